@@ -13,7 +13,7 @@
 #include "monitor.h"
 #include "drivers/displays/display.h"
 #include "drivers/storage/SDCard.h"
-#include "ShaTests/nerdSHA_HWTest.h"
+#include "ShaTests/nerdSHA_bench.h"
 #include "timeconst.h"
 
 #ifdef TOUCH_ENABLE
@@ -21,7 +21,7 @@
 #endif
 
 #include <soc/soc_caps.h>
-//#define HW_SHA256_TEST
+//#define SHA_BENCHMARK
 
 //3 seconds WDT
 #define WDT_TIMEOUT 3
@@ -79,8 +79,14 @@ void setup()
   disableCore0WDT();
   //disableCore1WDT();
 
-#ifdef HW_SHA256_TEST
-  while (1) HwShaTest();
+#ifdef SHA_BENCHMARK
+  while (1) runShaBenchmark();
+#else
+  if (shaBenchmarkRequested())
+  {
+    runShaBenchmark();
+    esp_restart();
+  }
 #endif
 
   // Setup the buttons
@@ -138,6 +144,11 @@ void setup()
   BaseType_t res1 = xTaskCreatePinnedToCore(runMonitor, "Monitor", 10000, (void*)monitor_name, 5, NULL,1);
   #endif
 
+  /******** CREATE JOB DISPATCHER TASK *****/
+  // Builds the templates the miners work on, woken by stratum and the miners
+  static const char dispatcher_name[] = "(Dispatcher)";
+  BaseType_t res3 = xTaskCreatePinnedToCore(runJobDispatcher, "Dispatcher", 4096, (void*)dispatcher_name, 4, NULL,1);
+
   /******** CREATE STRATUM TASK *****/
   static const char stratum_name[] = "(Stratum)";
  #if defined(CONFIG_IDF_TARGET_ESP32) && !defined(ESP32_2432S028R) && !defined(ESP32_2432S028_2USB)
@@ -214,6 +225,7 @@ void loop() {
   touchHandler.isTouched();
 #endif
   wifiManagerProcess(); // avoid delays() in loop when non-blocking and other long running code
+  shaBenchmarkSerialPoll();
 
   vTaskDelay(50 / portTICK_PERIOD_MS);
 }
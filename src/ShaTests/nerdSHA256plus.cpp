@@ -15,10 +15,12 @@
 #define NDEBUG
 #include <stdio.h>
 #include <string.h>
+#ifndef NERD_HOST_BUILD
 #include <Arduino.h>
 
 #include <esp_log.h>
 #include <esp_timer.h>
+#endif
 
 #include "nerdSHA256plus.h"
 #include <math.h>
@@ -88,6 +90,15 @@ DRAM_ATTR static const uint32_t K[64] = {
         h = temp1 + temp2;                                                                                             \
     }
 
+//P with h + K + x taken from the bake
+#define PB(a, b, c, d, e, f, g, h, hkx)                                                                                \
+    {                                                                                                                  \
+        temp1 = hkx + S3(e) + F1(e, f, g);                                                                             \
+        temp2 = S2(a) + F0(a, b, c);                                                                                   \
+        d += temp1;                                                                                                    \
+        h = temp1 + temp2;                                                                                             \
+    }
+
 uint32_t rotlFixed(uint32_t x, uint32_t y)
     {
         return (x << y) | (x >> (sizeof(y) * 8 - y));
@@ -454,7 +465,7 @@ IRAM_ATTR bool nerd_sha256d(nerdSHA256_context* midstate, const uint8_t* dataIn,
 }
 
 
-IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* bake)  //15 words
+IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* bake)  //NERD_BAKE_WORDS words
 {
     bake[0] = GET_UINT32_BE(dataIn, 0);
     bake[1] = GET_UINT32_BE(dataIn, 4);
@@ -464,6 +475,21 @@ IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, u
     bake[3] = S1(  0) + 0 + S0(bake[1]) + bake[0];
     bake[4] = S1(640) + 0 + S0(bake[2]) + bake[1];
 
+    nerd_sha256_bake_midstate(digest, bake);
+
+    //Nonce independent part of W18, W19, W31, W32
+    //W18 = S1(W16) + W11 + S0(W3)  + W2   -> bake[18] + S0(W3)
+    //W19 = S1(W17) + W12 + S0(W4)  + W3   -> bake[19] + W3
+    //W31 = S1(W29) + W24 + S0(W16) + W15  -> S1(W29) + W24 + bake[20]
+    //W32 = S1(W30) + W25 + S0(W17) + W16  -> S1(W30) + W25 + bake[21]
+    bake[18] = S1(bake[3]) + bake[2];
+    bake[19] = S1(bake[4]) + S0(0x80000000);
+    bake[20] = S0(bake[3]) + 640;
+    bake[21] = S0(bake[4]) + bake[3];
+}
+
+IRAM_ATTR void nerd_sha256_bake_midstate(const uint32_t* digest, uint32_t* bake)
+{
     uint32_t* a = bake + 5;
     a[0] = digest[0];
     a[1] = digest[1];
@@ -483,10 +509,44 @@ IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, u
     //P(a,    b,    c,    d,    e,    f,    g,    h,    x,    K)
     bake[13] = a[4] + S3(a[1]) + F1(a[1], a[2], a[3]) + K[3];// + x;
     bake[14] = S2(a[5]) + F0(a[5], a[6], a[7]);
+
+    //Rounds 4..6, h is not touched by round 3 yet: h + K + W
+    bake[15] = a[3] + K[4] + 0x80000000;
+    bake[16] = a[2] + K[5];
+    bake[17] = a[1] + K[6];
 }
 
 
-IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash)
+uint32_t nerd_zero_bits_mask(uint32_t bits)
+{
+    if (bits < NERD_ZERO_BITS_MIN) bits = NERD_ZERO_BITS_MIN;
+    if (bits > NERD_ZERO_BITS_MAX) bits = NERD_ZERO_BITS_MAX;
+
+    //hash[31] (most significant byte) is the low byte of H7, hash[28] the high one
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < 4 && bits > 8*i; ++i)
+    {
+        uint32_t b = bits - 8*i;
+        if (b > 8) b = 8;
+        mask |= ((0xFF00 >> b) & 0xFF) << (8*i);
+    }
+    return mask;
+}
+
+uint32_t nerd_zero_bits_from_diff(double difficulty)
+{
+    //diff 1 target is 0x00000000FFFF0000..., under 2^224: diff D gives 32 + floor(log2(D)) zero bits
+    if (difficulty <= 0.0)
+        return NERD_ZERO_BITS_MIN;
+    double bits = 32.0 + floor(log2(difficulty));
+    if (bits < NERD_ZERO_BITS_MIN)
+        return NERD_ZERO_BITS_MIN;
+    if (bits > NERD_ZERO_BITS_MAX)
+        return NERD_ZERO_BITS_MAX;
+    return (uint32_t)bits;
+}
+
+IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash, uint32_t zero_mask)
 {
     uint32_t temp1, temp2;
     //*********** Init 1rst SHA ***********
@@ -513,9 +573,12 @@ IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn,
     A[0] += temp1;
     A[4] = temp1 + temp2;
 
-    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[4], K[4]);
-    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[5], K[5]);
-    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[6], K[6]);
+    //P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[4], K[4]);
+    //P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[5], K[5]);
+    //P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[6], K[6]);
+    PB(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], bake[15]);
+    PB(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], bake[16]);
+    PB(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], bake[17]);
     P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[7], K[7]);
     P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[8], K[8]);
     P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[9], K[9]);
@@ -527,8 +590,10 @@ IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn,
     P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[15], K[15]);
     P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[16], K[16]);
     P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[17], K[17]);
-    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(18), K[18]);
-    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(19), K[19]);
+    W[18] = bake[18] + S0(W[3]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[18], K[18]);
+    W[19] = bake[19] + W[3];
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[19], K[19]);
     P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(20), K[20]);
     P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(21), K[21]);
     P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(22), K[22]);
@@ -540,8 +605,10 @@ IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn,
     P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(28), K[28]);
     P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(29), K[29]);
     P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(30), K[30]);
-    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(31), K[31]);
-    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(32), K[32]);
+    W[31] = S1(W[29]) + W[24] + bake[20];
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[31], K[31]);
+    W[32] = S1(W[30]) + W[25] + bake[21];
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[32], K[32]);
     P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(33), K[33]);
     P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(34), K[34]);
     P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(35), K[35]);
@@ -696,7 +763,8 @@ IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn,
     //P(a,    b,    c,    d,    e,    f,    g,    h,    x,     K)
     temp1 = A[3] + S3(A[0]) + F1(A[0], A[1], A[2]) + K[60] + R(60);
     uint32_t a7 = A[7] + temp1;
-    if ((uint32_t)(a7 & 0xFFFF) != 0x32E7)
+    //H7 = 0x5BE0CD19 + a7 must have the zero_mask bits cleared
+    if (((a7 + 0x5BE0CD19) & zero_mask) != 0)
         return false;
 
     //Post 57
@@ -742,3 +810,357 @@ IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn,
 #endif
     return true;
 }
+
+
+/************************************************************************************
+*   Interleaved nerd_sha256d_baked
+
+*   N consecutive nonces are hashed per call with the state kept as A[8][N].
+    Every round is issued for all lanes back to back, so the dependency chain of
+    one lane is hidden behind the other lanes instead of stalling the in-order
+    pipeline. All lanes share the same bake.
+
+*************************************************************************************/
+
+#define PL(a, b, c, d, e, f, g, h, x, K)                                                                               \
+    for (int l = 0; l < N; ++l)                                                                                        \
+        P(A[a][l], A[b][l], A[c][l], A[d][l], A[e][l], A[f][l], A[g][l], A[h][l], x, K)
+
+#define PBL(a, b, c, d, e, f, g, h, hkx)                                                                               \
+    for (int l = 0; l < N; ++l)                                                                                        \
+        PB(A[a][l], A[b][l], A[c][l], A[d][l], A[e][l], A[f][l], A[g][l], A[h][l], hkx)
+
+#define WL(t) W[t][l]
+#define RL(t) (W[t][l] = S1(W[t - 2][l]) + W[t - 7][l] + S0(W[t - 15][l]) + W[t - 16][l])
+
+#define PL8(t, x)                                                                                                      \
+    PL(0, 1, 2, 3, 4, 5, 6, 7, x(t + 0), K[t + 0]);                                                                    \
+    PL(7, 0, 1, 2, 3, 4, 5, 6, x(t + 1), K[t + 1]);                                                                    \
+    PL(6, 7, 0, 1, 2, 3, 4, 5, x(t + 2), K[t + 2]);                                                                    \
+    PL(5, 6, 7, 0, 1, 2, 3, 4, x(t + 3), K[t + 3]);                                                                    \
+    PL(4, 5, 6, 7, 0, 1, 2, 3, x(t + 4), K[t + 4]);                                                                    \
+    PL(3, 4, 5, 6, 7, 0, 1, 2, x(t + 5), K[t + 5]);                                                                    \
+    PL(2, 3, 4, 5, 6, 7, 0, 1, x(t + 6), K[t + 6]);                                                                    \
+    PL(1, 2, 3, 4, 5, 6, 7, 0, x(t + 7), K[t + 7])
+
+template <int N>
+static inline __attribute__((always_inline)) uint32_t nerd_sha256d_baked_lanes(const uint32_t* digest, const uint32_t* bake, uint32_t nonce, uint8_t* doubleHash, uint32_t zero_mask)
+{
+    uint32_t temp1, temp2;
+    uint32_t W[64][N];
+    uint32_t A[8][N];
+    const uint32_t* a = bake + 5;
+
+    //*********** Init 1rst SHA ***********
+    for (int l = 0; l < N; ++l)
+    {
+        W[0][l] = bake[0];
+        W[1][l] = bake[1];
+        W[2][l] = bake[2];
+        W[3][l] = __builtin_bswap32(nonce + l);
+        W[4][l] = 0x80000000;
+        W[5][l] = 0; W[6][l] = 0; W[7][l] = 0; W[8][l] = 0; W[9][l] = 0;
+        W[10][l] = 0; W[11][l] = 0; W[12][l] = 0; W[13][l] = 0; W[14][l] = 0;
+        W[15][l] = 640;
+        W[16][l] = bake[3];
+        W[17][l] = bake[4];
+
+        //Round 3, first one depending on the nonce
+        temp1 = bake[13] + W[3][l];
+        A[0][l] = a[0] + temp1;
+        A[1][l] = a[1];
+        A[2][l] = a[2];
+        A[3][l] = a[3];
+        A[4][l] = temp1 + bake[14];
+        A[5][l] = a[5];
+        A[6][l] = a[6];
+        A[7][l] = a[7];
+    }
+
+    PBL(4, 5, 6, 7, 0, 1, 2, 3, bake[15]);
+    PBL(3, 4, 5, 6, 7, 0, 1, 2, bake[16]);
+    PBL(2, 3, 4, 5, 6, 7, 0, 1, bake[17]);
+    PL(1, 2, 3, 4, 5, 6, 7, 0, WL(7), K[7]);
+    PL8(8, WL);
+    PL(0, 1, 2, 3, 4, 5, 6, 7, WL(16), K[16]);
+    PL(7, 0, 1, 2, 3, 4, 5, 6, WL(17), K[17]);
+    PL(6, 7, 0, 1, 2, 3, 4, 5, (W[18][l] = bake[18] + S0(W[3][l])), K[18]);
+    PL(5, 6, 7, 0, 1, 2, 3, 4, (W[19][l] = bake[19] + W[3][l]), K[19]);
+    PL(4, 5, 6, 7, 0, 1, 2, 3, RL(20), K[20]);
+    PL(3, 4, 5, 6, 7, 0, 1, 2, RL(21), K[21]);
+    PL(2, 3, 4, 5, 6, 7, 0, 1, RL(22), K[22]);
+    PL(1, 2, 3, 4, 5, 6, 7, 0, RL(23), K[23]);
+    PL(0, 1, 2, 3, 4, 5, 6, 7, RL(24), K[24]);
+    PL(7, 0, 1, 2, 3, 4, 5, 6, RL(25), K[25]);
+    PL(6, 7, 0, 1, 2, 3, 4, 5, RL(26), K[26]);
+    PL(5, 6, 7, 0, 1, 2, 3, 4, RL(27), K[27]);
+    PL(4, 5, 6, 7, 0, 1, 2, 3, RL(28), K[28]);
+    PL(3, 4, 5, 6, 7, 0, 1, 2, RL(29), K[29]);
+    PL(2, 3, 4, 5, 6, 7, 0, 1, RL(30), K[30]);
+    PL(1, 2, 3, 4, 5, 6, 7, 0, (W[31][l] = S1(W[29][l]) + W[24][l] + bake[20]), K[31]);
+    PL(0, 1, 2, 3, 4, 5, 6, 7, (W[32][l] = S1(W[30][l]) + W[25][l] + bake[21]), K[32]);
+    PL(7, 0, 1, 2, 3, 4, 5, 6, RL(33), K[33]);
+    PL(6, 7, 0, 1, 2, 3, 4, 5, RL(34), K[34]);
+    PL(5, 6, 7, 0, 1, 2, 3, 4, RL(35), K[35]);
+    PL(4, 5, 6, 7, 0, 1, 2, 3, RL(36), K[36]);
+    PL(3, 4, 5, 6, 7, 0, 1, 2, RL(37), K[37]);
+    PL(2, 3, 4, 5, 6, 7, 0, 1, RL(38), K[38]);
+    PL(1, 2, 3, 4, 5, 6, 7, 0, RL(39), K[39]);
+    PL8(40, RL);
+    PL8(48, RL);
+    PL8(56, RL);
+
+    //*********** end SHA_finish ***********
+
+    /* Calculate the second hash (double SHA-256) */
+    for (int l = 0; l < N; ++l)
+    {
+        W[0][l] = A[0][l] + digest[0];
+        W[1][l] = A[1][l] + digest[1];
+        W[2][l] = A[2][l] + digest[2];
+        W[3][l] = A[3][l] + digest[3];
+        W[4][l] = A[4][l] + digest[4];
+        W[5][l] = A[5][l] + digest[5];
+        W[6][l] = A[6][l] + digest[6];
+        W[7][l] = A[7][l] + digest[7];
+        W[8][l] = 0x80000000;
+        W[9][l] = 0; W[10][l] = 0; W[11][l] = 0; W[12][l] = 0; W[13][l] = 0; W[14][l] = 0;
+        W[15][l] = 256;
+
+        A[0][l] = 0x6A09E667;
+        A[1][l] = 0xBB67AE85;
+        A[2][l] = 0x3C6EF372;
+        A[3][l] = 0xA54FF53A;
+        A[4][l] = 0x510E527F;
+        A[5][l] = 0x9B05688C;
+        A[6][l] = 0x1F83D9AB;
+        A[7][l] = 0x5BE0CD19;
+    }
+
+    PL8(0, WL);
+    PL8(8, WL);
+    PL8(16, RL);
+    PL8(24, RL);
+    PL8(32, RL);
+    PL8(40, RL);
+    PL8(48, RL);
+    PL(0, 1, 2, 3, 4, 5, 6, 7, RL(56), K[56]);
+
+    //Rounds 57..60 only up to a7, same early reject as nerd_sha256d_baked
+    uint32_t m1[N], z1[N], t1[N], e1[N], a7[N], d57_a1[N], d58_a0[N];
+    uint32_t mask = 0;
+    for (int l = 0; l < N; ++l)
+    {
+        m1[l] = A[6][l] + S3(A[3][l]) + F1(A[3][l], A[4][l], A[5][l]) + K[57] + RL(57);
+        A[2][l] += m1[l];
+        d57_a1[l] = A[1][l];
+
+        z1[l] = A[5][l] + S3(A[2][l]) + F1(A[2][l], A[3][l], A[4][l]) + K[58] + RL(58);
+        d58_a0[l] = A[0][l];
+        A[1][l] += z1[l];
+
+        t1[l] = A[4][l] + S3(A[1][l]) + F1(A[1][l], A[2][l], A[3][l]) + K[59] + RL(59);
+        A[0][l] += t1[l];
+
+        e1[l] = A[3][l] + S3(A[0][l]) + F1(A[0][l], A[1][l], A[2][l]) + K[60] + RL(60);
+        a7[l] = A[7][l] + e1[l];
+        if (((a7[l] + 0x5BE0CD19) & zero_mask) == 0)
+            mask |= 1u << l;
+    }
+    if (!mask)
+        return 0;
+
+    for (int l = 0; l < N; ++l)
+    {
+        if (!(mask & (1u << l)))
+            continue;
+
+        uint32_t h[8] = { A[0][l], A[1][l], A[2][l], A[3][l], A[4][l], A[5][l], A[6][l], A[7][l] };
+        h[6] = m1[l] + S2(h[7]) + F0(h[7], d58_a0[l], d57_a1[l]);
+        h[5] = z1[l] + S2(h[6]) + F0(h[6], h[7], d58_a0[l]);
+        h[4] = t1[l] + S2(h[5]) + F0(h[5], h[6], h[7]);
+        h[7] = a7[l];
+        h[3] = e1[l] + S2(h[4]) + F0(h[4], h[5], h[6]);
+
+        P(h[3], h[4], h[5], h[6], h[7], h[0], h[1], h[2], RL(61), K[61]);
+        P(h[2], h[3], h[4], h[5], h[6], h[7], h[0], h[1], RL(62), K[62]);
+        P(h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[0], RL(63), K[63]);
+
+        uint8_t* out = doubleHash + 32 * l;
+        ((uint32_t*)out)[0] = __builtin_bswap32(0x6A09E667 + h[0]);
+        ((uint32_t*)out)[1] = __builtin_bswap32(0xBB67AE85 + h[1]);
+        ((uint32_t*)out)[2] = __builtin_bswap32(0x3C6EF372 + h[2]);
+        ((uint32_t*)out)[3] = __builtin_bswap32(0xA54FF53A + h[3]);
+        ((uint32_t*)out)[4] = __builtin_bswap32(0x510E527F + h[4]);
+        ((uint32_t*)out)[5] = __builtin_bswap32(0x9B05688C + h[5]);
+        ((uint32_t*)out)[6] = __builtin_bswap32(0x1F83D9AB + h[6]);
+        ((uint32_t*)out)[7] = __builtin_bswap32(0x5BE0CD19 + h[7]);
+    }
+    return mask;
+}
+
+IRAM_ATTR uint32_t nerd_sha256d_baked_x2(const uint32_t* digest, const uint32_t* bake, uint32_t nonce, uint8_t* doubleHash, uint32_t zero_mask)
+{
+    return nerd_sha256d_baked_lanes<2>(digest, bake, nonce, doubleHash, zero_mask);
+}
+
+IRAM_ATTR uint32_t nerd_sha256d_baked_x4(const uint32_t* digest, const uint32_t* bake, uint32_t nonce, uint8_t* doubleHash, uint32_t zero_mask)
+{
+    return nerd_sha256d_baked_lanes<4>(digest, bake, nonce, doubleHash, zero_mask);
+}
+
+//Message schedule of the padding block that follows a 64 byte message
+DRAM_ATTR static const uint32_t W_PAD64[64] = {
+    0x80000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000200,
+    0x80000000, 0x01400000, 0x00205000, 0x00005088, 0x22000800, 0x22550014, 0x05089742, 0xA0000020,
+    0x5A880000, 0x005C9400, 0x0016D49D, 0xFA801F00, 0xD33225D0, 0x11675959, 0xF6E6BFDA, 0xB30C1549,
+    0x08B2B050, 0x9D7C4C27, 0x0CE2A393, 0x88E6E1EA, 0xA52B4335, 0x67A16F49, 0xD732016F, 0x4EEB2E91,
+    0x5DBF55E5, 0x8EEE2335, 0xE2BC5EC2, 0xA83F4394, 0x45AD78F7, 0x36F3D0CD, 0xD99C05E8, 0xB0511DC7,
+    0x69BC7AC4, 0xBD11375B, 0xE3BA71E5, 0x3B209FF2, 0x18FEEE17, 0xE25AD9E7, 0x13375046, 0x0515089D,
+    0x4F0D0F04, 0x2627484E, 0x310128D2, 0xC668B434, 0x420841CC, 0x62D311B8, 0xE59BA771, 0x85A7A484,
+};
+
+//Rounds over a fully expanded schedule. Per job hashing only, kept compact
+static void nerd_sha256_rounds(uint32_t* state, const uint32_t* W)
+{
+    uint32_t temp1, temp2;
+    uint32_t A[8];
+    memcpy(A, state, sizeof(A));
+    for (int t = 0; t < 64; t += 8)
+    {
+        P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[t], K[t]);
+        P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[t + 1], K[t + 1]);
+        P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[t + 2], K[t + 2]);
+        P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[t + 3], K[t + 3]);
+        P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[t + 4], K[t + 4]);
+        P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[t + 5], K[t + 5]);
+        P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[t + 6], K[t + 6]);
+        P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[t + 7], K[t + 7]);
+    }
+    for (int i = 0; i < 8; ++i)
+        state[i] += A[i];
+}
+
+static void nerd_sha256_expand(uint32_t* W)
+{
+    for (int t = 16; t < 64; ++t)
+        R(t);
+}
+
+//Second hash of a sha256d: the 32 byte first hash as state words, one block
+static void nerd_sha256_32_words(const uint32_t* hash1, uint8_t* hash)
+{
+    uint32_t state[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+    uint32_t W[64];
+    memcpy(W, hash1, 32);
+    W[8] = 0x80000000;
+    memset(W + 9, 0, 6 * sizeof(uint32_t));
+    W[15] = 256;
+    nerd_sha256_expand(W);
+    nerd_sha256_rounds(state, W);
+    for (int i = 0; i < 8; ++i)
+    {
+        hash[4 * i] = state[i] >> 24;
+        hash[4 * i + 1] = state[i] >> 16;
+        hash[4 * i + 2] = state[i] >> 8;
+        hash[4 * i + 3] = state[i];
+    }
+}
+
+void nerd_sha256_block(uint32_t* state, const uint8_t* block)
+{
+    uint32_t W[64];
+    for (int i = 0; i < 16; ++i)
+        W[i] = GET_UINT32_BE(block, 4 * i);
+    nerd_sha256_expand(W);
+    nerd_sha256_rounds(state, W);
+}
+
+void nerd_sha256_32(const uint8_t* dataIn, uint8_t* hash)
+{
+    uint32_t words[8];
+    for (int i = 0; i < 8; ++i)
+        words[i] = GET_UINT32_BE(dataIn, 4 * i);
+    nerd_sha256_32_words(words, hash);
+}
+
+void nerd_sha256d_64(const uint8_t* dataIn, uint8_t* doubleHash)
+{
+    uint32_t state[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+    nerd_sha256_block(state, dataIn);
+    nerd_sha256_rounds(state, W_PAD64);
+    nerd_sha256_32_words(state, doubleHash);
+}
+
+/************************************************************************************
+*   Resumable sha256d
+*************************************************************************************/
+
+#define RS(t) (W[(t) & 15] += S1(W[((t) - 2) & 15]) + W[((t) - 7) & 15] + S0(W[((t) - 15) & 15]))
+
+void nerd_sha256d_slice_start(nerd_sha256d_slice* ctx, const uint32_t* digest, const uint8_t* dataIn, uint32_t nonce)
+{
+    ctx->W[0] = GET_UINT32_BE(dataIn, 0);
+    ctx->W[1] = GET_UINT32_BE(dataIn, 4);
+    ctx->W[2] = GET_UINT32_BE(dataIn, 8);
+    ctx->W[3] = __builtin_bswap32(nonce);
+    ctx->W[4] = 0x80000000;
+    memset(ctx->W + 5, 0, 10 * sizeof(uint32_t));
+    ctx->W[15] = 640;
+    memcpy(ctx->A, digest, sizeof(ctx->A));
+    memcpy(ctx->H, digest, sizeof(ctx->H));
+    ctx->nonce = nonce;
+    ctx->round = 0;
+}
+
+IRAM_ATTR bool nerd_sha256d_slice_step(nerd_sha256d_slice* ctx, uint32_t rounds, uint8_t* doubleHash)
+{
+    uint32_t temp1, temp2;
+    uint32_t* W = ctx->W;
+    uint32_t* A = ctx->A;
+    uint32_t end = ctx->round + rounds;
+    if (end > 128)
+        end = 128;
+    while (ctx->round < end)
+    {
+        uint32_t t = ctx->round & 63;
+        if (t >= 16)
+        {
+            RS(t); RS(t + 1); RS(t + 2); RS(t + 3); RS(t + 4); RS(t + 5); RS(t + 6); RS(t + 7);
+        }
+        P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[t & 15], K[t]);
+        P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[(t + 1) & 15], K[t + 1]);
+        P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[(t + 2) & 15], K[t + 2]);
+        P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[(t + 3) & 15], K[t + 3]);
+        P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[(t + 4) & 15], K[t + 4]);
+        P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[(t + 5) & 15], K[t + 5]);
+        P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[(t + 6) & 15], K[t + 6]);
+        P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[(t + 7) & 15], K[t + 7]);
+        ctx->round += 8;
+
+        if (ctx->round == 64)
+        {
+            //First hash done, it is the message of the second
+            static const uint32_t iv[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+            for (int i = 0; i < 8; ++i)
+                W[i] = ctx->H[i] + A[i];
+            W[8] = 0x80000000;
+            memset(W + 9, 0, 6 * sizeof(uint32_t));
+            W[15] = 256;
+            memcpy(ctx->H, iv, sizeof(iv));
+            memcpy(A, iv, sizeof(iv));
+        }
+    }
+    if (ctx->round < 128)
+        return false;
+    for (int i = 0; i < 8; ++i)
+    {
+        uint32_t h = ctx->H[i] + A[i];
+        doubleHash[4 * i] = h >> 24;
+        doubleHash[4 * i + 1] = h >> 16;
+        doubleHash[4 * i + 2] = h >> 8;
+        doubleHash[4 * i + 3] = h;
+    }
+    return true;
+}
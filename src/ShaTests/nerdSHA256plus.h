@@ -17,6 +17,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <esp_attr.h>
 
 
 struct nerdSHA256_context {
@@ -29,8 +30,65 @@ IRAM_ATTR void nerd_mids(uint32_t* digest, const uint8_t* dataIn);
 
 IRAM_ATTR bool nerd_sha256d(nerdSHA256_context* midstate, const uint8_t* dataIn, uint8_t* doubleHash);
 
-IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* bake);  //15 words
-IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+//W0..W2, W16, W17, rounds 0..2, h+K+W of rounds 4..6 and the nonce independent part of W18, W19, W31, W32
+#define NERD_BAKE_WORDS 22
+
+IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* bake);  //NERD_BAKE_WORDS words
+/* Only the midstate dependent words of bake, for a header that differs in its first block
+   alone (version rolling): the W words of the second block are kept */
+IRAM_ATTR void nerd_sha256_bake_midstate(const uint32_t* digest, uint32_t* bake);
+/* Early reject at round 60 of the second hash: only hashes with the zero bits
+   selected by zero_mask (see nerd_zero_bits_mask) are finished and return true */
+IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash, uint32_t zero_mask);
+
+/* Interleaved baked sha256d over nonce, nonce+1, ... (2 or 4 lanes)
+   Returns a bit mask of the lanes passing zero_mask, lane l hash at doubleHash+32*l */
+IRAM_ATTR uint32_t nerd_sha256d_baked_x2(const uint32_t* digest, const uint32_t* bake, uint32_t nonce, uint8_t* doubleHash, uint32_t zero_mask);
+IRAM_ATTR uint32_t nerd_sha256d_baked_x4(const uint32_t* digest, const uint32_t* bake, uint32_t nonce, uint8_t* doubleHash, uint32_t zero_mask);
+
+//Leading zero bits of the hash (as little endian 256bit number) that can be checked at round 60
+#define NERD_ZERO_BITS_MIN 16
+#define NERD_ZERO_BITS_MAX 32
+
+/* Mask over the last word of the second hash for "bits" leading zero bits, 16 bits -> 0x0000FFFF */
+uint32_t nerd_zero_bits_mask(uint32_t bits);
+/* Leading zero bits every hash over "difficulty" has, clamped to NERD_ZERO_BITS_MIN..MAX */
+uint32_t nerd_zero_bits_from_diff(double difficulty);
+
+//Nonces per call in minerWorkerSw: 1 (nerd_sha256d_baked), 2 or 4
+#ifndef NERD_SHA_LANES
+#define NERD_SHA_LANES 1
+#endif
+
+#if NERD_SHA_LANES == 2
+#define NERD_SHA_BAKED_LANES nerd_sha256d_baked_x2
+#elif NERD_SHA_LANES == 4
+#define NERD_SHA_BAKED_LANES nerd_sha256d_baked_x4
+#elif NERD_SHA_LANES != 1
+#error "NERD_SHA_LANES must be 1, 2 or 4"
+#endif
+
+/* Resumable sha256d of one nonce, a few rounds at a time: fills the short waits on the SHA
+   peripheral in minerWorkerHw. No bake and no early reject, the 128 rounds of both hashes
+   are done in calls of any multiple of 8 rounds */
+struct nerd_sha256d_slice {
+    uint32_t W[16];     //schedule, W[t & 15]
+    uint32_t A[8];      //working variables
+    uint32_t H[8];      //state the hash in progress adds to: midstate, then the IV
+    uint32_t nonce;
+    uint32_t round;     //0..128, the second hash from 64
+};
+
+void nerd_sha256d_slice_start(nerd_sha256d_slice* ctx, const uint32_t* digest, const uint8_t* dataIn, uint32_t nonce);
+/* true once all rounds are done, the hash in doubleHash (digest byte order) */
+IRAM_ATTR bool nerd_sha256d_slice_step(nerd_sha256d_slice* ctx, uint32_t rounds, uint8_t* doubleHash);
+
+/* Per job hashing, not on the nonce path: one compression of a 64 byte block into state (8 words,
+   starting from the sha256 IV), sha256 of a 32 byte message (the second half of a sha256d) and
+   sha256d of a 64 byte one (a merkle node). Hashes come out in digest byte order */
+void nerd_sha256_block(uint32_t* state, const uint8_t* block);
+void nerd_sha256_32(const uint8_t* dataIn, uint8_t* hash);
+void nerd_sha256d_64(const uint8_t* dataIn, uint8_t* doubleHash);
 
 void ByteReverseWords(uint32_t* out, const uint32_t* in, uint32_t byteCount);
 
@@ -0,0 +1,125 @@
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_freertos_hooks.h>
+#include <soc/soc_caps.h>
+#include "mining.h"
+#include "version.h"
+#include "ShaTests/nerdSHA_bench.h"
+
+#define BENCH_REQUEST_MAGIC 0x42454E43  //"BENC", in RTC memory across the restart
+#define BENCH_CALIBRATE_MS  200         //Idle hook rate of the cores with nothing to run
+
+#if (SOC_CPU_CORES_NUM >= 2)
+#define BENCH_CORES 2
+#else
+#define BENCH_CORES 1
+#endif
+
+static RTC_NOINIT_ATTR uint32_t s_bench_request;
+
+//Core load: the idle task calls these as fast as it can while the core has nothing else to run
+static volatile uint32_t s_idle_calls[BENCH_CORES];
+static float s_idle_calls_per_ms[BENCH_CORES];
+
+static bool IdleHookCore0()
+{
+  s_idle_calls[0]++;
+  return false;
+}
+
+#if (BENCH_CORES >= 2)
+static bool IdleHookCore1()
+{
+  s_idle_calls[1]++;
+  return false;
+}
+#endif
+
+static void IdleCountStart()
+{
+  for (int c = 0; c < BENCH_CORES; ++c)
+    s_idle_calls[c] = 0;
+}
+
+void runShaBenchmark()
+{
+  static bool hooked = false;
+  if (!hooked)
+  {
+    esp_register_freertos_idle_hook_for_cpu(IdleHookCore0, 0);
+#if (BENCH_CORES >= 2)
+    esp_register_freertos_idle_hook_for_cpu(IdleHookCore1, 1);
+#endif
+    hooked = true;
+  }
+  IdleCountStart();
+  uint32_t time_start = micros();
+  vTaskDelay(BENCH_CALIBRATE_MS / portTICK_PERIOD_MS);
+  float calibrate_ms = (micros() - time_start) / 1000.0f;
+  for (int c = 0; c < BENCH_CORES; ++c)
+    s_idle_calls_per_ms[c] = s_idle_calls[c] / calibrate_ms;
+
+  Serial.printf("[BENCH] %s %s, %d ms per kernel on core %d\n", CONFIG_IDF_TARGET, CURRENT_VERSION, SHA_BENCH_MS, xPortGetCoreID());
+  for (int k = 0; k < SHA_BENCH_KERNELS; ++k)
+  {
+    ShaBenchResult r = {};
+    r.kernel = (ShaBenchKernel)k;
+    IdleCountStart();
+    if (!minerBenchKernel(r.kernel, SHA_BENCH_MS, r.hashes, r.elapsed_us))
+      continue;
+    float elapsed_ms = r.elapsed_us / 1000.0f;
+    for (int c = 0; c < BENCH_CORES; ++c)
+    {
+      float load = -1;
+      if (s_idle_calls_per_ms[c] > 0)
+        load = constrain(1.0f - s_idle_calls[c] / elapsed_ms / s_idle_calls_per_ms[c], 0.0f, 1.0f);
+      r.core_load[c] = load;
+    }
+    r.target = CONFIG_IDF_TARGET;
+    r.version = CURRENT_VERSION;
+    r.core = xPortGetCoreID();
+    r.cores = BENCH_CORES;
+    r.free_heap = ESP.getFreeHeap();
+    char line[320];
+    sha_bench_json(line, sizeof(line), r);
+    Serial.print(line);
+    //The idle task gets its turn between two kernels
+    vTaskDelay(1);
+  }
+}
+
+//Nothing else reads the console: every byte is taken, a full line "bench" is the command
+void shaBenchmarkSerialPoll()
+{
+  static char line[16];
+  static uint8_t used = 0;
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+    if (c != '\r' && c != '\n')
+    {
+      if (used < sizeof(line) - 1)
+        line[used++] = c;
+      continue;
+    }
+    line[used] = 0;
+    used = 0;
+    if (strcmp(line, "bench") == 0)
+    {
+      //Miners, wifi and screen all running would skew the rates, the benchmark gets a fresh boot
+      Serial.println("[BENCH] Restarting into the benchmark");
+      Serial.flush();
+      s_bench_request = BENCH_REQUEST_MAGIC;
+      esp_restart();
+    }
+  }
+}
+
+bool shaBenchmarkRequested()
+{
+  //RTC_NOINIT memory is random after power on
+  bool requested = esp_reset_reason() == ESP_RST_SW && s_bench_request == BENCH_REQUEST_MAGIC;
+  s_bench_request = 0;
+  return requested;
+}
@@ -0,0 +1,19 @@
+#ifndef nerdSHA_bench_H_
+#define nerdSHA_bench_H_
+
+//Benchmark mode, the lines in sha_bench.h. -D SHA_BENCHMARK runs it instead of the miner,
+//"bench" on the serial console restarts into one run and back to mining
+#if defined(HW_SHA256_TEST) && !defined(SHA_BENCHMARK)
+#define SHA_BENCHMARK
+#endif
+
+//Every kernel of the build for SHA_BENCH_MS, in the calling task, before any other task is started
+void runShaBenchmark();
+
+//From loop(): reads the serial console, "bench" restarts the board into runShaBenchmark
+void shaBenchmarkSerialPoll();
+
+//Once after the restart shaBenchmarkSerialPoll asked for
+bool shaBenchmarkRequested();
+
+#endif /* nerdSHA_bench_H_ */
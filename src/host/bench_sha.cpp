@@ -0,0 +1,604 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "host.h"
+#include "ShaTests/nerdSHA256plus.h"
+#include "mbedtls/sha256.h"
+#include "job_header.h"
+#include "sha_bench.h"
+#include "version.h"
+
+#define BENCH_NONCES_DEFAULT   2000000
+#define BENCH_MIDS_CALLS       200000
+#define SELFTEST_HEADERS       64
+#define SELFTEST_NONCES        16384
+#define NONCE_START            0xDA54E700
+
+static uint64_t s_rng_state = 0x4E45524421ull;
+static uint32_t rng_next()
+{
+    s_rng_state ^= s_rng_state << 13;
+    s_rng_state ^= s_rng_state >> 7;
+    s_rng_state ^= s_rng_state << 17;
+    return (uint32_t)(s_rng_state >> 16);
+}
+
+static void set_nonce(uint8_t* sha_buffer, uint32_t nonce)
+{
+    memcpy(sha_buffer + 64 + 12, &nonce, sizeof(nonce));
+}
+
+static void reference_sha256d(const uint8_t* header, uint8_t* hash)
+{
+    uint8_t inter[32];
+    mbedtls_sha256_ret(header, 80, inter, 0);
+    mbedtls_sha256_ret(inter, 32, hash, 0);
+}
+
+//Kernels only return a hash when the top 16 bits of the result are zero
+static bool passes_prefilter(const uint8_t* hash)
+{
+    return hash[31] == 0 && hash[30] == 0;
+}
+
+//Leading zero bits of the hash read as a little endian 256bit number
+static uint32_t leading_zero_bits(const uint8_t* hash)
+{
+    uint32_t bits = 0;
+    for (int i = 31; i >= 0; --i)
+    {
+        if (hash[i])
+            return bits + __builtin_clz(hash[i]) - 24;
+        bits += 8;
+    }
+    return bits;
+}
+
+//Share difficulty, diff 1 target is 0xFFFF * 2^208
+static double hash_difficulty(const uint8_t* hash)
+{
+    double value = 0.0;
+    for (int i = 31; i >= 0; --i)
+        value = value * 256.0 + hash[i];
+    return value > 0.0 ? ldexp(0xFFFF, 208) / value : 1e300;
+}
+
+//Zero bits filter: masks, difficulty mapping and the baked kernel with 16..32 bits
+static int zero_bits_selftest()
+{
+    int errors = 0;
+    static const struct { uint32_t bits, mask; } s_masks[] = {
+        { 8, 0x0000FFFF }, { 16, 0x0000FFFF }, { 18, 0x00C0FFFF }, { 20, 0x00F0FFFF },
+        { 24, 0x00FFFFFF }, { 29, 0xF8FFFFFF }, { 32, 0xFFFFFFFF }, { 40, 0xFFFFFFFF },
+    };
+    for (size_t i = 0; i < sizeof(s_masks)/sizeof(s_masks[0]); ++i)
+    {
+        if (nerd_zero_bits_mask(s_masks[i].bits) != s_masks[i].mask)
+        {
+            printf("FAIL nerd_zero_bits_mask(%u) = %08X expected %08X\n", s_masks[i].bits, nerd_zero_bits_mask(s_masks[i].bits), s_masks[i].mask);
+            errors++;
+        }
+    }
+    static const struct { double diff; uint32_t bits; } s_diffs[] = {
+        { 0.0, 16 }, { 0.00001, 16 }, { 0.0001, 18 }, { 0.001, 22 }, { 0.5, 31 }, { 0.99, 31 }, { 1.0, 32 }, { 512.0, 32 },
+    };
+    for (size_t i = 0; i < sizeof(s_diffs)/sizeof(s_diffs[0]); ++i)
+    {
+        if (nerd_zero_bits_from_diff(s_diffs[i].diff) != s_diffs[i].bits)
+        {
+            printf("FAIL nerd_zero_bits_from_diff(%g) = %u expected %u\n", s_diffs[i].diff, nerd_zero_bits_from_diff(s_diffs[i].diff), s_diffs[i].bits);
+            errors++;
+        }
+    }
+    //A hash over the difficulty must never be filtered out by the bits derived from it
+    for (uint32_t i = 0; i < 1000000; ++i)
+    {
+        uint8_t hash[32];
+        for (int b = 0; b < 32; ++b)
+            hash[b] = (uint8_t)rng_next();
+        uint32_t zeros = 16 + (rng_next() % 24);
+        for (uint32_t b = 0; b < zeros; ++b)
+            hash[31 - b/8] &= ~(0x80 >> (b % 8));
+        double diff = hash_difficulty(hash);
+        if (leading_zero_bits(hash) < nerd_zero_bits_from_diff(diff))
+        {
+            printf("FAIL nerd_zero_bits_from_diff(%g) = %u, hash has %u zero bits\n", diff, nerd_zero_bits_from_diff(diff), leading_zero_bits(hash));
+            errors++;
+            break;
+        }
+    }
+    return errors;
+}
+
+//Per job hashing: the 32/64 byte fast paths and the cached coinbase prefix against mbedtls one shot
+static int merkle_selftest()
+{
+    int errors = 0;
+    uint8_t data[64], inter[32], ref[32], hash[32];
+    for (int r = 0; r < 1000; ++r)
+    {
+        for (int i = 0; i < 64; ++i)
+            data[i] = (uint8_t)rng_next();
+        mbedtls_sha256_ret(data, 64, inter, 0);
+        mbedtls_sha256_ret(inter, 32, ref, 0);
+        nerd_sha256d_64(data, hash);
+        if (memcmp(hash, ref, 32) != 0)
+            errors++;
+        mbedtls_sha256_ret(data, 32, ref, 0);
+        nerd_sha256_32(data, hash);
+        if (memcmp(hash, ref, 32) != 0)
+            errors++;
+    }
+    if (errors)
+        printf("FAIL nerd_sha256d_64 / nerd_sha256_32 mismatch\n");
+
+    //Every coinbase length around the block boundaries, extranonces split anywhere
+    static mining_job s_job;
+    static uint8_t s_coinbase[COINBASE_SIZE + EXTRANONCE_SIZE + COINBASE2_SIZE];
+    job_merkle_cache cache;
+    uint8_t extranonce[EXTRANONCE_SIZE];
+    for (int r = 0; r < 4000; ++r)
+    {
+        s_job.coinb1_size = rng_next() % 200;
+        s_job.coinb2_size = rng_next() % 200;
+        size_t extranonce1_size = rng_next() % 9;
+        size_t extranonce2_size = rng_next() % 9;
+        for (int i = 0; i < s_job.coinb1_size; ++i)
+            s_job.coinb1[i] = (uint8_t)rng_next();
+        for (int i = 0; i < s_job.coinb2_size; ++i)
+            s_job.coinb2[i] = (uint8_t)rng_next();
+        for (size_t i = 0; i < extranonce1_size + extranonce2_size; ++i)
+            extranonce[i] = (uint8_t)rng_next();
+        s_job.merkle_branch_count = rng_next() % 4;
+        for (int k = 0; k < s_job.merkle_branch_count; ++k)
+            for (int i = 0; i < 32; ++i)
+                s_job.merkle_branch[k][i] = (uint8_t)rng_next();
+
+        size_t size = 0;
+        memcpy(s_coinbase + size, s_job.coinb1, s_job.coinb1_size);
+        size += s_job.coinb1_size;
+        memcpy(s_coinbase + size, extranonce, extranonce1_size + extranonce2_size);
+        size += extranonce1_size + extranonce2_size;
+        memcpy(s_coinbase + size, s_job.coinb2, s_job.coinb2_size);
+        size += s_job.coinb2_size;
+        mbedtls_sha256_ret(s_coinbase, size, inter, 0);
+        mbedtls_sha256_ret(inter, 32, ref, 0);
+        for (int k = 0; k < s_job.merkle_branch_count; ++k)
+        {
+            memcpy(data, ref, 32);
+            memcpy(data + 32, s_job.merkle_branch[k], 32);
+            mbedtls_sha256_ret(data, 64, inter, 0);
+            mbedtls_sha256_ret(inter, 32, ref, 0);
+        }
+
+        job_merkle_begin(cache, s_job, extranonce, extranonce1_size);
+        job_coinbase_hash(cache, extranonce + extranonce1_size, extranonce2_size, hash);
+        job_merkle_root(s_job, hash, hash);
+        if (memcmp(hash, ref, 32) != 0)
+        {
+            printf("FAIL merkle root, coinbase %u + %u + %u + %u bytes, %d branches\n", s_job.coinb1_size,
+                   (unsigned)extranonce1_size, (unsigned)extranonce2_size, s_job.coinb2_size, s_job.merkle_branch_count);
+            errors++;
+            break;
+        }
+    }
+    return errors;
+}
+
+//Version rolling keeps the W words of the bake, only its midstate part is redone
+static int version_roll_selftest()
+{
+    int errors = 0;
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8], bake[NERD_BAKE_WORDS], ref[NERD_BAKE_WORDS];
+    for (size_t c = 0; c < g_host_corpus_size; ++c)
+    {
+        host_make_sha_buffer(g_host_corpus[c], sha_buffer);
+        nerd_mids(midstate, sha_buffer);
+        nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+        uint32_t version = 0x20000000;
+        for (int r = 0; r < 64 && job_version_roll(version, 0x1fffe000); ++r)
+        {
+            job_header_version(sha_buffer, version);
+            nerd_mids(midstate, sha_buffer);
+            nerd_sha256_bake_midstate(midstate, bake);
+            nerd_sha256_bake(midstate, sha_buffer + 64, ref);
+            if (memcmp(bake, ref, sizeof(ref)) != 0)
+                errors++;
+        }
+    }
+    //Every subset of the mask once, the bits outside it untouched
+    uint32_t version = 0x20000004, rolled = 0;
+    while (job_version_roll(version, 0x00012008))
+    {
+        if ((version & ~0x00012008u) != 0x20000004)
+            errors++;
+        rolled++;
+    }
+    if (rolled != 7 || version != 0x20000004)
+        errors++;
+    if (errors)
+        printf("FAIL nerd_sha256_bake_midstate / job_version_roll\n");
+    return errors;
+}
+
+static void print_hex(const char* label, const uint8_t* data, size_t len)
+{
+    printf("%s", label);
+    for (size_t i = 0; i < len; ++i)
+        printf("%02x", data[i]);
+    printf("\n");
+}
+
+//The reference itself: the host mbedtls stand-in against the FIPS 180-4 example digests, so a
+//mistake it shares with the kernels cannot pass the cross checks
+static int reference_selftest()
+{
+    static const struct { const char* message; uint32_t repeat; const char* sha256; } s_vectors[] = {
+        { "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 10000,
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    };
+    int errors = 0;
+    for (size_t i = 0; i < sizeof(s_vectors)/sizeof(s_vectors[0]); ++i)
+    {
+        uint8_t expected[32], hash[32];
+        host_from_hex(s_vectors[i].sha256, expected, sizeof(expected));
+        size_t length = strlen(s_vectors[i].message);
+        mbedtls_sha256_context ctx;
+        mbedtls_sha256_init(&ctx);
+        mbedtls_sha256_starts_ret(&ctx, 0);
+        for (uint32_t r = 0; r < s_vectors[i].repeat; ++r)
+            mbedtls_sha256_update_ret(&ctx, (const unsigned char*)s_vectors[i].message, length);
+        mbedtls_sha256_finish_ret(&ctx, hash);
+        mbedtls_sha256_free(&ctx);
+        if (memcmp(hash, expected, 32) != 0)
+        {
+            printf("FAIL FIPS 180-4 vector %u: reference sha256 mismatch\n", (unsigned)i);
+            print_hex("  got      ", hash, 32);
+            print_hex("  expected ", expected, 32);
+            errors++;
+        }
+        if (s_vectors[i].repeat == 1)
+        {
+            mbedtls_sha256_ret((const unsigned char*)s_vectors[i].message, length, hash, 0);
+            if (memcmp(hash, expected, 32) != 0)
+            {
+                printf("FAIL FIPS 180-4 vector %u: reference one shot sha256 mismatch\n", (unsigned)i);
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+int host_sha_selftest(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    int errors = 0;
+    uint8_t sha_buffer[128];
+    uint8_t expected[32], ref[32], hash[32];
+    uint32_t midstate[8];
+    uint32_t bake[NERD_BAKE_WORDS];
+    nerdSHA256_context ctx;
+
+    errors += reference_selftest();
+
+    //Known answers: real block headers must match mbedtls and the published hash
+    for (size_t c = 0; c < g_host_corpus_size; ++c)
+    {
+        const host_header& h = g_host_corpus[c];
+        host_make_sha_buffer(h, sha_buffer);
+        host_from_hex(h.sha256d, expected, sizeof(expected));
+
+        reference_sha256d(sha_buffer, ref);
+        if (memcmp(ref, expected, 32) != 0)
+        {
+            printf("FAIL %s: mbedtls sha256d mismatch\n", h.name);
+            print_hex("  got      ", ref, 32);
+            print_hex("  expected ", expected, 32);
+            errors++;
+        }
+
+        nerd_mids(midstate, sha_buffer);
+        memcpy(ctx.digest, midstate, sizeof(midstate));
+        memset(hash, 0, sizeof(hash));
+        if (!nerd_sha256d(&ctx, sha_buffer + 64, hash) || memcmp(hash, expected, 32) != 0)
+        {
+            printf("FAIL %s: nerd_sha256d mismatch\n", h.name);
+            print_hex("  got      ", hash, 32);
+            errors++;
+        }
+
+        nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+        memset(hash, 0, sizeof(hash));
+        if (!nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash, nerd_zero_bits_mask(16)) || memcmp(hash, expected, 32) != 0)
+        {
+            printf("FAIL %s: nerd_sha256d_baked mismatch\n", h.name);
+            print_hex("  got      ", hash, 32);
+            errors++;
+        }
+    }
+
+    //Random headers: kernels must agree with mbedtls on every hash they accept
+    //and must never reject a hash that passes the 16 bit prefilter
+    uint32_t checked = 0, accepted = 0;
+    for (int r = 0; r < SELFTEST_HEADERS; ++r)
+    {
+        for (int i = 0; i < 80; ++i)
+            sha_buffer[i] = (uint8_t)rng_next();
+        memset(sha_buffer + 80, 0, 48);
+        sha_buffer[80] = 0x80;
+        sha_buffer[126] = 0x02;
+        sha_buffer[127] = 0x80;
+
+        nerd_mids(midstate, sha_buffer);
+        memcpy(ctx.digest, midstate, sizeof(midstate));
+        nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+
+        uint32_t nonce_start = rng_next();
+        for (uint32_t n = 0; n < SELFTEST_NONCES; n += 4)
+        {
+            uint8_t refs[4][32];
+            uint32_t want_mask = 0;
+            for (int l = 0; l < 4; ++l)
+            {
+                set_nonce(sha_buffer, nonce_start + n + l);
+                reference_sha256d(sha_buffer, refs[l]);
+                bool want = passes_prefilter(refs[l]);
+                if (want)
+                    want_mask |= 1u << l;
+
+                uint8_t hash_full[32], hash_baked[32];
+                bool got_full = nerd_sha256d(&ctx, sha_buffer + 64, hash_full);
+                bool got_baked = nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash_baked, nerd_zero_bits_mask(16));
+                checked++;
+
+                //Resumable kernel, every hash finished, in steps of 8 to 128 rounds
+                nerd_sha256d_slice slice;
+                uint8_t hash_slice[32];
+                uint32_t rounds = 8 * (1 + (n + l) % 16);
+                nerd_sha256d_slice_start(&slice, midstate, sha_buffer + 64, nonce_start + n + l);
+                while (!nerd_sha256d_slice_step(&slice, rounds, hash_slice))
+                {}
+                if (memcmp(hash_slice, refs[l], 32) != 0)
+                {
+                    printf("FAIL random header %d nonce 0x%08X: slice hash mismatch, %u rounds a step\n", r, nonce_start + n + l, rounds);
+                    errors++;
+                }
+
+                if (got_full != want || got_baked != want)
+                {
+                    printf("FAIL random header %d nonce 0x%08X: prefilter full=%d baked=%d expected=%d\n",
+                           r, nonce_start + n + l, got_full, got_baked, want);
+                    errors++;
+                    continue;
+                }
+                if (!want)
+                    continue;
+                accepted++;
+                if (memcmp(hash_full, refs[l], 32) != 0 || memcmp(hash_baked, refs[l], 32) != 0)
+                {
+                    printf("FAIL random header %d nonce 0x%08X: hash mismatch\n", r, nonce_start + n + l);
+                    errors++;
+                }
+                for (uint32_t bits = 17; bits <= 32; ++bits)
+                {
+                    bool want_bits = leading_zero_bits(refs[l]) >= bits;
+                    if (nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash_baked, nerd_zero_bits_mask(bits)) != want_bits)
+                    {
+                        printf("FAIL random header %d nonce 0x%08X: %u bits filter expected %d\n", r, nonce_start + n + l, bits, want_bits);
+                        errors++;
+                    }
+                }
+            }
+
+            uint8_t lanes[4][32];
+            uint32_t got_x4 = nerd_sha256d_baked_x4(midstate, bake, nonce_start + n, lanes[0], nerd_zero_bits_mask(16));
+            uint32_t got_x2 = nerd_sha256d_baked_x2(midstate, bake, nonce_start + n, lanes[0], nerd_zero_bits_mask(16));
+            got_x2 |= nerd_sha256d_baked_x2(midstate, bake, nonce_start + n + 2, lanes[2], nerd_zero_bits_mask(16)) << 2;
+            if (got_x4 != want_mask || got_x2 != want_mask)
+            {
+                printf("FAIL random header %d nonce 0x%08X: lane masks x2=%X x4=%X expected=%X\n",
+                       r, nonce_start + n, got_x2, got_x4, want_mask);
+                errors++;
+                continue;
+            }
+            for (int l = 0; l < 4; ++l)
+            {
+                if ((want_mask & (1u << l)) && memcmp(lanes[l], refs[l], 32) != 0)
+                {
+                    printf("FAIL random header %d nonce 0x%08X: lane hash mismatch\n", r, nonce_start + n + l);
+                    errors++;
+                }
+            }
+        }
+    }
+
+    errors += zero_bits_selftest();
+    errors += merkle_selftest();
+    errors += version_roll_selftest();
+
+    printf("selftest: %u corpus headers, %u random nonces (%u accepted), %d errors\n",
+           (unsigned)g_host_corpus_size, checked, accepted, errors);
+    return errors ? 1 : 0;
+}
+
+static void report(const char* corpus, const char* kernel, uint32_t count, uint64_t us, uint64_t cycles, uint32_t rejected)
+{
+    double rate = us ? (double)count * 1000000.0 / (double)us : 0.0;
+    printf("%-12s %-22s %10.2f KH/s %9.1f cycles/nonce", corpus, kernel, rate / 1000.0, (double)cycles / count);
+    if (rejected != 0xFFFFFFFF)
+        printf("   early-reject %8.4f%%", 100.0 * rejected / count);
+    printf("\n");
+}
+
+static uint64_t thread_cpu_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+//bench --json: the firmware's benchmark mode (sha_bench.h) for the software kernels, same lines.
+//One core, its load is the thread's CPU time over the run
+static int bench_json(uint32_t duration_ms)
+{
+    uint8_t sha_buffer[128];
+    memset(sha_buffer, 0, sizeof(sha_buffer));
+    memcpy(sha_buffer, sha_bench_header, sizeof(sha_bench_header));
+    sha_buffer[80] = 0x80;
+    sha_buffer[126] = 0x02;
+    sha_buffer[127] = 0x80;
+    nerdSHA256_context ctx;
+    uint32_t bake[NERD_BAKE_WORDS];
+    nerd_mids(ctx.digest, sha_buffer);
+    nerd_sha256_bake(ctx.digest, sha_buffer + 64, bake);
+    uint32_t zero_mask = nerd_zero_bits_mask(NERD_ZERO_BITS_MIN);
+
+    for (int k = SHA_BENCH_SW_SHA256D; k <= SHA_BENCH_SW_BAKED_X4; ++k)
+    {
+        uint8_t hash[4][32];
+        uint32_t nonce = 0;
+        uint64_t t0 = host_micros(), cpu0 = thread_cpu_micros();
+        do
+        {
+            for (uint32_t n = nonce; n < nonce + 1024; n += 4)
+            {
+                if (k == SHA_BENCH_SW_BAKED_X4)
+                {
+                    nerd_sha256d_baked_x4(ctx.digest, bake, n, hash[0], zero_mask);
+                    continue;
+                }
+                if (k == SHA_BENCH_SW_BAKED_X2)
+                {
+                    nerd_sha256d_baked_x2(ctx.digest, bake, n, hash[0], zero_mask);
+                    nerd_sha256d_baked_x2(ctx.digest, bake, n + 2, hash[2], zero_mask);
+                    continue;
+                }
+                for (uint32_t l = 0; l < 4; ++l)
+                {
+                    set_nonce(sha_buffer, n + l);
+                    if (k == SHA_BENCH_SW_SHA256D)
+                        nerd_sha256d(&ctx, sha_buffer + 64, hash[l]);
+                    else
+                        nerd_sha256d_baked(ctx.digest, sha_buffer + 64, bake, hash[l], zero_mask);
+                }
+            }
+            nonce += 1024;
+        } while (host_micros() - t0 < duration_ms * 1000ull);
+
+        ShaBenchResult r = {};
+        r.elapsed_us = (uint32_t)(host_micros() - t0);
+        r.kernel = (ShaBenchKernel)k;
+        r.target = "host";
+        r.version = CURRENT_VERSION;
+        r.hashes = nonce;
+        r.core = 0;
+        r.cores = 1;
+        r.core_load[0] = r.elapsed_us ? (float)(thread_cpu_micros() - cpu0) / r.elapsed_us : 0;
+        if (r.core_load[0] > 1)
+            r.core_load[0] = 1;
+        r.free_heap = 0;
+        char line[320];
+        sha_bench_json(line, sizeof(line), r);
+        fputs(line, stdout);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int host_sha_bench(int argc, char** argv)
+{
+    if (argc > 0 && strcmp(argv[0], "--json") == 0)
+        return bench_json(argc > 1 && strtoul(argv[1], NULL, 0) ? strtoul(argv[1], NULL, 0) : SHA_BENCH_MS);
+
+    uint32_t nonces = BENCH_NONCES_DEFAULT;
+    if (argc > 0)
+        nonces = strtoul(argv[0], NULL, 0);
+    if (nonces == 0)
+        nonces = BENCH_NONCES_DEFAULT;
+
+    uint8_t sha_buffer[128];
+    uint8_t hash[32];
+    uint32_t midstate[8];
+    uint32_t bake[NERD_BAKE_WORDS];
+    nerdSHA256_context ctx;
+
+    printf("bench: %u nonces per kernel, cycles are %s\n", nonces,
+#if defined(__x86_64__) || defined(__i386__)
+           "TSC ticks"
+#else
+           "nanoseconds"
+#endif
+           );
+
+    for (size_t c = 0; c < g_host_corpus_size; ++c)
+    {
+        const host_header& h = g_host_corpus[c];
+        host_make_sha_buffer(h, sha_buffer);
+        nerd_mids(midstate, sha_buffer);
+        memcpy(ctx.digest, midstate, sizeof(midstate));
+        nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+
+        uint32_t rejected = 0;
+        uint64_t t0 = host_micros(), c0 = host_cycles();
+        for (uint32_t n = 0; n < nonces; ++n)
+        {
+            set_nonce(sha_buffer, NONCE_START + n);
+            if (!nerd_sha256d(&ctx, sha_buffer + 64, hash))
+                rejected++;
+        }
+        report(h.name, "nerd_sha256d", nonces, host_micros() - t0, host_cycles() - c0, rejected);
+
+        rejected = 0;
+        t0 = host_micros(); c0 = host_cycles();
+        for (uint32_t n = 0; n < nonces; ++n)
+        {
+            set_nonce(sha_buffer, NONCE_START + n);
+            if (!nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash, nerd_zero_bits_mask(16)))
+                rejected++;
+        }
+        report(h.name, "nerd_sha256d_baked", nonces, host_micros() - t0, host_cycles() - c0, rejected);
+
+        //What minerWorkerHw -D HW_SHA_OVERLAP fits in the SHA peripheral's waits, 8 rounds a step
+        rejected = 0;
+        t0 = host_micros(); c0 = host_cycles();
+        for (uint32_t n = 0; n < nonces; ++n)
+        {
+            nerd_sha256d_slice slice;
+            nerd_sha256d_slice_start(&slice, midstate, sha_buffer + 64, NONCE_START + n);
+            while (!nerd_sha256d_slice_step(&slice, 8, hash))
+            {}
+            if (!passes_prefilter(hash))
+                rejected++;
+        }
+        report(h.name, "nerd_sha256d_slice", nonces, host_micros() - t0, host_cycles() - c0, rejected);
+
+        uint8_t lanes[4][32];
+        rejected = 0;
+        t0 = host_micros(); c0 = host_cycles();
+        for (uint32_t n = 0; n < nonces; n += 2)
+            rejected += 2 - __builtin_popcount(nerd_sha256d_baked_x2(midstate, bake, NONCE_START + n, lanes[0], nerd_zero_bits_mask(16)));
+        report(h.name, "nerd_sha256d_baked_x2", nonces, host_micros() - t0, host_cycles() - c0, rejected);
+
+        rejected = 0;
+        t0 = host_micros(); c0 = host_cycles();
+        for (uint32_t n = 0; n < nonces; n += 4)
+            rejected += 4 - __builtin_popcount(nerd_sha256d_baked_x4(midstate, bake, NONCE_START + n, lanes[0], nerd_zero_bits_mask(16)));
+        report(h.name, "nerd_sha256d_baked_x4", nonces, host_micros() - t0, host_cycles() - c0, rejected);
+
+        t0 = host_micros(); c0 = host_cycles();
+        for (uint32_t n = 0; n < BENCH_MIDS_CALLS; ++n)
+        {
+            sha_buffer[0] = (uint8_t)n;
+            nerd_mids(midstate, sha_buffer);
+        }
+        report(h.name, "nerd_mids", BENCH_MIDS_CALLS, host_micros() - t0, host_cycles() - c0, 0xFFFFFFFF);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "host.h"
+#include "stratum_parse.h"
+
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define BENCH_ARDUINOJSON
+#endif
+
+//mining.notify parse cost: the single pass parser against the ArduinoJson path stratum.cpp used
+//before it (String copy of the line, deserializeJson for the method, again for the params, field
+//Strings, hex decoding later in calculateMiningData)
+#define PARSE_ITERATIONS_DEFAULT  20000
+
+static uint64_t s_parse_rng = 0x504152534521ull;
+static uint32_t parse_rng()
+{
+    s_parse_rng ^= s_parse_rng << 13;
+    s_parse_rng ^= s_parse_rng >> 7;
+    s_parse_rng ^= s_parse_rng << 17;
+    return (uint32_t)(s_parse_rng >> 16);
+}
+
+static size_t put_hash(char* out, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i += 4)
+        sprintf(out + 2 * i, "%08x", parse_rng());
+    out[2 * bytes] = 0;
+    return 2 * bytes;
+}
+
+//Shape of a public-pool.io notify: segwit coinbase split around the extranonces, full mempool branches
+size_t host_make_notify(char* out, int branches)
+{
+    char hash[65];
+    size_t size = sprintf(out, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"%08x%08x\",\"", parse_rng(), parse_rng());
+    size += put_hash(out + size, 28);
+    size += sprintf(out + size, "00000000\",\"02000000010000000000000000000000000000000000000000000000000000000000000000"
+                                "ffffffff35035d0d0d0004%08x%08x0c\",\"0a7075626c69632d706f6f6cffffffff02", parse_rng(), parse_rng());
+    for (int i = 0; i < 2; ++i)
+    {
+        put_hash(hash, 16);
+        size += sprintf(out + size, "%s", hash);
+    }
+    size += sprintf(out + size, "0000000000266a24aa21a9ed");
+    size += put_hash(out + size, 32);
+    size += sprintf(out + size, "00000000\",[");
+    for (int i = 0; i < branches; ++i)
+    {
+        put_hash(hash, 32);
+        size += sprintf(out + size, "%s\"%s\"", i ? "," : "", hash);
+    }
+    size += sprintf(out + size, "],\"20000000\",\"17034219\",\"%08x\",true]}", parse_rng());
+    return size;
+}
+
+#ifdef BENCH_ARDUINOJSON
+static StaticJsonDocument<4096> s_doc;
+
+struct LegacyJob
+{
+    std::string job_id, prev_block_hash, coinb1, coinb2, version, nbits, ntime;
+    JsonArray merkle_branch;
+    bool clean_jobs;
+    uint8_t header[80];
+    uint8_t branches[MAX_MERKLE_BRANCHES][32];
+};
+
+static bool legacy_notify(const char* text, LegacyJob& job)
+{
+    std::string line(text);     //readStringUntil
+
+    //parse_mining_method
+    if (deserializeJson(s_doc, line) || s_doc["error"].size() != 0)
+        return false;
+    if (!s_doc.containsKey("method") || strcmp("mining.notify", (const char*)s_doc["method"]) != 0)
+        return false;
+
+    //parse_mining_notify
+    if (deserializeJson(s_doc, line) || !s_doc.containsKey("params"))
+        return false;
+    job.job_id = (const char*)s_doc["params"][0];
+    job.prev_block_hash = (const char*)s_doc["params"][1];
+    job.coinb1 = (const char*)s_doc["params"][2];
+    job.coinb2 = (const char*)s_doc["params"][3];
+    job.merkle_branch = s_doc["params"][4];
+    job.version = (const char*)s_doc["params"][5];
+    job.nbits = (const char*)s_doc["params"][6];
+    job.ntime = (const char*)s_doc["params"][7];
+    job.clean_jobs = s_doc["params"][8];
+
+    //calculateMiningData: branches and header fields from hex
+    for (size_t k = 0; k < job.merkle_branch.size() && k < MAX_MERKLE_BRANCHES; k++)
+        host_from_hex((const char*)job.merkle_branch[k], job.branches[k], 32);
+    std::string header = job.version + job.prev_block_hash + job.ntime + job.nbits;
+    host_from_hex(header.c_str(), job.header, sizeof(job.header));
+    return true;
+}
+#endif
+
+static void report(const char* payload, const char* parser, uint64_t elapsed_us, uint64_t cycles, uint32_t allocations, uint32_t count)
+{
+    printf("%-12s %-12s %8.2f us/notify %10.0f cycles/notify %6.1f allocations/notify\n", payload, parser,
+           (double)elapsed_us / count, (double)cycles / count, (double)allocations / count);
+}
+
+int host_parse_bench(int argc, char** argv)
+{
+    uint32_t iterations = argc > 0 ? (uint32_t)atoi(argv[0]) : PARSE_ITERATIONS_DEFAULT;
+    static char s_payload[STRATUM_LINE_MAX];
+    static char s_line[STRATUM_LINE_MAX];
+    static stratum_message s_msg;
+    static const int s_branches[] = { 12, 16 };
+    uint32_t errors = 0;
+
+    printf("parse: %u iterations per payload, cycles are %s\n", iterations,
+#if defined(__x86_64__) || defined(__i386__)
+           "TSC ticks"
+#else
+           "nanoseconds"
+#endif
+           );
+    for (size_t b = 0; b < sizeof(s_branches) / sizeof(s_branches[0]); ++b)
+    {
+        char name[32];
+        size_t size = host_make_notify(s_payload, s_branches[b]);
+        snprintf(name, sizeof(name), "notify-%d", s_branches[b]);
+
+        //The parser works in place, every round gets a fresh copy like a new socket read
+        uint32_t allocations = host_allocations();
+        uint64_t time_start = host_micros();
+        uint64_t cycles_start = host_cycles();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            memcpy(s_line, s_payload, size + 1);
+            if (parse_stratum_line(s_line, size, s_msg) != MINING_NOTIFY || !s_msg.valid ||
+                s_msg.merkle_branch_count != s_branches[b])
+                errors++;
+        }
+        uint64_t cycles = host_cycles() - cycles_start;
+        report(name, "single-pass", host_micros() - time_start, cycles, host_allocations() - allocations, iterations);
+
+#ifdef BENCH_ARDUINOJSON
+        LegacyJob job;
+        allocations = host_allocations();
+        time_start = host_micros();
+        cycles_start = host_cycles();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            if (!legacy_notify(s_payload, job) || (int)job.merkle_branch.size() != s_branches[b])
+                errors++;
+        }
+        cycles = host_cycles() - cycles_start;
+        report(name, "arduinojson", host_micros() - time_start, cycles, host_allocations() - allocations, iterations);
+        if (memcmp(job.branches, s_msg.merkle_branch, s_branches[b] * 32) != 0)
+            errors++;
+#endif
+    }
+#ifndef BENCH_ARDUINOJSON
+    printf("parse: ArduinoJson not found, baseline skipped (pio run -e native fetches it)\n");
+#endif
+    if (errors)
+        printf("FAIL parse: %u bad results\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+/************************************************************************************
+*   Host stand-in for ESP-IDF esp_attr.h
+
+*   Description:
+
+*   Placement attributes only matter on the ESP32 memory map. The native build
+    defines them away so the hashing kernels compile unchanged on Linux/macOS.
+
+*************************************************************************************/
+#ifndef HOST_ESP_ATTR_H_
+#define HOST_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define IRAM_DATA_ATTR
+#define RTC_DATA_ATTR
+
+#endif /* HOST_ESP_ATTR_H_ */
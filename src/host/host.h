@@ -0,0 +1,89 @@
+/************************************************************************************
+*   Native (Linux/macOS) harness for the NerdMiner kernels
+
+*   Description:
+
+*   Built by the [env:native] PlatformIO environment. Only the portable parts
+    of the firmware are compiled in, the ESP-IDF/Arduino pieces they need are
+    replaced by the stand-ins next to this file.
+
+*************************************************************************************/
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static inline uint64_t host_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+//TSC ticks on x86, nanoseconds elsewhere
+static inline uint64_t host_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline uint8_t host_hex_nibble(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return 0;
+}
+
+static inline size_t host_from_hex(const char* hex, uint8_t* out, size_t out_size)
+{
+    size_t n = 0;
+    while (hex[0] && hex[1] && n < out_size)
+    {
+        out[n++] = (host_hex_nibble(hex[0]) << 4) | host_hex_nibble(hex[1]);
+        hex += 2;
+    }
+    return n;
+}
+
+//Block header corpus shared by the benchmarks and self tests
+typedef struct {
+    const char* name;
+    const char* header;   //80 bytes, hex, as serialized on the wire
+    const char* sha256d;  //expected double sha256, hex, digest byte order
+} host_header;
+
+extern const host_header g_host_corpus[];
+extern const size_t g_host_corpus_size;
+
+//Prepare the 128 byte, two block sha buffer exactly like runStratumWorker does
+void host_make_sha_buffer(const host_header& h, uint8_t* sha_buffer);
+
+//Random mining.notify line shaped like a public-pool.io one, no newline. Returns its length
+size_t host_make_notify(char* out, int branches);
+
+//Heap allocations made by the process so far (operator new, and malloc on glibc)
+uint32_t host_allocations();
+
+int host_sha_selftest(int argc, char** argv);
+int host_sha_bench(int argc, char** argv);
+int host_spsc_stress(int argc, char** argv);
+int host_sched_sim(int argc, char** argv);
+int host_stratum_test(int argc, char** argv);
+int host_parse_bench(int argc, char** argv);
+int host_notify_replay(int argc, char** argv);
+int host_roll_test(int argc, char** argv);
+int host_submit_test(int argc, char** argv);
+int host_vardiff_sim(int argc, char** argv);
+
+#endif /* HOST_H_ */
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include "host.h"
+
+const host_header g_host_corpus[] = {
+    { "genesis",
+      "01000000"
+      "0000000000000000000000000000000000000000000000000000000000000000"
+      "3ba3edfd7a7b12b27ac72c3e67768f617fc81bc3888a51323a9fb8aa4b1e5e4a"
+      "29ab5f49" "ffff001d" "1dac2b7c",
+      "6fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d6190000000000" },
+    { "block125552",
+      "01000000"
+      "81cd02ab7e569e8bcd9317e2fe99f2de44d49ab2b8851ba4a308000000000000"
+      "e320b6c2fffc8d750423db8b1eb942ae710e951ed797f7affc8892b0f1fc122b"
+      "c7f5d74d" "f2b9441a" "42a14695",
+      "1dbd981fe6985776b644b173a4d0385ddc1aa2a829688d1e0000000000000000" },
+    //sha_bench_header from sha_bench.h
+    { "hwtest",
+      "0000002299" "44bbffbb000077" "44cc1177" "8855bb44" "55007788" "99110000" "00000000"
+      "00000000" "bbbb6611" "88334499" "cc33ff22" "11aa77ee" "bb66eecc" "ee66eedd"
+      "77552222" "cccc66ee" "22dd9966" "66880011" "2e334119",
+      "6fa464b007f2d577edfa5dfe9dfc3f9209f36d1a6711d314ea68ccdd03000000" },
+};
+const size_t g_host_corpus_size = sizeof(g_host_corpus) / sizeof(g_host_corpus[0]);
+
+void host_make_sha_buffer(const host_header& h, uint8_t* sha_buffer)
+{
+    memset(sha_buffer, 0, 128);
+    host_from_hex(h.header, sha_buffer, 80);
+    sha_buffer[80] = 0x80;
+    sha_buffer[126] = 0x02;
+    sha_buffer[127] = 0x80;
+}
+
+typedef int (*host_command)(int argc, char** argv);
+
+static const struct {
+    const char* name;
+    host_command run;
+    const char* help;
+} s_commands[] = {
+    { "selftest", host_sha_selftest, "known-answer and cross checks of the sha256d kernels" },
+    { "bench",    host_sha_bench,    "[nonces] | --json [ms]  kernel throughput over the header corpus, or the firmware's benchmark lines" },
+    { "spsc",     host_spsc_stress,  "[jobs]  job/result ring stress, producer and miner threads" },
+    { "sched",    host_sched_sim,    "[seconds] [kH/s ...]  nonce scheduler model, idle time per miner" },
+    { "stratum",  host_stratum_test, "[rounds]  pool transcript through the line framer and parser, heap allocation count" },
+    { "parse",    host_parse_bench,  "[iterations]  mining.notify parse time, single pass parser vs ArduinoJson" },
+    { "replay",   host_notify_replay, "[file] [iterations]  notify to first hash latency per stage, from a pool capture or generated notifies" },
+    { "roll",     host_roll_test,    "[jobs]  version and extranonce2 rolling, shares mined on rolled headers checked the way the pool rebuilds them" },
+    { "submit",   host_submit_test,  "[shares]  submit pipeline against a stalling socket and a slow pool, accept rate and round trip" },
+    { "vardiff",  host_vardiff_sim,  "[phase seconds]  share vardiff against hashrate steps, a pool that takes the suggestions and one that ignores them" },
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        //Default run: gate on correctness first, then measure
+        if (host_sha_selftest(0, NULL) != 0)
+            return 1;
+        return host_sha_bench(0, NULL);
+    }
+
+    for (size_t i = 0; i < sizeof(s_commands) / sizeof(s_commands[0]); ++i)
+    {
+        if (strcmp(argv[1], s_commands[i].name) == 0)
+            return s_commands[i].run(argc - 2, argv + 2);
+    }
+
+    printf("usage: %s <command> [args]\n", argv[0]);
+    for (size_t i = 0; i < sizeof(s_commands) / sizeof(s_commands[0]); ++i)
+        printf("  %-10s %s\n", s_commands[i].name, s_commands[i].help);
+    return 2;
+}
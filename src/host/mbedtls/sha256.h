@@ -0,0 +1,32 @@
+/************************************************************************************
+*   Host stand-in for mbedtls/sha256.h
+
+*   Description:
+
+*   Plain FIPS 180-4 SHA-256 exposing the subset of the mbedtls 2.x API used by
+    the firmware (the ESP32 Arduino core ships mbedtls 2.x). It is only built
+    for the native environment and is the reference the nerd kernels are
+    checked against off-device.
+
+*************************************************************************************/
+#ifndef HOST_MBEDTLS_SHA256_H_
+#define HOST_MBEDTLS_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t total[2];
+    uint32_t state[8];
+    unsigned char buffer[64];
+    int is224;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen);
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char output[32]);
+int mbedtls_sha256_ret(const unsigned char* input, size_t ilen, unsigned char output[32], int is224);
+
+#endif /* HOST_MBEDTLS_SHA256_H_ */
@@ -0,0 +1,149 @@
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static void sha256_process(mbedtls_sha256_context* ctx, const unsigned char data[64])
+{
+    uint32_t W[64], A[8];
+
+    for (int i = 0; i < 16; ++i)
+        W[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+               ((uint32_t)data[i * 4 + 2] << 8) | ((uint32_t)data[i * 4 + 3]);
+    for (int i = 16; i < 64; ++i)
+    {
+        uint32_t s0 = ROTR(W[i - 15], 7) ^ ROTR(W[i - 15], 18) ^ (W[i - 15] >> 3);
+        uint32_t s1 = ROTR(W[i - 2], 17) ^ ROTR(W[i - 2], 19) ^ (W[i - 2] >> 10);
+        W[i] = s1 + W[i - 7] + s0 + W[i - 16];
+    }
+
+    memcpy(A, ctx->state, sizeof(A));
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32_t t1 = A[7] + (ROTR(A[4], 6) ^ ROTR(A[4], 11) ^ ROTR(A[4], 25)) +
+                      ((A[4] & A[5]) ^ (~A[4] & A[6])) + K[i] + W[i];
+        uint32_t t2 = (ROTR(A[0], 2) ^ ROTR(A[0], 13) ^ ROTR(A[0], 22)) +
+                      ((A[0] & A[1]) ^ (A[0] & A[2]) ^ (A[1] & A[2]));
+        A[7] = A[6]; A[6] = A[5]; A[5] = A[4]; A[4] = A[3] + t1;
+        A[3] = A[2]; A[2] = A[1]; A[1] = A[0]; A[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; ++i)
+        ctx->state[i] += A[i];
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx)
+{
+    if (ctx)
+        memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224)
+{
+    static const uint32_t iv256[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                                       0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+    static const uint32_t iv224[8] = { 0xC1059ED8, 0x367CD507, 0x3070DD17, 0xF70E5939,
+                                       0xFFC00B31, 0x68581511, 0x64F98FA7, 0xBEFA4FA4 };
+    ctx->total[0] = 0;
+    ctx->total[1] = 0;
+    ctx->is224 = is224;
+    memcpy(ctx->state, is224 ? iv224 : iv256, sizeof(ctx->state));
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen)
+{
+    size_t fill;
+    uint32_t left;
+
+    if (ilen == 0)
+        return 0;
+
+    left = ctx->total[0] & 0x3F;
+    fill = 64 - left;
+
+    ctx->total[0] += (uint32_t)ilen;
+    if (ctx->total[0] < (uint32_t)ilen)
+        ctx->total[1]++;
+
+    if (left && ilen >= fill)
+    {
+        memcpy(ctx->buffer + left, input, fill);
+        sha256_process(ctx, ctx->buffer);
+        input += fill;
+        ilen -= fill;
+        left = 0;
+    }
+
+    while (ilen >= 64)
+    {
+        sha256_process(ctx, input);
+        input += 64;
+        ilen -= 64;
+    }
+
+    if (ilen > 0)
+        memcpy(ctx->buffer + left, input, ilen);
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char output[32])
+{
+    uint32_t used = ctx->total[0] & 0x3F;
+    uint32_t high = (ctx->total[0] >> 29) | (ctx->total[1] << 3);
+    uint32_t low = ctx->total[0] << 3;
+
+    ctx->buffer[used++] = 0x80;
+    if (used <= 56)
+    {
+        memset(ctx->buffer + used, 0, 56 - used);
+    } else
+    {
+        memset(ctx->buffer + used, 0, 64 - used);
+        sha256_process(ctx, ctx->buffer);
+        memset(ctx->buffer, 0, 56);
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ctx->buffer[56 + i] = (unsigned char)(high >> (24 - i * 8));
+        ctx->buffer[60 + i] = (unsigned char)(low >> (24 - i * 8));
+    }
+    sha256_process(ctx, ctx->buffer);
+
+    int words = ctx->is224 ? 7 : 8;
+    for (int i = 0; i < words; ++i)
+    {
+        output[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+        output[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        output[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        output[i * 4 + 3] = (unsigned char)(ctx->state[i]);
+    }
+    return 0;
+}
+
+int mbedtls_sha256_ret(const unsigned char* input, size_t ilen, unsigned char output[32], int is224)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, is224);
+    mbedtls_sha256_update_ret(&ctx, input, ilen);
+    mbedtls_sha256_finish_ret(&ctx, output);
+    mbedtls_sha256_free(&ctx);
+    return 0;
+}
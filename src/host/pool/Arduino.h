@@ -0,0 +1,149 @@
+/************************************************************************************
+*   Host stand-in for the Arduino core, pool harness only
+
+*   Description:
+
+*   Just enough of Arduino.h for mining.cpp, stratum.cpp and utils.cpp to run
+    unchanged on Linux/macOS against the stand-in pool: String over std::string,
+    Print/Stream, a Serial that writes to a log file (or nowhere) and the
+    millis()/micros()/delay() clock. See pool_main.cpp.
+
+*************************************************************************************/
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+#define DEC 10
+#define HEX 16
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+class String
+{
+public:
+    String() {}
+    String(const char* text) : s_(text ? text : "") {}
+    String(char ch) : s_(1, ch) {}
+    String(int value, unsigned char base = DEC) : s_(format(base == HEX ? "%x" : "%d", value)) {}
+    String(unsigned int value, unsigned char base = DEC) : s_(format(base == HEX ? "%x" : "%u", value)) {}
+    String(long value, unsigned char base = DEC) : s_(format(base == HEX ? "%lx" : "%ld", value)) {}
+    String(unsigned long value, unsigned char base = DEC) : s_(format(base == HEX ? "%lx" : "%lu", value)) {}
+    String(double value, unsigned int decimals = 2) : s_(format("%.*f", decimals, value)) {}
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.size(); }
+    bool isEmpty() const { return s_.empty(); }
+    char operator[](unsigned int index) const { return index < s_.size() ? s_[index] : 0; }
+    bool operator==(const String& other) const { return s_ == other.s_; }
+    bool operator!=(const String& other) const { return s_ != other.s_; }
+    String& operator+=(const String& other) { s_ += other.s_; return *this; }
+    String operator+(const String& other) const { String sum(*this); sum += other; return sum; }
+    bool concat(const String& other) { s_ += other.s_; return true; }
+    int indexOf(char ch, unsigned int from = 0) const { return found(s_.find(ch, from)); }
+    int indexOf(const String& text, unsigned int from = 0) const { return found(s_.find(text.s_, from)); }
+    String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from).c_str()) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < to && from < s_.size() ? String(s_.substr(from, to - from).c_str()) : String(); }
+    long toInt() const { return atol(s_.c_str()); }
+    double toDouble() const { return atof(s_.c_str()); }
+    void trim()
+    {
+        size_t first = s_.find_first_not_of(" \t\r\n");
+        s_ = first == std::string::npos ? std::string() : s_.substr(first, s_.find_last_not_of(" \t\r\n") - first + 1);
+    }
+
+private:
+    template <typename T>
+    static std::string format(const char* fmt, T value) { char text[32]; snprintf(text, sizeof(text), fmt, value); return text; }
+    static std::string format(const char* fmt, unsigned int decimals, double value) { char text[64]; snprintf(text, sizeof(text), fmt, decimals, value); return text; }
+    static int found(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+    std::string s_;
+};
+
+inline String operator+(const char* text, const String& other) { return String(text) + other; }
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+
+    size_t write(uint8_t ch) { return write(&ch, 1); }
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t print(const String& text) { return print(text.c_str()); }
+    size_t print(char ch) { return write((uint8_t)ch); }
+    size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+    size_t print(double value, int decimals = 2) { return print(String(value, (unsigned int)decimals)); }
+    template <typename T>
+    size_t println(T value) { size_t size = print(value); return size + print("\r\n"); }
+    template <typename T>
+    size_t println(T value, int format) { size_t size = print(value, format); return size + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+
+    void setTimeout(unsigned long timeout_ms) { timeout_ms_ = timeout_ms; }
+    //Waits up to the timeout for every character, like the core does
+    String readStringUntil(char terminator);
+
+protected:
+    unsigned long timeout_ms_ = 1000;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void flush() { if (out_) fflush(out_); }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    size_t write(const uint8_t* data, size_t size) override { return out_ ? fwrite(data, 1, size, out_) : size; }
+    using Print::write;
+
+    //Host only: where the firmware log goes, NULL drops it
+    void host_output(FILE* out) { out_ = out; }
+
+private:
+    FILE* out_ = NULL;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getHeapSize() { return 0; }
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getMinFreeHeap() { return 0; }
+    void restart() { exit(1); }
+};
+
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+#endif /* HOST_ARDUINO_H_ */
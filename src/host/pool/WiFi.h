@@ -0,0 +1,72 @@
+/************************************************************************************
+*   Host stand-in for the ESP32 WiFi library, pool harness only
+
+*   Description:
+
+*   The station is always connected, WiFiClient is a plain TCP socket with the
+    semantics the stratum code relies on: connected() stays true while data is
+    left to read, available()/read() never block, print() blocks until sent.
+
+*************************************************************************************/
+#ifndef HOST_WIFI_H_
+#define HOST_WIFI_H_
+
+#include <Arduino.h>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+class IPAddress
+{
+public:
+    IPAddress() : address_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address_((uint32_t)a << 24 | (uint32_t)b << 16 | (uint32_t)c << 8 | d) {}
+    bool operator==(const IPAddress& other) const { return address_ == other.address_; }
+    bool operator!=(const IPAddress& other) const { return address_ != other.address_; }
+    String toString() const;
+
+    uint32_t host_address() const { return address_; }  //Host order
+
+private:
+    uint32_t address_;
+};
+
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() : fd_(-1) {}
+    ~WiFiClient() { stop(); }
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    uint8_t connected();
+    void stop();
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size);
+    size_t write(const uint8_t* data, size_t size) override;
+    using Print::write;
+    int setNoDelay(bool nodelay);
+    int fd() const { return fd_; }
+
+private:
+    WiFiClient(const WiFiClient&);
+    int fd_;
+};
+
+class WiFiClass
+{
+public:
+    wl_status_t status() { return WL_CONNECTED; }
+    bool reconnect() { return true; }
+    int hostByName(const char* host, IPAddress& ip);
+};
+
+extern WiFiClass WiFi;
+
+#endif /* HOST_WIFI_H_ */
@@ -0,0 +1,264 @@
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <Arduino.h>
+#include <WiFi.h>
+
+//Arduino core, WiFi and FreeRTOS stand-ins the firmware sources run on in the pool harness
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+static uint64_t clock_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+//Counted from the first call like the core counts from boot, wraps the same way
+static const uint64_t s_boot_us = clock_us();
+
+unsigned long millis() { return (uint32_t)((clock_us() - s_boot_us) / 1000); }
+unsigned long micros() { return (uint32_t)(clock_us() - s_boot_us); }
+void delay(unsigned long ms) { usleep(ms * 1000); }
+
+size_t Print::printf(const char* fmt, ...)
+{
+    char text[512];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    if (len < 0)
+        return 0;
+    return write((const uint8_t*)text, (size_t)len < sizeof(text) ? len : sizeof(text) - 1);
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    std::string text;
+    unsigned long start = millis();
+    while (millis() - start < timeout_ms_)
+    {
+        int ch = available() > 0 ? read() : -1;
+        if (ch < 0)
+        {
+            usleep(1000);
+            continue;
+        }
+        if (ch == terminator)
+            break;
+        text += (char)ch;
+        start = millis();
+    }
+    return String(text.c_str());
+}
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", address_ >> 24, (address_ >> 16) & 0xFF, (address_ >> 8) & 0xFF, address_ & 0xFF);
+    return String(text);
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& ip)
+{
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0)
+        return 0;
+    uint32_t address = ntohl(((struct sockaddr_in*)result->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(result);
+    ip = IPAddress(address >> 24, address >> 16, address >> 8, address);
+    return 1;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(ip.host_address());
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0)
+        return 0;
+    //lwIP's default TCP_SND_BUF, so a slow pool backs up writes as soon as on the device
+    int sndbuf = 5744;
+    setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    if (::connect(fd_, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port)
+{
+    IPAddress ip;
+    return WiFi.hostByName(host, ip) && connect(ip, port);
+}
+
+//Like the ESP32 core: still connected while the peer's data is not read, closed once it is
+uint8_t WiFiClient::connected()
+{
+    if (fd_ < 0)
+        return 0;
+    char ch;
+    ssize_t peeked = recv(fd_, &ch, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (peeked > 0 || (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)))
+        return 1;
+    stop();
+    return 0;
+}
+
+void WiFiClient::stop()
+{
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+}
+
+int WiFiClient::available()
+{
+    int size = 0;
+    if (fd_ < 0 || ioctl(fd_, FIONREAD, &size) != 0)
+        return 0;
+    return size;
+}
+
+int WiFiClient::read()
+{
+    uint8_t ch;
+    return read(&ch, 1) == 1 ? ch : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size)
+{
+    if (fd_ < 0)
+        return -1;
+    ssize_t received = recv(fd_, buffer, size, MSG_DONTWAIT);
+    if (received < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    return received;
+}
+
+size_t WiFiClient::write(const uint8_t* data, size_t size)
+{
+    size_t sent = 0;
+    while (fd_ >= 0 && sent < size)
+    {
+        ssize_t n = send(fd_, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        sent += n;
+    }
+    return sent;
+}
+
+int WiFiClient::setNoDelay(bool nodelay)
+{
+    int value = nodelay;
+    return fd_ >= 0 && setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) == 0;
+}
+
+//One per task, the handle FreeRTOS hands out
+struct HostTask
+{
+    TaskFunction_t function;
+    void* param;
+    BaseType_t core;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t bits;
+    bool pending;
+};
+
+static thread_local HostTask* s_current_task = NULL;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char*, uint32_t, void* param,
+                                   UBaseType_t, TaskHandle_t* handle, BaseType_t core)
+{
+    HostTask* task = new HostTask();
+    task->function = function;
+    task->param = param;
+    task->core = core;
+    task->bits = 0;
+    task->pending = false;
+    if (handle)
+        *handle = task;
+    std::thread([task]() {
+        s_current_task = task;
+        task->function(task->param);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_size, param, priority, handle, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return s_current_task; }
+
+void vTaskDelay(TickType_t ticks) { usleep((useconds_t)ticks * 1000 * portTICK_PERIOD_MS); }
+
+TickType_t xTaskGetTickCount() { return millis() / portTICK_PERIOD_MS; }
+
+BaseType_t xPortGetCoreID() { return s_current_task && s_current_task->core != tskNO_AFFINITY ? s_current_task->core : 0; }
+
+BaseType_t xTaskNotify(TaskHandle_t handle, uint32_t value, eNotifyAction action)
+{
+    HostTask* task = (HostTask*)handle;
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        if (action == eSetBits)
+            task->bits |= value;
+        else if (action == eIncrement)
+            task->bits++;
+        else if (action == eSetValueWithOverwrite || (action == eSetValueWithoutOverwrite && !task->pending))
+            task->bits = value;
+        task->pending = true;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks)
+{
+    HostTask* task = s_current_task;
+    std::unique_lock<std::mutex> guard(task->lock);
+    if (!task->pending)
+        task->bits &= ~clear_on_entry;
+    if (ticks == portMAX_DELAY)
+        task->notified.wait(guard, [task]() { return task->pending; });
+    else
+        task->notified.wait_for(guard, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), [task]() { return task->pending; });
+    if (!task->pending)
+        return pdFALSE;
+    if (value)
+        *value = task->bits;
+    task->bits &= ~clear_on_exit;
+    task->pending = false;
+    return pdTRUE;
+}
@@ -0,0 +1,16 @@
+//Host stand-in for esp_heap_caps.h, pool harness only: every allocation is from the host heap
+#ifndef HOST_ESP_HEAP_CAPS_H_
+#define HOST_ESP_HEAP_CAPS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_DMA          (1 << 3)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+static inline void* heap_caps_calloc(size_t n, size_t size, uint32_t) { return calloc(n, size); }
+static inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif /* HOST_ESP_HEAP_CAPS_H_ */
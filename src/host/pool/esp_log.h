@@ -0,0 +1 @@
+//Host stand-in for esp_log.h, pool harness only: the firmware logs through Serial
@@ -0,0 +1,7 @@
+//Host stand-in for esp_private/gdma.h, pool harness only: the SHA accelerator model in host_sha.h
+#ifndef HOST_ESP_PRIVATE_GDMA_H_
+#define HOST_ESP_PRIVATE_GDMA_H_
+
+#include "host_sha.h"
+
+#endif /* HOST_ESP_PRIVATE_GDMA_H_ */
@@ -0,0 +1,13 @@
+/************************************************************************************
+*   Host stand-in for esp_task_wdt.h, pool harness only: no watchdog off-device
+*************************************************************************************/
+#ifndef HOST_ESP_TASK_WDT_H_
+#define HOST_ESP_TASK_WDT_H_
+
+#include "freertos/FreeRTOS.h"
+
+static inline int esp_task_wdt_init(uint32_t, bool) { return 0; }
+static inline int esp_task_wdt_add(TaskHandle_t) { return 0; }
+static inline int esp_task_wdt_reset() { return 0; }
+
+#endif /* HOST_ESP_TASK_WDT_H_ */
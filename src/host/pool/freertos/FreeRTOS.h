@@ -0,0 +1,50 @@
+/************************************************************************************
+*   Host stand-in for FreeRTOS, pool harness only
+
+*   Description:
+
+*   Tasks are threads, one tick is one millisecond, task notifications are a
+    bit field per task. Priorities and core affinity are ignored, the core id
+    passed at creation is what xPortGetCoreID() reports.
+
+*************************************************************************************/
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portTICK_PERIOD_MS  1
+#define portMAX_DELAY       0xFFFFFFFF
+#define pdMS_TO_TICKS(ms)   (ms)
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define pdFAIL              0
+#define tskNO_AFFINITY      0x7FFFFFFF
+
+typedef enum {
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+} eNotifyAction;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_size, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_size, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks);
+
+#endif /* HOST_FREERTOS_H_ */
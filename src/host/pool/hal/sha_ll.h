@@ -0,0 +1,7 @@
+//Host stand-in for hal/sha_ll.h, pool harness only: the SHA accelerator model in host_sha.h
+#ifndef HOST_HAL_SHA_LL_H_
+#define HOST_HAL_SHA_LL_H_
+
+#include "host_sha.h"
+
+#endif /* HOST_HAL_SHA_LL_H_ */
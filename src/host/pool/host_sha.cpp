@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include "host_sha.h"
+#include "ShaTests/nerdSHA256plus.h"
+#include "mbedtls/sha256.h"
+
+//SHA accelerator model, see host_sha.h
+
+volatile uint32_t host_sha_regs[HOST_SHA_REGS_SIZE / 4];
+uint32_t host_sha_busy_polls = 1;
+bool host_sha_keep_text = true;
+
+static const uint32_t s_sha256_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+#if defined(CONFIG_IDF_TARGET_ESP32)
+static host_sha_chip s_chip = HOST_SHA_ESP32;
+#else
+static host_sha_chip s_chip = HOST_SHA_S3;
+#endif
+static std::mutex s_engine;
+static uint32_t s_busy;                 //Busy register reads left
+static uint32_t s_state[8];             //ESP32: the engine's own state, not in a register
+
+struct host_gdma_channel
+{
+    bool sha;                           //Connected to the SHA peripheral
+    const lldesc_t* desc;               //Started on, until the SHA takes its blocks
+};
+static host_gdma_channel* s_sha_dma;    //The channel the SHA reads from
+static std::mutex s_gdma;               //Connections, made with or without the engine held
+
+static std::atomic<uint64_t> s_writes(0), s_reads(0), s_polls(0), s_blocks(0), s_dma_starts(0), s_errors(0);
+
+static inline uint32_t reg(uint32_t offset) { return host_sha_regs[offset / 4]; }
+static inline void reg_set(uint32_t offset, uint32_t value) { host_sha_regs[offset / 4] = value; }
+
+static void sha_error()
+{
+    s_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+//One compression of the 16 message words, from the IV or from state. dma: the S3 block from memory
+static void sha_block(bool first, const uint8_t* dma = NULL)
+{
+    uint8_t block[64];
+    if (s_chip == HOST_SHA_S3)
+    {
+        if (reg(HOST_SHA_S3_MODE) != 2) //SHA2_256
+            sha_error();
+        for (int i = 0; i < 16; ++i)
+        {
+            uint32_t word = reg(HOST_SHA_S3_TEXT + 4 * i);
+            memcpy(block + 4 * i, dma ? dma + 4 * i : (uint8_t*)&word, 4);
+        }
+        for (int i = 0; i < 8; ++i)
+            s_state[i] = first ? s_sha256_iv[i] : __builtin_bswap32(reg(HOST_SHA_S3_H + 4 * i));
+        nerd_sha256_block(s_state, block);
+        for (int i = 0; i < 8; ++i)
+            reg_set(HOST_SHA_S3_H + 4 * i, __builtin_bswap32(s_state[i]));
+    } else
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            uint32_t word = __builtin_bswap32(reg(HOST_SHA_ESP32_TEXT + 4 * i));
+            memcpy(block + 4 * i, &word, 4);
+        }
+        if (first)
+            memcpy(s_state, s_sha256_iv, sizeof(s_state));
+        nerd_sha256_block(s_state, block);
+    }
+    if (!host_sha_keep_text || dma)
+    {
+        uint32_t text = s_chip == HOST_SHA_S3 ? HOST_SHA_S3_TEXT : HOST_SHA_ESP32_TEXT;
+        for (int i = 0; i < 16; ++i)
+            reg_set(text + 4 * i, 0xA5A5A5A5 ^ (s_blocks.load(std::memory_order_relaxed) + i));
+    }
+    s_blocks.fetch_add(1, std::memory_order_relaxed);
+    s_busy = host_sha_busy_polls;
+}
+
+//DMA_START / DMA_CONTINUE: SHA_DMA_BLOCK_NUM blocks out of the started descriptor chain
+static void sha_dma(bool first)
+{
+    uint32_t blocks = reg(HOST_SHA_S3_DMA_BLOCKS);
+    if (!s_sha_dma || !s_sha_dma->desc || blocks == 0)
+    {
+        sha_error();
+        return;
+    }
+    const lldesc_t* desc = s_sha_dma->desc;
+    s_sha_dma->desc = NULL;
+    uint32_t offset = 0;
+    for (uint32_t b = 0; b < blocks; ++b)
+    {
+        uint8_t block[64];
+        for (uint32_t filled = 0; filled < 64; )
+        {
+            if (!desc || !desc->owner || !desc->buf)
+            {
+                sha_error();
+                return;
+            }
+            uint32_t take = desc->length - offset < 64 - filled ? desc->length - offset : 64 - filled;
+            memcpy(block + filled, (const uint8_t*)desc->buf + offset, take);
+            filled += take;
+            offset += take;
+            if (offset == desc->length)
+            {
+                desc = desc->qe.stqe_next;
+                offset = 0;
+            }
+        }
+        sha_block(first && b == 0, block);
+    }
+}
+
+static bool is_data(uint32_t offset)
+{
+    if (s_chip == HOST_SHA_S3)
+        return (offset >= HOST_SHA_S3_H && offset < HOST_SHA_S3_H + 32) || (offset >= HOST_SHA_S3_TEXT && offset < HOST_SHA_S3_TEXT + 64);
+    return offset < HOST_SHA_ESP32_TEXT + 128;
+}
+
+void host_sha_write(uintptr_t address, uint32_t value)
+{
+    uint32_t offset = address - (uintptr_t)host_sha_regs;
+    s_writes.fetch_add(1, std::memory_order_relaxed);
+    if (address < (uintptr_t)host_sha_regs || offset >= HOST_SHA_REGS_SIZE || (offset & 3))
+    {
+        sha_error();
+        return;
+    }
+    if (s_busy && (is_data(offset) || value))
+        sha_error();
+    if (s_chip == HOST_SHA_S3 && (offset == HOST_SHA_S3_START || offset == HOST_SHA_S3_CONTINUE))
+    {
+        if (value & 1)
+            sha_block(offset == HOST_SHA_S3_START);
+    } else if (s_chip == HOST_SHA_S3 && (offset == HOST_SHA_S3_DMA_START || offset == HOST_SHA_S3_DMA_CONTINUE))
+    {
+        if (value & 1)
+            sha_dma(offset == HOST_SHA_S3_DMA_START);
+    } else if (s_chip == HOST_SHA_ESP32 && (offset == HOST_SHA_ESP32_START || offset == HOST_SHA_ESP32_CONTINUE))
+    {
+        if (value & 1)
+            sha_block(offset == HOST_SHA_ESP32_START);
+    } else if (s_chip == HOST_SHA_ESP32 && offset == HOST_SHA_ESP32_LOAD)
+    {
+        if (value & 1)
+        {
+            for (int i = 0; i < 8; ++i)
+                reg_set(HOST_SHA_ESP32_TEXT + 4 * i, s_state[i]);
+            s_busy = host_sha_busy_polls;
+        }
+    } else
+        reg_set(offset, value);
+}
+
+uint32_t host_sha_read(uintptr_t address)
+{
+    uint32_t offset = address - (uintptr_t)host_sha_regs;
+    if (address < (uintptr_t)host_sha_regs || offset >= HOST_SHA_REGS_SIZE || (offset & 3))
+    {
+        sha_error();
+        return 0;
+    }
+    if (offset == (s_chip == HOST_SHA_S3 ? HOST_SHA_S3_BUSY : HOST_SHA_ESP32_BUSY))
+    {
+        s_polls.fetch_add(1, std::memory_order_relaxed);
+        if (!s_busy)
+            return 0;
+        s_busy--;
+        return 1;
+    }
+    s_reads.fetch_add(1, std::memory_order_relaxed);
+    if (s_busy)
+        sha_error();
+    return reg(offset);
+}
+
+void host_sha_get_counters(host_sha_counters& counters)
+{
+    counters.writes = s_writes.load(std::memory_order_relaxed);
+    counters.reads = s_reads.load(std::memory_order_relaxed);
+    counters.polls = s_polls.load(std::memory_order_relaxed);
+    counters.blocks = s_blocks.load(std::memory_order_relaxed);
+    counters.dma_starts = s_dma_starts.load(std::memory_order_relaxed);
+    counters.errors = s_errors.load(std::memory_order_relaxed);
+}
+
+void host_sha_set_chip(host_sha_chip chip)
+{
+    std::lock_guard<std::mutex> guard(s_engine);
+    s_chip = chip;
+    s_busy = 0;
+    memset((void*)host_sha_regs, 0, sizeof(host_sha_regs));
+}
+
+void esp_sha_acquire_hardware() { s_engine.lock(); }
+void esp_sha_release_hardware() { s_engine.unlock(); }
+void esp_sha_lock_engine(esp_sha_type) { s_engine.lock(); }
+void esp_sha_unlock_engine(esp_sha_type) { s_engine.unlock(); }
+
+#if !defined(CONFIG_IDF_TARGET_ESP32)
+void sha_hal_wait_idle()
+{
+    while (REG_READ(SHA_BUSY_REG))
+    {}
+}
+
+void sha_hal_hash_block(esp_sha_type sha_type, const void* data_block, size_t block_word_len, bool first_block)
+{
+    sha_hal_wait_idle();
+    for (size_t i = 0; i < block_word_len; ++i)
+        REG_WRITE(SHA_TEXT_BASE + 4 * i, ((const uint32_t*)data_block)[i]);
+    if (first_block)
+        sha_ll_start_block(sha_type);
+    else
+        sha_ll_continue_block(sha_type);
+}
+
+void sha_hal_read_digest(esp_sha_type sha_type, void* digest_state)
+{
+    //Only sha256 is modelled, other types have longer digests
+    if (sha_type != SHA2_256)
+        sha_error();
+    sha_hal_wait_idle();
+    for (int i = 0; i < 8; ++i)
+        ((uint32_t*)digest_state)[i] = REG_READ(SHA_H_BASE + 4 * i);
+}
+
+#endif
+
+esp_err_t gdma_new_channel(const gdma_channel_alloc_config_t* config, gdma_channel_handle_t* ret_chan)
+{
+    if (!config || config->direction != GDMA_CHANNEL_DIRECTION_TX || !ret_chan)
+        return ESP_FAIL;
+    *ret_chan = (host_gdma_channel*)calloc(1, sizeof(host_gdma_channel));
+    return *ret_chan ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t gdma_del_channel(gdma_channel_handle_t dma_chan)
+{
+    if (dma_chan->sha)
+        gdma_disconnect(dma_chan);
+    free(dma_chan);
+    return ESP_OK;
+}
+
+esp_err_t gdma_connect(gdma_channel_handle_t dma_chan, gdma_trigger_t trig_periph)
+{
+    std::lock_guard<std::mutex> guard(s_gdma);
+    if (trig_periph.periph != GDMA_TRIG_PERIPH_SHA || dma_chan->sha || s_sha_dma)
+        return ESP_FAIL;
+    dma_chan->sha = true;
+    s_sha_dma = dma_chan;
+    return ESP_OK;
+}
+
+esp_err_t gdma_disconnect(gdma_channel_handle_t dma_chan)
+{
+    std::lock_guard<std::mutex> guard(s_gdma);
+    if (!dma_chan->sha)
+        return ESP_FAIL;
+    dma_chan->sha = false;
+    dma_chan->desc = NULL;
+    s_sha_dma = NULL;
+    return ESP_OK;
+}
+
+//Called with the engine held, like the SHA registers
+esp_err_t gdma_start(gdma_channel_handle_t dma_chan, intptr_t desc_base_addr)
+{
+    s_dma_starts.fetch_add(1, std::memory_order_relaxed);
+    if (!dma_chan->sha || s_busy)
+        sha_error();
+    dma_chan->desc = (const lldesc_t*)desc_base_addr;
+    return ESP_OK;
+}
+
+static void selftest_wait(uintptr_t base, uint32_t busy)
+{
+    while (host_sha_read(base + busy))
+    {}
+}
+
+static void selftest_text(uintptr_t base, uint32_t text, const uint8_t* block, int words, bool big_endian)
+{
+    for (int i = 0; i < words; ++i)
+    {
+        uint32_t word;
+        memcpy(&word, block + 4 * i, 4);
+        host_sha_write(base + text + 4 * i, big_endian ? __builtin_bswap32(word) : word);
+    }
+}
+
+//sha256d of an 80 byte header the way each family's miner drives it
+static void selftest_sha256d(host_sha_chip chip, const uint8_t* header, uint8_t* hash)
+{
+    uintptr_t base = (uintptr_t)host_sha_regs;
+    uint8_t tail[64] = { 0 };
+    uint8_t second[64] = { 0 };
+    memcpy(tail, header + 64, 16);
+    tail[16] = 0x80;
+    tail[62] = 0x02;
+    tail[63] = 0x80;
+    second[32] = 0x80;
+    second[62] = 0x01;
+    host_sha_set_chip(chip);
+    if (chip == HOST_SHA_S3)
+    {
+        host_sha_write(base + HOST_SHA_S3_MODE, 2);
+        selftest_text(base, HOST_SHA_S3_TEXT, header, 16, false);
+        host_sha_write(base + HOST_SHA_S3_START, 1);
+        selftest_wait(base, HOST_SHA_S3_BUSY);
+        selftest_text(base, HOST_SHA_S3_TEXT, tail, 16, false);
+        host_sha_write(base + HOST_SHA_S3_CONTINUE, 1);
+        selftest_wait(base, HOST_SHA_S3_BUSY);
+        for (int i = 0; i < 8; ++i)
+            host_sha_write(base + HOST_SHA_S3_TEXT + 4 * i, host_sha_read(base + HOST_SHA_S3_H + 4 * i));
+        selftest_text(base, HOST_SHA_S3_TEXT + 32, second + 32, 8, false);
+        host_sha_write(base + HOST_SHA_S3_START, 1);
+        selftest_wait(base, HOST_SHA_S3_BUSY);
+        for (int i = 0; i < 8; ++i)
+            ((uint32_t*)hash)[i] = host_sha_read(base + HOST_SHA_S3_H + 4 * i);
+    } else
+    {
+        selftest_text(base, HOST_SHA_ESP32_TEXT, header, 16, true);
+        host_sha_write(base + HOST_SHA_ESP32_START, 1);
+        selftest_wait(base, HOST_SHA_ESP32_BUSY);
+        selftest_text(base, HOST_SHA_ESP32_TEXT, tail, 16, true);
+        host_sha_write(base + HOST_SHA_ESP32_CONTINUE, 1);
+        selftest_wait(base, HOST_SHA_ESP32_BUSY);
+        host_sha_write(base + HOST_SHA_ESP32_LOAD, 1);
+        selftest_wait(base, HOST_SHA_ESP32_BUSY);
+        selftest_text(base, HOST_SHA_ESP32_TEXT + 32, second + 32, 8, true);
+        host_sha_write(base + HOST_SHA_ESP32_START, 1);
+        selftest_wait(base, HOST_SHA_ESP32_BUSY);
+        host_sha_write(base + HOST_SHA_ESP32_LOAD, 1);
+        selftest_wait(base, HOST_SHA_ESP32_BUSY);
+        for (int i = 0; i < 8; ++i)
+            ((uint32_t*)hash)[i] = __builtin_bswap32(host_sha_read(base + HOST_SHA_ESP32_TEXT + 4 * i));
+    }
+}
+
+//The same on the S3 through GDMA: both blocks of the header in one chain, the second hash from memory
+static void selftest_sha256d_dma(const uint8_t* header, uint8_t* hash)
+{
+    uintptr_t base = (uintptr_t)host_sha_regs;
+    uint8_t message[128] = { 0 };
+    uint8_t second[64] = { 0 };
+    memcpy(message, header, 80);
+    message[80] = 0x80;
+    message[126] = 0x02;
+    message[127] = 0x80;
+    second[32] = 0x80;
+    second[62] = 0x01;
+    lldesc_t desc[3];
+    memset(desc, 0, sizeof(desc));
+    for (int i = 0; i < 3; ++i)
+    {
+        desc[i].size = desc[i].length = 64;
+        desc[i].owner = 1;
+        desc[i].buf = i < 2 ? message + 64 * i : second;
+    }
+    desc[0].qe.stqe_next = &desc[1];
+    desc[1].eof = desc[2].eof = 1;
+
+    gdma_channel_alloc_config_t config = {};
+    config.direction = GDMA_CHANNEL_DIRECTION_TX;
+    gdma_channel_handle_t channel;
+    gdma_new_channel(&config, &channel);
+    gdma_connect(channel, GDMA_MAKE_TRIGGER(GDMA_TRIG_PERIPH_SHA, 0));
+    host_sha_set_chip(HOST_SHA_S3);
+    host_sha_write(base + HOST_SHA_S3_MODE, 2);
+    host_sha_write(base + HOST_SHA_S3_DMA_BLOCKS, 2);
+    gdma_start(channel, (intptr_t)&desc[0]);
+    host_sha_write(base + HOST_SHA_S3_DMA_START, 1);
+    selftest_wait(base, HOST_SHA_S3_BUSY);
+    for (int i = 0; i < 8; ++i)
+        ((uint32_t*)second)[i] = host_sha_read(base + HOST_SHA_S3_H + 4 * i);
+    host_sha_write(base + HOST_SHA_S3_DMA_BLOCKS, 1);
+    gdma_start(channel, (intptr_t)&desc[2]);
+    host_sha_write(base + HOST_SHA_S3_DMA_START, 1);
+    selftest_wait(base, HOST_SHA_S3_BUSY);
+    for (int i = 0; i < 8; ++i)
+        ((uint32_t*)hash)[i] = host_sha_read(base + HOST_SHA_S3_H + 4 * i);
+    gdma_del_channel(channel);
+}
+
+int host_sha_model_selftest()
+{
+    host_sha_chip chip = s_chip;
+    host_sha_counters before, after;
+    host_sha_get_counters(before);
+    uint8_t header[80];
+    uint32_t seed = 0x53484131;
+    int mismatches = 0;
+    for (int round = 0; round < 64; ++round)
+    {
+        for (int i = 0; i < 80; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            header[i] = seed >> 16;
+        }
+        uint8_t expected[32], hash[32];
+        mbedtls_sha256_ret(header, 80, expected, 0);
+        mbedtls_sha256_ret(expected, 32, expected, 0);
+        for (int family = HOST_SHA_S3; family <= HOST_SHA_ESP32; ++family)
+        {
+            selftest_sha256d((host_sha_chip)family, header, hash);
+            mismatches += memcmp(hash, expected, 32) != 0;
+        }
+        selftest_sha256d_dma(header, hash);
+        mismatches += memcmp(hash, expected, 32) != 0;
+    }
+    host_sha_get_counters(after);
+    host_sha_set_chip(chip);
+    return mismatches + (int)(after.errors - before.errors);
+}
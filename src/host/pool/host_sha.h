@@ -0,0 +1,183 @@
+/************************************************************************************
+*   Software model of the ESP32 SHA accelerator, pool harness only
+
+*   Description:
+
+*   The registers the hardware miners in mining.cpp drive, kept in host memory,
+    with the behaviour of either chip family:
+        S2/S3/C3  message in SHA_TEXT_BASE and state in SHA_H_BASE, both in byte
+                  order (the peripheral swaps the words). START hashes from the
+                  IV, CONTINUE from SHA_H_BASE, the result is back in SHA_H_BASE.
+                  DMA_START / DMA_CONTINUE hash SHA_DMA_BLOCK_NUM blocks from the
+                  descriptors of the GDMA channel connected to SHA (S3),
+                  the text registers are left undefined.
+        ESP32     message in SHA_TEXT_BASE as big endian word values. START
+                  hashes from the IV, CONTINUE from the engine's own state,
+                  LOAD copies that state into the first 8 text words.
+
+    Build with -D CONFIG_IDF_TARGET_ESP32S3 (S2, C3) or -D CONFIG_IDF_TARGET_ESP32
+    for that register map and minerWorkerHw is compiled. REG_WRITE / REG_READ and
+    their DPORT variants are the only way in and every access is counted. A
+    block keeps the engine busy for host_sha_busy_polls reads of the busy
+    register; text or state accessed before that is an error, like reading a
+    half computed digest on the chip. The text registers keep their value
+    across blocks unless host_sha_keep_text is cleared, for code that must not
+    rely on it.
+
+*************************************************************************************/
+#ifndef HOST_SHA_H_
+#define HOST_SHA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3) || defined(CONFIG_IDF_TARGET_ESP32)
+#define HOST_SHA_TARGET
+#endif
+
+enum host_sha_chip
+{
+    HOST_SHA_S3,        //S2, S3 and C3
+    HOST_SHA_ESP32,
+};
+
+//Register offsets from the SHA base, per family
+#define HOST_SHA_S3_MODE        0x00
+#define HOST_SHA_S3_DMA_BLOCKS  0x0C
+#define HOST_SHA_S3_START       0x10
+#define HOST_SHA_S3_CONTINUE    0x14
+#define HOST_SHA_S3_BUSY        0x18
+#define HOST_SHA_S3_DMA_START   0x1C
+#define HOST_SHA_S3_DMA_CONTINUE 0x20
+#define HOST_SHA_S3_H           0x40
+#define HOST_SHA_S3_TEXT        0x80
+
+#define HOST_SHA_ESP32_TEXT     0x00
+#define HOST_SHA_ESP32_START    0x90
+#define HOST_SHA_ESP32_CONTINUE 0x94
+#define HOST_SHA_ESP32_LOAD     0x98
+#define HOST_SHA_ESP32_BUSY     0x9C
+
+#define HOST_SHA_REGS_SIZE      0xC0
+
+extern volatile uint32_t host_sha_regs[HOST_SHA_REGS_SIZE / 4];
+extern uint32_t host_sha_busy_polls;    //Busy register reads per block, 1 by default
+extern bool host_sha_keep_text;         //false: a block leaves garbage in the text registers
+
+typedef struct
+{
+    uint64_t writes;        //Text, state and control registers
+    uint64_t reads;         //Text and state, the busy register not included
+    uint64_t polls;         //Busy register reads
+    uint64_t blocks;        //Compressions
+    uint64_t dma_starts;    //GDMA channel starts
+    uint64_t errors;        //Accesses while busy, bad mode or address
+} host_sha_counters;
+
+void host_sha_write(uintptr_t address, uint32_t value);
+uint32_t host_sha_read(uintptr_t address);
+
+//Snapshot, updated by every access from any thread
+void host_sha_get_counters(host_sha_counters& counters);
+
+//Family the registers behave as, the build's target by default
+void host_sha_set_chip(host_sha_chip chip);
+
+//Known answers through the registers of both families and the S3 DMA, returns the mismatches
+int host_sha_model_selftest();
+
+//What the IDF headers give the miner, on the model
+#if defined(CONFIG_IDF_TARGET_ESP32)
+typedef enum { SHA1 = 0, SHA2_256, SHA2_384, SHA2_512, SHA_TYPE_MAX } esp_sha_type;
+
+#define SHA_TEXT_BASE           ((uintptr_t)host_sha_regs + HOST_SHA_ESP32_TEXT)
+#define SHA_256_START_REG       ((uintptr_t)host_sha_regs + HOST_SHA_ESP32_START)
+#define SHA_256_CONTINUE_REG    ((uintptr_t)host_sha_regs + HOST_SHA_ESP32_CONTINUE)
+#define SHA_256_LOAD_REG        ((uintptr_t)host_sha_regs + HOST_SHA_ESP32_LOAD)
+#define SHA_256_BUSY_REG        ((uintptr_t)host_sha_regs + HOST_SHA_ESP32_BUSY)
+#else
+typedef enum { SHA1 = 0, SHA2_224, SHA2_256, SHA2_384, SHA2_512, SHA2_512224, SHA2_512256, SHA2_512T, SHA_TYPE_MAX } esp_sha_type;
+
+#define SHA_MODE_REG            ((uintptr_t)host_sha_regs + HOST_SHA_S3_MODE)
+#define SHA_START_REG           ((uintptr_t)host_sha_regs + HOST_SHA_S3_START)
+#define SHA_CONTINUE_REG        ((uintptr_t)host_sha_regs + HOST_SHA_S3_CONTINUE)
+#define SHA_BUSY_REG            ((uintptr_t)host_sha_regs + HOST_SHA_S3_BUSY)
+#define SHA_DMA_BLOCK_NUM_REG   ((uintptr_t)host_sha_regs + HOST_SHA_S3_DMA_BLOCKS)
+#define SHA_DMA_START_REG       ((uintptr_t)host_sha_regs + HOST_SHA_S3_DMA_START)
+#define SHA_DMA_CONTINUE_REG    ((uintptr_t)host_sha_regs + HOST_SHA_S3_DMA_CONTINUE)
+#define SHA_H_BASE              ((uintptr_t)host_sha_regs + HOST_SHA_S3_H)
+#define SHA_TEXT_BASE           ((uintptr_t)host_sha_regs + HOST_SHA_S3_TEXT)
+#endif
+
+#define REG_WRITE(_r, _v)               host_sha_write((uintptr_t)(_r), (_v))
+#define REG_READ(_r)                    host_sha_read((uintptr_t)(_r))
+#define DPORT_REG_WRITE(_r, _v)         host_sha_write((uintptr_t)(_r), (_v))
+#define DPORT_REG_READ(_r)              host_sha_read((uintptr_t)(_r))
+#define DPORT_SEQUENCE_REG_READ(_r)     host_sha_read((uintptr_t)(_r))
+#define DPORT_INTERRUPT_DISABLE()
+#define DPORT_INTERRUPT_RESTORE()
+
+//sha/sha_dma.h and sha/sha_parallel_engine.h: one user of the engine at a time
+void esp_sha_acquire_hardware();
+void esp_sha_release_hardware();
+void esp_sha_lock_engine(esp_sha_type sha_type);
+void esp_sha_unlock_engine(esp_sha_type sha_type);
+
+//hal/sha_ll.h
+#if defined(CONFIG_IDF_TARGET_ESP32)
+static inline void sha_ll_start_block(esp_sha_type) { DPORT_REG_WRITE(SHA_256_START_REG, 1); }
+static inline void sha_ll_continue_block(esp_sha_type) { DPORT_REG_WRITE(SHA_256_CONTINUE_REG, 1); }
+static inline void sha_ll_load(esp_sha_type) { DPORT_REG_WRITE(SHA_256_LOAD_REG, 1); }
+#else
+static inline void sha_ll_start_block(esp_sha_type sha_type) { REG_WRITE(SHA_MODE_REG, sha_type); REG_WRITE(SHA_START_REG, 1); }
+static inline void sha_ll_continue_block(esp_sha_type sha_type) { REG_WRITE(SHA_MODE_REG, sha_type); REG_WRITE(SHA_CONTINUE_REG, 1); }
+//The state is in SHA_H_BASE as soon as a block is done
+static inline void sha_ll_load(esp_sha_type) {}
+static inline void sha_ll_set_block_num(size_t num_blocks) { REG_WRITE(SHA_DMA_BLOCK_NUM_REG, num_blocks); }
+static inline void sha_ll_start_dma(esp_sha_type sha_type) { REG_WRITE(SHA_MODE_REG, sha_type); REG_WRITE(SHA_DMA_START_REG, 1); }
+static inline void sha_ll_continue_dma(esp_sha_type sha_type) { REG_WRITE(SHA_MODE_REG, sha_type); REG_WRITE(SHA_DMA_CONTINUE_REG, 1); }
+
+//hal/sha_hal.h
+void sha_hal_wait_idle();
+void sha_hal_hash_block(esp_sha_type sha_type, const void* data_block, size_t block_word_len, bool first_block);
+void sha_hal_read_digest(esp_sha_type sha_type, void* digest_state);
+
+#endif
+
+//soc/lldesc.h, a GDMA descriptor: the next one in qe.stqe_next, NULL ends the chain
+typedef struct lldesc_s
+{
+    volatile uint32_t size : 12, length : 12, offset : 5, sosf : 1, eof : 1, owner : 1;
+    volatile const uint8_t* buf;
+    union
+    {
+        volatile uint32_t empty;
+        struct { struct lldesc_s* stqe_next; } qe;
+    };
+} lldesc_t;
+
+//esp_private/gdma.h, TX channels to the SHA peripheral only (S3)
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK      0
+#define ESP_FAIL    -1
+#endif
+typedef struct host_gdma_channel* gdma_channel_handle_t;
+typedef enum { GDMA_CHANNEL_DIRECTION_TX, GDMA_CHANNEL_DIRECTION_RX } gdma_channel_direction_t;
+typedef struct
+{
+    gdma_channel_handle_t sibling_chan;
+    gdma_channel_direction_t direction;
+    struct { uint32_t reserve_sibling : 1; } flags;
+} gdma_channel_alloc_config_t;
+typedef enum { GDMA_TRIG_PERIPH_M2M = -1, GDMA_TRIG_PERIPH_AES = 6, GDMA_TRIG_PERIPH_SHA = 7 } gdma_trigger_peripheral_t;
+typedef struct { gdma_trigger_peripheral_t periph; int instance_id; } gdma_trigger_t;
+#define GDMA_MAKE_TRIGGER(peri, id)     (gdma_trigger_t){ .periph = peri, .instance_id = id }
+
+esp_err_t gdma_new_channel(const gdma_channel_alloc_config_t* config, gdma_channel_handle_t* ret_chan);
+esp_err_t gdma_del_channel(gdma_channel_handle_t dma_chan);
+esp_err_t gdma_connect(gdma_channel_handle_t dma_chan, gdma_trigger_t trig_periph);
+esp_err_t gdma_disconnect(gdma_channel_handle_t dma_chan);
+esp_err_t gdma_start(gdma_channel_handle_t dma_chan, intptr_t desc_base_addr);
+
+#endif /* HOST_SHA_H_ */
@@ -0,0 +1,3 @@
+//Host stand-in for lwip/sockets.h, pool harness only: the host's BSD sockets
+#include <sys/socket.h>
+#include <errno.h>
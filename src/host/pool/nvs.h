@@ -0,0 +1,31 @@
+/************************************************************************************
+*   Host stand-in for nvs.h, pool harness only: there is no flash, every call
+    fails the way an erased partition does and the stats start from zero
+*************************************************************************************/
+#ifndef HOST_NVS_H_
+#define HOST_NVS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+#define ESP_ERR_NVS_NO_FREE_PAGES       0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   0x1110
+
+static inline esp_err_t nvs_open(const char*, nvs_open_mode_t, nvs_handle_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_get_blob(nvs_handle_t, const char*, void*, size_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_set_blob(nvs_handle_t, const char*, const void*, size_t) { return ESP_FAIL; }
+static inline esp_err_t nvs_get_u32(nvs_handle_t, const char*, uint32_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_set_u32(nvs_handle_t, const char*, uint32_t) { return ESP_FAIL; }
+static inline esp_err_t nvs_get_u64(nvs_handle_t, const char*, uint64_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_set_u64(nvs_handle_t, const char*, uint64_t) { return ESP_FAIL; }
+static inline esp_err_t nvs_commit(nvs_handle_t) { return ESP_FAIL; }
+static inline void nvs_close(nvs_handle_t) {}
+
+#endif /* HOST_NVS_H_ */
@@ -0,0 +1,11 @@
+#ifndef HOST_NVS_FLASH_H_
+#define HOST_NVS_FLASH_H_
+
+#include "nvs.h"
+
+#define ESP_ERROR_CHECK(x) (x)
+
+static inline esp_err_t nvs_flash_init() { return ESP_FAIL; }
+static inline esp_err_t nvs_flash_erase() { return ESP_FAIL; }
+
+#endif /* HOST_NVS_FLASH_H_ */
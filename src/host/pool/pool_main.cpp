@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include <WiFi.h>
+#include "mining.h"
+#include "drivers/storage/storage.h"
+#include "stratum_pool.h"
+#include "host_sha.h"
+#include "version.h"
+
+//End to end run of the stratum, dispatcher and miner tasks from mining.cpp against the stand-in pool:
+//  program [-v | --log file] [--clobber] [scenario | script file ...]
+//Without scenarios all the built-in ones run. Exits non zero when a pool rejects a share as
+//duplicate or invalid, a disconnect is not recovered within POOL_RECONNECT_MAX_MS or no share is accepted.
+//Built for a chip (-D CONFIG_IDF_TARGET_ESP32S3 or _ESP32) miner 0 is minerWorkerHw on the SHA
+//accelerator model, with its register accesses per nonce and any misuse of the peripheral reported.
+//--clobber: the model's text registers do not keep their value across blocks.
+//--bench [ms]: no pool, the firmware's benchmark lines (sha_bench.h) for every kernel of the build.
+
+#define POOL_RECONNECT_MAX_MS   5000
+
+TSettings Settings;
+
+//Display and led hooks the stratum worker calls
+void animateCurrentScreen(unsigned long) {}
+void doLedStuff(unsigned long) {}
+void drawCurrentScreen(unsigned long) {}
+void resetToFirstScreen() {}
+void switchToNextScreen() {}
+
+static const struct {
+    const char* name;
+    const char* script;
+} s_scenarios[] = {
+    { "steady",
+      "0 difficulty 0.0002\n"
+      "0 notify clean\n"
+      "5000 notify\n"
+      "10000 notify\n"
+      "15000 notify\n"
+      "20000 end\n" },
+    //A block race: clean jobs faster than a range is hashed, then a retarget
+    { "clean_storm",
+      "0 difficulty 0.0002\n"
+      "0 notify clean\n"
+      "3000 storm 40 250\n"
+      "14000 difficulty 0.0004\n"
+      "14000 notify\n"
+      "20000 end\n" },
+    { "disconnect",
+      "0 difficulty 0.0002\n"
+      "0 notify clean\n"
+      "4000 disconnect\n"
+      "8000 notify clean\n"
+      "10000 disconnect\n"
+      "10050 notify clean\n"
+      "15000 disconnect\n"
+      "20000 end\n" },
+    //BIP 310 pool: set_version_mask, set_difficulty and notify before the subscribe answer
+    { "early_mask",
+      "0 early_mask 1e000000\n"
+      "0 difficulty 0.0002\n"
+      "0 notify clean\n"
+      "6000 disconnect\n"
+      "12000 notify\n"
+      "20000 end\n" },
+    //A pool behind a congested link: small window, reads trickle, writes are chopped, answers lag
+    { "slow_read",
+      "0 rcvbuf 1024\n"
+      "0 disconnect\n"
+      "0 difficulty 0.0001\n"
+      "0 notify clean\n"
+      "0 read_pace 64 100\n"
+      "0 write_pace 100 20\n"
+      "0 answer_delay 300\n"
+      "6000 notify clean\n"
+      "12000 notify\n"
+      "20000 rcvbuf 0\n"
+      "20000 end\n" },
+};
+
+static uint64_t miner_nonces(int first = 0, int last = 3)
+{
+    miner_counters counters[4];
+    int miners = getMinerCounters(counters, 4);
+    uint64_t nonces = 0;
+    for (int i = first; i < miners && i <= last; ++i)
+        nonces += counters[i].nonces;
+    return nonces;
+}
+
+static char* read_file(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = (char*)malloc(size + 1);
+    if (text && fread(text, 1, size, f) != (size_t)size)
+    {
+        free(text);
+        text = NULL;
+    }
+    if (text)
+        text[size] = 0;
+    fclose(f);
+    return text;
+}
+
+static bool run_scenario(const PoolScript& script)
+{
+    static PoolStats stats;
+    host_sha_counters sha_start, sha_end;
+    host_sha_get_counters(sha_start);
+    uint64_t nonces = miner_nonces();
+    uint64_t hw_nonces = miner_nonces(0, 0);
+    unsigned long start = millis();
+    pool_run(script, stats);
+    double seconds = (millis() - start) / 1000.0;
+    double hashrate = (miner_nonces() - nonces) / seconds;
+    hw_nonces = miner_nonces(0, 0) - hw_nonces;
+    host_sha_get_counters(sha_end);
+
+    //What the miners' hashrate should have earned, in shares of the difficulty they were checked at
+    double work_rate = stats.accepted_work * 4294967296.0 / seconds;
+    double stale = stats.submits ? 100.0 * stats.stale / stats.submits : 0;
+    printf("%-12s %5.1f s  %7.1f kH/s  %4u submits  %6.2f shares/s  pool %7.1f kH/s (%5.1f%%)  stale %4.1f%%  dup %u  invalid %u",
+           script.name, seconds, hashrate / 1000, stats.submits, stats.accepted / seconds,
+           work_rate / 1000, hashrate > 0 ? 100 * work_rate / hashrate : 0, stale, stats.duplicate, stats.invalid);
+    if (stats.disconnects)
+        printf("  reconnect %u/%u mean %.0f max %.0f ms, share %.0f ms",
+               stats.reconnects, stats.disconnects, stats.reconnects ? stats.reconnect_us / 1000.0 / stats.reconnects : 0,
+               stats.reconnect_max_us / 1000.0, stats.recovered ? stats.recovered_us / 1000.0 / stats.recovered : 0);
+    printf("\n");
+#ifdef HOST_SHA_TARGET
+    //Dispatcher midstates included, a few blocks per template. Miner 0's nonces, -D HW_SHA_OVERLAP software ones too
+    double per_nonce = hw_nonces ? 1.0 / hw_nonces : 0;
+    printf("%-12s hw sha: %.1f kH/s  per nonce %.2f writes  %.2f reads  %.2f busy polls  %.2f blocks  %.2f dma starts  %llu errors\n",
+           "", hw_nonces / seconds / 1000, (sha_end.writes - sha_start.writes) * per_nonce, (sha_end.reads - sha_start.reads) * per_nonce,
+           (sha_end.polls - sha_start.polls) * per_nonce, (sha_end.blocks - sha_start.blocks) * per_nonce,
+           (sha_end.dma_starts - sha_start.dma_starts) * per_nonce, (unsigned long long)(sha_end.errors - sha_start.errors));
+#endif
+
+    return stats.accepted > 0 && stats.duplicate == 0 && stats.invalid == 0 && sha_end.errors == sha_start.errors &&
+           stats.reconnects >= stats.disconnects && stats.reconnect_max_us <= POOL_RECONNECT_MAX_MS * 1000u;
+}
+
+#if defined(CONFIG_IDF_TARGET_ESP32)
+#define POOL_BENCH_TARGET   "esp32 model"
+#elif defined(HOST_SHA_TARGET)
+#define POOL_BENCH_TARGET   "esp32s3 model"
+#else
+#define POOL_BENCH_TARGET   "host"
+#endif
+
+//minerBenchKernel through mining.cpp, the SHA kernels on the model: its rates say nothing of the chip's
+static int run_bench(uint32_t duration_ms)
+{
+    host_sha_counters sha_start, sha_end;
+    host_sha_get_counters(sha_start);
+    for (int k = 0; k < SHA_BENCH_KERNELS; ++k)
+    {
+        ShaBenchResult r = {};
+        r.kernel = (ShaBenchKernel)k;
+        if (!minerBenchKernel(r.kernel, duration_ms, r.hashes, r.elapsed_us))
+            continue;
+        r.target = POOL_BENCH_TARGET;
+        r.version = CURRENT_VERSION;
+        r.cores = 1;
+        r.core_load[0] = -1;
+        char line[320];
+        sha_bench_json(line, sizeof(line), r);
+        fputs(line, stdout);
+    }
+    host_sha_get_counters(sha_end);
+    if (sha_end.errors != sha_start.errors)
+    {
+        printf("sha model: %llu errors\n", (unsigned long long)(sha_end.errors - sha_start.errors));
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    FILE* log = NULL;
+    int first = 1;
+    while (first < argc && argv[first][0] == '-')
+    {
+        if (strcmp(argv[first], "-v") == 0)
+            Serial.host_output(stdout);
+        else if (first + 1 < argc && strcmp(argv[first], "--log") == 0)
+        {
+            log = fopen(argv[++first], "w");
+            Serial.host_output(log);
+        } else if (strcmp(argv[first], "--clobber") == 0)
+            host_sha_keep_text = false;
+        else if (strcmp(argv[first], "--bench") == 0)
+            return run_bench(first + 1 < argc ? strtoul(argv[first + 1], NULL, 0) : SHA_BENCH_MS);
+        else
+        {
+            printf("unknown option %s\n", argv[first]);
+            return 2;
+        }
+        first++;
+    }
+
+    static PoolScript scripts[8];
+    int count = 0;
+    char error[128];
+    if (first == argc)
+    {
+        for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); ++i)
+            pool_script_parse(s_scenarios[i].script, s_scenarios[i].name, scripts[count++], error, sizeof(error));
+    }
+    for (int i = first; i < argc && count < 8; ++i)
+    {
+        const char* text = NULL;
+        char* file = NULL;
+        for (size_t s = 0; s < sizeof(s_scenarios) / sizeof(s_scenarios[0]); ++s)
+        {
+            if (strcmp(argv[i], s_scenarios[s].name) == 0)
+                text = s_scenarios[s].script;
+        }
+        if (!text)
+            text = file = read_file(argv[i]);
+        if (!text)
+        {
+            printf("no scenario or script %s\n", argv[i]);
+            return 2;
+        }
+        const char* name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        bool ok = pool_script_parse(text, name, scripts[count++], error, sizeof(error));
+        free(file);
+        if (!ok)
+        {
+            printf("%s\n", error);
+            return 2;
+        }
+    }
+
+#ifdef HOST_SHA_TARGET
+    int sha_errors = host_sha_model_selftest();
+    printf("sha model: S3, S3 DMA and ESP32 register sequences against sha256d, %d errors\n", sha_errors);
+    if (sha_errors)
+        return 1;
+#endif
+
+    uint16_t port;
+    if (!pool_listen(port))
+    {
+        printf("cannot listen on 127.0.0.1\n");
+        return 2;
+    }
+    Settings.PoolAddress = "127.0.0.1";
+    Settings.PoolPort = port;
+    strcpy(Settings.BtcWallet, "bc1qhostharness.pool");
+
+    //The tasks setup() starts, less the monitor and the screen
+    static const char dispatcher_name[] = "(Dispatcher)";
+    static const char stratum_name[] = "(Stratum)";
+    TaskHandle_t minerTask1, minerTask2;
+    xTaskCreatePinnedToCore(runJobDispatcher, "Dispatcher", 4096, (void*)dispatcher_name, 4, NULL, 1);
+    xTaskCreatePinnedToCore(runStratumWorker, "Stratum", 15000, (void*)stratum_name, 4, NULL, 1);
+#ifdef HOST_SHA_TARGET
+    xTaskCreate(minerWorkerHw, "MinerHw-0", 4096, (void*)0, 3, &minerTask1);
+#else
+    xTaskCreate(minerWorkerSw, "MinerSw-0", 6000, (void*)0, 1, &minerTask1);
+#endif
+    xTaskCreate(minerWorkerSw, "MinerSw-1", 6000, (void*)1, 1, &minerTask2);
+
+    bool ok = true;
+    for (int i = 0; i < count; ++i)
+        ok &= run_scenario(scripts[i]);
+    if (log)
+        fclose(log);
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    //Tasks never return, leave without unwinding them
+    fflush(stdout);
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,7 @@
+//Host stand-in for sha/sha_parallel_engine.h, pool harness only: the SHA accelerator model in host_sha.h
+#ifndef HOST_SHA_SHA_PARALLEL_ENGINE_H_
+#define HOST_SHA_SHA_PARALLEL_ENGINE_H_
+
+#include "host_sha.h"
+
+#endif /* HOST_SHA_SHA_PARALLEL_ENGINE_H_ */
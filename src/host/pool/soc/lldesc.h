@@ -0,0 +1,7 @@
+//Host stand-in for soc/lldesc.h, pool harness only: the SHA accelerator model in host_sha.h
+#ifndef HOST_SOC_LLDESC_H_
+#define HOST_SOC_LLDESC_H_
+
+#include "host_sha.h"
+
+#endif /* HOST_SOC_LLDESC_H_ */
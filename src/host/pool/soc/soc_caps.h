@@ -0,0 +1,4 @@
+//Host stand-in for soc/soc_caps.h, pool harness only: two miner tasks like the dual core chips
+#ifndef SOC_CPU_CORES_NUM
+#define SOC_CPU_CORES_NUM 2
+#endif
@@ -0,0 +1,728 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <deque>
+#include <set>
+#include <string>
+#include "stratum_pool.h"
+#include "mbedtls/sha256.h"
+
+//Stand-in pool, single connection, driven from pool_run on the caller's thread
+#define POOL_JOBS               16      //Jobs a share may still name
+#define POOL_BRANCHES_MAX       12
+#define POOL_COINBASE_MAX       96
+#define POOL_EXTRANONCE2_SIZE   4
+#define POOL_READ_MAX           4096
+#define POOL_PARAMS_MAX         8
+#define POOL_PARAM_SIZE         96
+#define POOL_POLL_MS            2
+
+struct PoolJob
+{
+    uint32_t serial;            //0 unused
+    char id[20];
+    uint8_t prev_block_hash[32];
+    uint8_t coinb1[POOL_COINBASE_MAX];
+    uint8_t coinb2[POOL_COINBASE_MAX];
+    size_t coinb1_size;
+    size_t coinb2_size;
+    uint8_t branches[POOL_BRANCHES_MAX][32];
+    int branch_count;
+    uint32_t version;
+    uint32_t nbits;
+    uint32_t ntime;
+    double difficulty;
+    bool stale;
+};
+
+struct PoolAnswer
+{
+    uint64_t due_us;
+    std::string line;
+};
+
+struct PoolState
+{
+    int listen_fd = -1;
+    int rcvbuf;                     //As the listen socket came, for "rcvbuf 0"
+    int fd = -1;
+    std::string in;                 //Partial line received
+    std::string out;                //Not written yet
+    std::deque<PoolAnswer> answers; //Delayed submit answers
+    std::set<std::string> shares;   //Seen this scenario, for duplicates
+
+    //Session
+    uint32_t extranonce1;
+    uint32_t extranonce1_next = 0x08000001;
+    uint32_t session_mask;
+    bool authorized;
+    uint64_t disconnect_us;         //Waiting for the session after a scripted disconnect, 0 when not
+    uint64_t recovering_us;         //Reconnected, waiting for its first accepted share
+
+    //Timeline
+    PoolJob jobs[POOL_JOBS];
+    uint32_t job_serial;
+    double difficulty;
+    uint32_t version_mask;
+    uint32_t early_mask;            //Sent with set_version_mask before the subscribe answer, 0 not
+    uint64_t rng;
+    uint32_t read_pace, read_interval_ms, write_pace, write_interval_ms, answer_delay_ms;
+    uint64_t next_read_us, next_write_us;
+};
+
+static PoolState s_pool;
+
+static uint64_t pool_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint32_t pool_rng()
+{
+    s_pool.rng ^= s_pool.rng << 13;
+    s_pool.rng ^= s_pool.rng >> 7;
+    s_pool.rng ^= s_pool.rng << 17;
+    return (uint32_t)(s_pool.rng >> 16);
+}
+
+static void pool_random(uint8_t* out, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        out[i] = pool_rng();
+}
+
+static void pool_hex(std::string& out, const uint8_t* data, size_t size)
+{
+    static const char s_hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i)
+    {
+        out += s_hex[data[i] >> 4];
+        out += s_hex[data[i] & 0xF];
+    }
+}
+
+static int pool_nibble(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+//Exactly size bytes of hex
+static bool pool_unhex(const char* hex, uint8_t* out, size_t size)
+{
+    if (strlen(hex) != 2 * size)
+        return false;
+    for (size_t i = 0; i < size; ++i)
+    {
+        int hi = pool_nibble(hex[2 * i]), lo = pool_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        out[i] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+static bool pool_hex32(const char* hex, uint32_t& value)
+{
+    uint8_t bytes[4];
+    if (!pool_unhex(hex, bytes, 4))
+        return false;
+    value = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+    return true;
+}
+
+static void pool_sha256d(const uint8_t* data, size_t size, uint8_t hash[32])
+{
+    uint8_t inter[32];
+    mbedtls_sha256_ret(data, size, inter, 0);
+    mbedtls_sha256_ret(inter, 32, hash, 0);
+}
+
+static void put_le32(uint8_t* out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out[i] = value >> (8 * i);
+}
+
+//Requests are read with plain string scans, not with the firmware's parser
+static bool json_id(const char* line, unsigned long& id)
+{
+    const char* p = strstr(line, "\"id\"");
+    if (!p || !(p = strchr(p, ':')))
+        return false;
+    char* end;
+    id = strtoul(p + 1, &end, 10);
+    return end != p + 1;
+}
+
+static bool json_string(const char* line, const char* key, char* out, size_t size)
+{
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    const char* p = strstr(line, quoted);
+    if (!p || !(p = strchr(p + strlen(quoted), '"')))
+        return false;
+    const char* end = strchr(++p, '"');
+    if (!end || (size_t)(end - p) >= size)
+        return false;
+    memcpy(out, p, end - p);
+    out[end - p] = 0;
+    return true;
+}
+
+//Top level strings of "params", nested arrays and objects skipped
+static int json_params(const char* line, char params[][POOL_PARAM_SIZE])
+{
+    const char* p = strstr(line, "\"params\"");
+    if (!p || !(p = strchr(p, '[')))
+        return 0;
+    int count = 0, depth = 0;
+    for (++p; *p && depth >= 0; ++p)
+    {
+        if (*p == '[' || *p == '{')
+            depth++;
+        else if (*p == ']' || *p == '}')
+            depth--;
+        else if (*p == '"')
+        {
+            const char* end = strchr(p + 1, '"');
+            if (!end)
+                break;
+            if (depth == 0 && count < POOL_PARAMS_MAX && (size_t)(end - p - 1) < POOL_PARAM_SIZE)
+            {
+                memcpy(params[count], p + 1, end - p - 1);
+                params[count++][end - p - 1] = 0;
+            }
+            p = end;
+        }
+    }
+    return count;
+}
+
+static void pool_send(const std::string& line)
+{
+    if (s_pool.fd >= 0)
+        s_pool.out += line;
+}
+
+static void pool_send_difficulty()
+{
+    char line[96];
+    snprintf(line, sizeof(line), "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[%.10g]}\n", s_pool.difficulty);
+    pool_send(line);
+}
+
+static void pool_send_notify(const PoolJob& job, bool clean)
+{
+    std::string line = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"";
+    line += job.id;
+    line += "\",\"";
+    pool_hex(line, job.prev_block_hash, 32);
+    line += "\",\"";
+    pool_hex(line, job.coinb1, job.coinb1_size);
+    line += "\",\"";
+    pool_hex(line, job.coinb2, job.coinb2_size);
+    line += "\",[";
+    for (int i = 0; i < job.branch_count; ++i)
+    {
+        line += i ? ",\"" : "\"";
+        pool_hex(line, job.branches[i], 32);
+        line += "\"";
+    }
+    char tail[64];
+    snprintf(tail, sizeof(tail), "],\"%08x\",\"%08x\",\"%08x\",%s]}\n", job.version, job.nbits, job.ntime, clean ? "true" : "false");
+    line += tail;
+    pool_send(line);
+}
+
+static const PoolJob* pool_current_job()
+{
+    const PoolJob* current = NULL;
+    for (int i = 0; i < POOL_JOBS; ++i)
+    {
+        if (s_pool.jobs[i].serial && (!current || s_pool.jobs[i].serial > current->serial))
+            current = &s_pool.jobs[i];
+    }
+    return current;
+}
+
+static void pool_new_job(bool clean)
+{
+    uint32_t serial = ++s_pool.job_serial;
+    PoolJob& job = s_pool.jobs[serial % POOL_JOBS];
+    if (clean)
+    {
+        for (int i = 0; i < POOL_JOBS; ++i)
+            s_pool.jobs[i].stale = true;
+    }
+    job.serial = serial;
+    snprintf(job.id, sizeof(job.id), "%04x%08x", serial & 0xFFFF, pool_rng());
+    pool_random(job.prev_block_hash, 32);
+    //Shaped like a real coinbase: version, one input, height push, then random filler
+    static const uint8_t s_coinb1[] = { 0x02, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                        0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x35, 0x03 };
+    memcpy(job.coinb1, s_coinb1, sizeof(s_coinb1));
+    job.coinb1_size = sizeof(s_coinb1) + 8 + pool_rng() % 24;
+    pool_random(job.coinb1 + sizeof(s_coinb1), job.coinb1_size - sizeof(s_coinb1));
+    job.coinb2_size = 40 + pool_rng() % 48;
+    pool_random(job.coinb2, job.coinb2_size);
+    job.branch_count = pool_rng() % (POOL_BRANCHES_MAX + 1);
+    pool_random(job.branches[0], job.branch_count * 32);
+    job.version = 0x20000000;
+    job.nbits = 0x17034219;
+    job.ntime = 0x66000000 + serial;
+    job.difficulty = s_pool.difficulty;
+    job.stale = false;
+    if (s_pool.authorized)
+        pool_send_notify(job, clean);
+}
+
+static void pool_close(uint64_t now)
+{
+    if (s_pool.fd >= 0)
+        close(s_pool.fd);
+    s_pool.fd = -1;
+    s_pool.in.clear();
+    s_pool.out.clear();
+    s_pool.answers.clear();
+    s_pool.authorized = false;
+    s_pool.disconnect_us = now;
+    s_pool.recovering_us = 0;
+}
+
+//Header as the pool rebuilds it from the job and the submit, see test_roll.cpp
+static void pool_share_hash(const PoolJob& job, const uint8_t* extranonce2, uint32_t version, uint32_t ntime, uint32_t nonce, uint8_t hash[32])
+{
+    uint8_t coinbase[2 * POOL_COINBASE_MAX + 4 + POOL_EXTRANONCE2_SIZE];
+    size_t size = 0;
+    memcpy(coinbase, job.coinb1, job.coinb1_size);
+    size += job.coinb1_size;
+    for (int i = 0; i < 4; ++i)
+        coinbase[size++] = s_pool.extranonce1 >> (24 - 8 * i);
+    memcpy(coinbase + size, extranonce2, POOL_EXTRANONCE2_SIZE);
+    size += POOL_EXTRANONCE2_SIZE;
+    memcpy(coinbase + size, job.coinb2, job.coinb2_size);
+    size += job.coinb2_size;
+
+    uint8_t node[64];
+    pool_sha256d(coinbase, size, node);
+    for (int i = 0; i < job.branch_count; ++i)
+    {
+        memcpy(node + 32, job.branches[i], 32);
+        pool_sha256d(node, 64, node);
+    }
+
+    //Stratum sends the previous hash as 32 bit words in the other byte order
+    uint8_t header[80];
+    const uint8_t* prev = job.prev_block_hash;
+    put_le32(header, version);
+    for (int i = 0; i < 32; i += 4)
+        put_le32(header + 4 + i, ((uint32_t)prev[i] << 24) | ((uint32_t)prev[i + 1] << 16) | ((uint32_t)prev[i + 2] << 8) | prev[i + 3]);
+    memcpy(header + 36, node, 32);
+    put_le32(header + 68, ntime);
+    put_le32(header + 72, job.nbits);
+    put_le32(header + 76, nonce);
+    pool_sha256d(header, 80, hash);
+}
+
+//Error member of the answer, NULL when accepted
+static const char* pool_check_share(char params[][POOL_PARAM_SIZE], int count, PoolStats& stats)
+{
+    if (count != 5 && count != 6)
+        return "[20,\"Bad params\",null]";
+    const PoolJob* job = NULL;
+    for (int i = 0; i < POOL_JOBS; ++i)
+    {
+        if (s_pool.jobs[i].serial && strcmp(s_pool.jobs[i].id, params[1]) == 0)
+            job = &s_pool.jobs[i];
+    }
+    if (!job || job->stale)
+    {
+        stats.stale++;
+        return "[21,\"Job not found\",null]";
+    }
+
+    uint8_t extranonce2[POOL_EXTRANONCE2_SIZE];
+    uint32_t ntime, nonce, version = job->version, version_bits = 0;
+    if (!pool_unhex(params[2], extranonce2, sizeof(extranonce2)) || !pool_hex32(params[3], ntime) || !pool_hex32(params[4], nonce) ||
+        ntime != job->ntime || (count == 6 && (!pool_hex32(params[5], version_bits) || (version_bits & ~s_pool.session_mask))))
+    {
+        stats.invalid++;
+        return "[20,\"Invalid share\",null]";
+    }
+    //BIP 310
+    if (count == 6)
+        version = (version & ~s_pool.session_mask) | (version_bits & s_pool.session_mask);
+
+    char key[128];
+    snprintf(key, sizeof(key), "%s:%08x:%s:%08x:%08x:%08x", job->id, s_pool.extranonce1, params[2], ntime, nonce, version);
+    if (!s_pool.shares.insert(key).second)
+    {
+        stats.duplicate++;
+        return "[22,\"Duplicate share\",null]";
+    }
+
+    uint8_t hash[32];
+    pool_share_hash(*job, extranonce2, version, ntime, nonce, hash);
+    double value = 0;
+    for (int i = 31; i >= 0; --i)
+        value = value * 256.0 + hash[i];
+    double difficulty = value > 0 ? ldexp(65535.0, 208) / value : 0;
+    //A retarget counts from when it was sent, the miner may still be on the job's
+    double wanted = job->difficulty < s_pool.difficulty ? job->difficulty : s_pool.difficulty;
+    if (difficulty < wanted * (1 - 1e-9))
+    {
+        stats.invalid++;
+        return "[23,\"Low difficulty share\",null]";
+    }
+    stats.accepted++;
+    stats.accepted_work += wanted;
+    return NULL;
+}
+
+static void pool_message(const char* line, uint64_t now, uint64_t start, PoolStats& stats)
+{
+    char method[64];
+    char params[POOL_PARAMS_MAX][POOL_PARAM_SIZE];
+    char answer[256];
+    unsigned long id = 0;
+    if (!json_id(line, id) || !json_string(line, "method", method, sizeof(method)))
+        return;
+
+    if (strcmp(method, "mining.configure") == 0)
+    {
+        char requested[16];
+        uint32_t mask = 0;
+        if (json_string(line, "version-rolling.mask", requested, sizeof(requested)))
+            pool_hex32(requested, mask);
+        s_pool.session_mask = mask & s_pool.version_mask;
+        if (s_pool.version_mask)
+            snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"%08x\"},\"error\":null}\n",
+                     id, s_pool.session_mask);
+        else
+            snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":null,\"error\":[20,\"Unknown method\",null]}\n", id);
+        pool_send(answer);
+    } else if (strcmp(method, "mining.subscribe") == 0)
+    {
+        s_pool.extranonce1 = s_pool.extranonce1_next++;
+        if (s_pool.early_mask)
+        {
+            //Like BIP 310 pools that notify the mask before answering, and eager ones the work
+            s_pool.session_mask &= s_pool.early_mask;
+            snprintf(answer, sizeof(answer), "{\"id\":null,\"method\":\"mining.set_version_mask\",\"params\":[\"%08x\"]}\n",
+                     s_pool.session_mask);
+            pool_send(answer);
+            pool_send_difficulty();
+            const PoolJob* job = pool_current_job();
+            if (job)
+                pool_send_notify(*job, true);
+        }
+        snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":[[[\"mining.set_difficulty\",\"%08x\"],[\"mining.notify\",\"%08x\"]],\"%08x\",%d],\"error\":null}\n",
+                 id, s_pool.extranonce1, s_pool.extranonce1, s_pool.extranonce1, POOL_EXTRANONCE2_SIZE);
+        pool_send(answer);
+    } else if (strcmp(method, "mining.authorize") == 0)
+    {
+        snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":true,\"error\":null}\n", id);
+        pool_send(answer);
+        s_pool.authorized = true;
+        pool_send_difficulty();
+        const PoolJob* job = pool_current_job();
+        if (job)
+            pool_send_notify(*job, true);
+        if (s_pool.disconnect_us)
+        {
+            uint64_t elapsed = now - s_pool.disconnect_us;
+            stats.reconnects++;
+            stats.reconnect_us += elapsed;
+            if (elapsed > stats.reconnect_max_us)
+                stats.reconnect_max_us = elapsed;
+            s_pool.recovering_us = s_pool.disconnect_us;
+            s_pool.disconnect_us = 0;
+        }
+    } else if (strcmp(method, "mining.submit") == 0)
+    {
+        stats.submits++;
+        const char* error = pool_check_share(params, json_params(line, params), stats);
+        if (error)
+            snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":null,\"error\":%s}\n", id, error);
+        else
+            snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":true,\"error\":null}\n", id);
+        if (!error && s_pool.recovering_us)
+        {
+            stats.recovered++;
+            stats.recovered_us += now - s_pool.recovering_us;
+            s_pool.recovering_us = 0;
+        }
+        PoolAnswer delayed = { now + s_pool.answer_delay_ms * 1000ull, answer };
+        s_pool.answers.push_back(delayed);
+    } else if (strcmp(method, "mining.suggest_difficulty") == 0)
+    {
+        //Taken note of and ignored, the script sets the difficulty
+        snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":true,\"error\":null}\n", id);
+        pool_send(answer);
+    } else
+    {
+        snprintf(answer, sizeof(answer), "{\"id\":%lu,\"result\":null,\"error\":[20,\"Unknown method\",null]}\n", id);
+        pool_send(answer);
+    }
+    (void)start;
+}
+
+static bool pool_step(const PoolStep& step, uint64_t now, PoolStats& stats)
+{
+    switch (step.action)
+    {
+        case POOL_DIFFICULTY:
+            s_pool.difficulty = step.value;
+            if (s_pool.authorized)
+                pool_send_difficulty();
+            break;
+        case POOL_NOTIFY:
+        case POOL_NOTIFY_CLEAN:
+            pool_new_job(step.action == POOL_NOTIFY_CLEAN);
+            stats.notifies++;
+            break;
+        case POOL_DISCONNECT:
+            stats.disconnects++;
+            pool_close(now);
+            break;
+        case POOL_VERSION_MASK:
+            s_pool.version_mask = step.arg;
+            break;
+        case POOL_EARLY_MASK:
+            s_pool.early_mask = step.arg;
+            break;
+        case POOL_RCVBUF:
+        {
+            //Inherited by the connections accepted from now on
+            int size = step.arg ? (int)step.arg : s_pool.rcvbuf;
+            setsockopt(s_pool.listen_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+            break;
+        }
+        case POOL_READ_PACE:
+            s_pool.read_pace = step.arg;
+            s_pool.read_interval_ms = step.interval;
+            break;
+        case POOL_WRITE_PACE:
+            s_pool.write_pace = step.arg;
+            s_pool.write_interval_ms = step.interval;
+            break;
+        case POOL_ANSWER_DELAY:
+            s_pool.answer_delay_ms = step.arg;
+            break;
+        case POOL_END:
+            return false;
+    }
+    return true;
+}
+
+bool pool_listen(uint16_t& port)
+{
+    struct sockaddr_in addr;
+    socklen_t size = sizeof(addr);
+    int yes = 1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s_pool.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s_pool.listen_fd < 0)
+        return false;
+    setsockopt(s_pool.listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (bind(s_pool.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(s_pool.listen_fd, 4) != 0 ||
+        getsockname(s_pool.listen_fd, (struct sockaddr*)&addr, &size) != 0)
+        return false;
+    port = ntohs(addr.sin_port);
+    //Linux reports twice what was set
+    size = sizeof(s_pool.rcvbuf);
+    getsockopt(s_pool.listen_fd, SOL_SOCKET, SO_RCVBUF, &s_pool.rcvbuf, &size);
+    s_pool.rcvbuf /= 2;
+    return true;
+}
+
+void pool_run(const PoolScript& script, PoolStats& stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    //Same jobs on every run of the script
+    s_pool.rng = 0x504F4F4C;
+    for (const char* p = script.name; *p; ++p)
+        s_pool.rng = s_pool.rng * 31 + *p;
+    s_pool.shares.clear();
+    s_pool.version_mask = 0x1fffe000;
+    s_pool.early_mask = 0;
+    s_pool.read_pace = s_pool.write_pace = s_pool.answer_delay_ms = 0;
+    s_pool.disconnect_us = 0;
+    s_pool.recovering_us = 0;
+
+    uint64_t start = pool_now_us();
+    int next = 0;
+    while (true)
+    {
+        uint64_t now = pool_now_us();
+        bool running = true;
+        while (running && next < script.count && start + script.steps[next].at_ms * 1000ull <= now)
+            running = pool_step(script.steps[next++], now, stats);
+        if (!running || next == script.count)
+            break;
+
+        while (!s_pool.answers.empty() && s_pool.answers.front().due_us <= now)
+        {
+            pool_send(s_pool.answers.front().line);
+            s_pool.answers.pop_front();
+        }
+
+        //Writes and reads as far as the paces allow
+        if (s_pool.fd >= 0 && !s_pool.out.empty() && (!s_pool.write_pace || now >= s_pool.next_write_us))
+        {
+            size_t size = s_pool.write_pace && s_pool.write_pace < s_pool.out.size() ? s_pool.write_pace : s_pool.out.size();
+            ssize_t sent = send(s_pool.fd, s_pool.out.data(), size, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent > 0)
+                s_pool.out.erase(0, sent);
+            s_pool.next_write_us = now + s_pool.write_interval_ms * 1000ull;
+        }
+
+        struct pollfd fds[2] = { { s_pool.listen_fd, POLLIN, 0 }, { s_pool.fd, POLLIN, 0 } };
+        bool may_read = !s_pool.read_pace || now >= s_pool.next_read_us;
+        if (poll(fds, s_pool.fd >= 0 && may_read ? 2 : 1, POOL_POLL_MS) <= 0)
+            continue;
+        if (fds[0].revents & POLLIN)
+        {
+            //One miner at a time, a new connection replaces the old one
+            int fd = accept(s_pool.listen_fd, NULL, NULL);
+            if (fd >= 0)
+            {
+                uint64_t disconnect_us = s_pool.disconnect_us;
+                pool_close(now);
+                s_pool.disconnect_us = disconnect_us;
+                s_pool.fd = fd;
+                s_pool.session_mask = 0;
+                stats.connections++;
+            }
+        }
+        if (s_pool.fd >= 0 && may_read && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            char buffer[POOL_READ_MAX];
+            size_t size = s_pool.read_pace && s_pool.read_pace < sizeof(buffer) ? s_pool.read_pace : sizeof(buffer);
+            ssize_t received = recv(s_pool.fd, buffer, size, MSG_DONTWAIT);
+            if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                //The miner hung up, not a scripted disconnect
+                pool_close(now);
+                s_pool.disconnect_us = 0;
+                continue;
+            }
+            if (received < 0)
+                continue;
+            s_pool.next_read_us = now + s_pool.read_interval_ms * 1000ull;
+            s_pool.in.append(buffer, received);
+            size_t eol;
+            while ((eol = s_pool.in.find('\n')) != std::string::npos)
+            {
+                std::string line = s_pool.in.substr(0, eol);
+                s_pool.in.erase(0, eol + 1);
+                pool_message(line.c_str(), now, start, stats);
+            }
+        }
+    }
+    stats.duration_ms = (pool_now_us() - start) / 1000;
+}
+
+bool pool_script_parse(const char* text, const char* name, PoolScript& script, char* error, size_t error_size)
+{
+    snprintf(script.name, sizeof(script.name), "%s", name);
+    script.count = 0;
+    int line_number = 0;
+    uint32_t last_ms = 0;
+    bool ended = false;
+    while (*text)
+    {
+        char line[256];
+        size_t len = strcspn(text, "\n");
+        snprintf(line, sizeof(line), "%.*s", (int)(len < sizeof(line) ? len : sizeof(line) - 1), text);
+        text += len + (text[len] == '\n');
+        line_number++;
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+
+        char action[32] = "";
+        char arg[32] = "";
+        unsigned at_ms = 0, arg2 = 0;
+        int fields = sscanf(line, "%u %31s %31s %u", &at_ms, action, arg, &arg2);
+        if (fields <= 0)
+            continue;
+        PoolStep step = { at_ms, POOL_END, 0, 0, 0 };
+        bool ok = fields >= 2 && at_ms >= last_ms && !ended;
+        if (!ok)
+            ;
+        else if (strcmp(action, "difficulty") == 0)
+        {
+            step.action = POOL_DIFFICULTY;
+            step.value = atof(arg);
+            ok = step.value > 0;
+        } else if (strcmp(action, "notify") == 0)
+        {
+            step.action = fields >= 3 && strcmp(arg, "clean") == 0 ? POOL_NOTIFY_CLEAN : POOL_NOTIFY;
+            ok = fields == 2 || step.action == POOL_NOTIFY_CLEAN;
+        } else if (strcmp(action, "storm") == 0)
+        {
+            //Expanded here, count clean notifies interval ms apart
+            uint32_t count = strtoul(arg, NULL, 10);
+            ok = fields == 4 && count > 0 && script.count + count <= POOL_STEPS_MAX;
+            for (uint32_t i = 0; ok && i < count; ++i)
+            {
+                PoolStep notify = { at_ms + i * arg2, POOL_NOTIFY_CLEAN, 0, 0, 0 };
+                script.steps[script.count++] = notify;
+            }
+            last_ms = at_ms + (count - 1) * arg2;
+            if (ok)
+                continue;
+        } else if (strcmp(action, "disconnect") == 0)
+            step.action = POOL_DISCONNECT;
+        else if (strcmp(action, "version_mask") == 0 || strcmp(action, "early_mask") == 0)
+        {
+            step.action = action[0] == 'v' ? POOL_VERSION_MASK : POOL_EARLY_MASK;
+            step.arg = strtoul(arg, NULL, 16);
+            ok = fields >= 3;
+        } else if (strcmp(action, "rcvbuf") == 0 || strcmp(action, "answer_delay") == 0)
+        {
+            step.action = action[0] == 'r' ? POOL_RCVBUF : POOL_ANSWER_DELAY;
+            step.arg = strtoul(arg, NULL, 10);
+            ok = fields >= 3;
+        } else if (strcmp(action, "read_pace") == 0 || strcmp(action, "write_pace") == 0)
+        {
+            step.action = action[0] == 'r' ? POOL_READ_PACE : POOL_WRITE_PACE;
+            step.arg = strtoul(arg, NULL, 10);
+            step.interval = arg2;
+            ok = fields >= 3 && (step.arg == 0 || arg2 > 0);
+        } else if (strcmp(action, "end") == 0)
+            ended = true;
+        else
+            ok = false;
+        if (!ok || script.count == POOL_STEPS_MAX)
+        {
+            snprintf(error, error_size, "%s line %d: %s", name, line_number, line);
+            return false;
+        }
+        script.steps[script.count++] = step;
+        last_ms = at_ms;
+    }
+    if (!ended)
+    {
+        snprintf(error, error_size, "%s: no end step", name);
+        return false;
+    }
+    return true;
+}
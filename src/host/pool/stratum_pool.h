@@ -0,0 +1,96 @@
+/************************************************************************************
+*   Stand-in Stratum v1 pool for the host harness
+
+*   Description:
+
+*   Listens on 127.0.0.1 and plays a scripted scenario against whatever
+    connects: mining.configure / subscribe / authorize answers, set_difficulty
+    and notify on a timeline, disconnects, paced reads and writes and slow
+    answers. Every mining.submit is checked from the job it names the way a
+    pool does it, accepted, or rejected as stale, duplicate or invalid.
+
+    A script is one step per line, "<ms from start> <action> [args]":
+        0      difficulty 0.0002
+        0      notify clean
+        3000   storm 40 250        40 clean notifies 250 ms apart
+        5000   notify
+        6000   disconnect
+        0      version_mask 1fffe000   granted to mining.configure, 0 refuses it
+        0      early_mask 1e000000     ahead of the subscribe answer: set_version_mask narrowing
+                                       the grant to these bits, set_difficulty and notify. 0 off
+        0      rcvbuf 1024         receive buffer of the next connections, 0 default
+        0      read_pace 64 100    read 64 bytes every 100 ms, 0 unpaced
+        0      write_pace 100 20   send 100 bytes every 20 ms, 0 unpaced
+        0      answer_delay 300    ms before a submit is answered
+        20000  end
+    '#' starts a comment. Steps must be in time order.
+
+*************************************************************************************/
+#ifndef STRATUM_POOL_H_
+#define STRATUM_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POOL_STEPS_MAX  512
+
+enum PoolAction
+{
+    POOL_DIFFICULTY,
+    POOL_NOTIFY,
+    POOL_NOTIFY_CLEAN,
+    POOL_DISCONNECT,
+    POOL_VERSION_MASK,
+    POOL_EARLY_MASK,
+    POOL_RCVBUF,
+    POOL_READ_PACE,
+    POOL_WRITE_PACE,
+    POOL_ANSWER_DELAY,
+    POOL_END,
+};
+
+struct PoolStep
+{
+    uint32_t at_ms;
+    PoolAction action;
+    double value;       //difficulty
+    uint32_t arg;       //bytes, mask or ms
+    uint32_t interval;  //ms of the paces
+};
+
+struct PoolScript
+{
+    char name[32];
+    PoolStep steps[POOL_STEPS_MAX];
+    int count;
+};
+
+struct PoolStats
+{
+    uint32_t duration_ms;
+    uint32_t connections;
+    uint32_t notifies;
+    uint32_t submits;
+    uint32_t accepted;
+    uint32_t stale;             //job replaced by a clean notify, or unknown
+    uint32_t duplicate;
+    uint32_t invalid;           //wrong header, version bits or below the difficulty
+    double accepted_work;       //sum of the difficulties accepted shares were checked at
+    uint32_t disconnects;       //by the script
+    uint32_t reconnects;        //sessions authorized again after one
+    uint64_t reconnect_us;      //disconnect to authorized, summed
+    uint32_t reconnect_max_us;
+    uint32_t recovered;         //reconnects followed by an accepted share
+    uint64_t recovered_us;      //disconnect to that share, summed
+};
+
+//Text script into steps, false with a message naming the bad line
+bool pool_script_parse(const char* text, const char* name, PoolScript& script, char* error, size_t error_size);
+
+//Binds 127.0.0.1 on a free port
+bool pool_listen(uint16_t& port);
+
+//Plays the script until its end step, the connection is kept for the next one
+void pool_run(const PoolScript& script, PoolStats& stats);
+
+#endif /* STRATUM_POOL_H_ */
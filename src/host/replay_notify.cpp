@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host.h"
+#include "stratum_parse.h"
+#include "job_header.h"
+#include "notify_trace.h"
+#include "ShaTests/nerdSHA256plus.h"
+
+//Notify to first hash path of runStratumWorker + runJobDispatcher on one thread, stamped with
+//the same NotifyTracer the firmware uses under -D NOTIFY_TRACE. Replays notify lines captured
+//from a pool (a serial log works, anything before the first '{' of a line is dropped) or
+//generated ones. The task handoffs (ring, notification, miner wake up) are not modelled here
+#define REPLAY_ITERATIONS_DEFAULT  2000
+#define REPLAY_NOTIFY_MAX          64
+#define REPLAY_RECORDS_SHOWN       4
+
+static char s_replay_lines[REPLAY_NOTIFY_MAX][STRATUM_LINE_MAX];
+static size_t s_replay_sizes[REPLAY_NOTIFY_MAX];
+
+static uint32_t replay_nanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+
+//Keeps the lines that parse as a valid mining.notify
+static int replay_load(const char* path)
+{
+    static char s_text[STRATUM_LINE_MAX];
+    static stratum_message s_msg;
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        printf("replay: cannot open %s\n", path);
+        return -1;
+    }
+    int count = 0;
+    while (count < REPLAY_NOTIFY_MAX && fgets(s_text, sizeof(s_text), file))
+    {
+        const char* json = strchr(s_text, '{');
+        if (!json)
+            continue;
+        size_t size = strcspn(json, "\r\n");
+        memcpy(s_replay_lines[count], json, size);
+        s_replay_lines[count][size] = 0;
+        memcpy(s_text, json, size + 1);
+        if (parse_stratum_line(s_text, size, s_msg) != MINING_NOTIFY || !s_msg.valid)
+            continue;
+        s_replay_sizes[count++] = size;
+    }
+    fclose(file);
+    return count;
+}
+
+int host_notify_replay(int argc, char** argv)
+{
+    static StratumFramer s_framer;
+    static stratum_message s_msg;
+    static mining_job s_job;
+    static NotifyTracer s_tracer;
+    static NotifyHistogram s_histogram;
+    static job_merkle_cache s_merkle_cache;
+    static const uint8_t s_extranonce1[4] = { 0xb4, 0xb6, 0x69, 0x3b };
+    static const uint8_t s_extranonce2[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+    //"replay 500" is the generator with 500 iterations
+    const char* path = NULL;
+    if (argc > 0 && strspn(argv[0], "0123456789") != strlen(argv[0]))
+    {
+        path = argv[0];
+        argc--;
+        argv++;
+    }
+    int notifies;
+    if (path)
+    {
+        notifies = replay_load(path);
+        if (notifies < 0)
+            return 1;
+    } else
+    {
+        for (notifies = 0; notifies < 8; ++notifies)
+            s_replay_sizes[notifies] = host_make_notify(s_replay_lines[notifies], notifies < 4 ? 12 : 16);
+    }
+    if (notifies == 0)
+    {
+        printf("FAIL replay: no mining.notify in %s\n", path);
+        return 1;
+    }
+    uint32_t iterations = argc > 0 ? (uint32_t)atoi(argv[0]) : REPLAY_ITERATIONS_DEFAULT;
+    printf("replay: %d notify lines from %s, %u iterations\n", notifies, path ? path : "generator", iterations);
+
+    uint32_t errors = 0;
+    uint32_t shown = 0;
+    uint32_t allocations = host_allocations();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        uint32_t id = i;
+        const char* text = s_replay_lines[i % notifies];
+        size_t size = s_replay_sizes[i % notifies];
+
+        //One socket read brings the whole line
+        size_t space;
+        char* buffer = s_framer.fill(space);
+        if (space < size + 1)
+        {
+            s_framer.reset();
+            buffer = s_framer.fill(space);
+        }
+        memcpy(buffer, text, size);
+        buffer[size] = '\n';
+        s_framer.filled(size + 1);
+        s_tracer.stage(TRACE_RECEIVED, replay_nanos());
+
+        char* line;
+        size_t len;
+        if (!s_framer.next(line, len))
+        {
+            errors++;
+            continue;
+        }
+        s_tracer.stage(TRACE_FRAMED, replay_nanos());
+        parse_stratum_line(line, len, s_msg);
+        s_tracer.stage(TRACE_PARSED, replay_nanos());
+        if (!stratum_notify_job(s_msg, s_job))
+        {
+            errors++;
+            continue;
+        }
+        s_tracer.stage(TRACE_JOB, replay_nanos());
+
+        //calculateMiningData
+        uint8_t coinbase_hash[32], merkle_root[32];
+        uint8_t sha_buffer[128];
+        job_merkle_begin(s_merkle_cache, s_job, s_extranonce1, sizeof(s_extranonce1));
+        job_coinbase_hash(s_merkle_cache, s_extranonce2, sizeof(s_extranonce2), coinbase_hash);
+        s_tracer.stage(TRACE_COINBASE, replay_nanos());
+        job_merkle_root(s_job, coinbase_hash, merkle_root);
+        s_tracer.stage(TRACE_MERKLE, replay_nanos());
+        job_block_header(s_job, merkle_root, sha_buffer);
+        memset(sha_buffer + 80, 0, 128 - 80);
+        sha_buffer[80] = 0x80;
+        sha_buffer[126] = 0x02;
+        sha_buffer[127] = 0x80;
+        s_tracer.stage(TRACE_HEADER, replay_nanos());
+
+        //Dispatcher, right away
+        s_tracer.post(id, replay_nanos());
+        s_tracer.mark(id, TRACE_DISPATCHED, replay_nanos());
+        uint32_t midstate[8];
+        uint32_t bake[NERD_BAKE_WORDS];
+        nerd_mids(midstate, sha_buffer);
+        s_tracer.mark(id, TRACE_MIDSTATE, replay_nanos());
+        nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+        s_tracer.mark(id, TRACE_BAKED, replay_nanos());
+        s_tracer.mark(id, TRACE_PUBLISHED, replay_nanos());
+
+        //Miner: first claim, stamped once its first nonce is hashed
+        uint8_t hash[32];
+        nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash, nerd_zero_bits_mask(NERD_ZERO_BITS_MIN));
+        s_tracer.first(id, TRACE_FIRST_CLAIM, replay_nanos());
+
+        NotifyTraceRecord record;
+        char report[256];
+        while (s_tracer.collect(record))
+        {
+            if (shown++ < REPLAY_RECORDS_SHOWN)
+            {
+                notify_trace_format(record, report, sizeof(report), "ns");
+                printf("%s\n", report);
+            }
+            s_histogram.add(record);
+        }
+    }
+    allocations = host_allocations() - allocations;
+
+    char report[256];
+    printf("replay: notify to first hash, %u templates\n", s_histogram.count());
+    for (int i = 0; s_histogram.format(i, report, sizeof(report), "ns"); ++i)
+        printf("%s\n", report);
+    if (s_histogram.count() != iterations - errors)
+        errors++;
+    if (allocations)
+        printf("FAIL replay: %u heap allocations\n", allocations);
+    if (errors)
+        printf("FAIL replay: %u notifies lost\n", errors);
+    return errors || allocations ? 1 : 0;
+}
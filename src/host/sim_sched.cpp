@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "host.h"
+#include "nonce_cursor.h"
+
+//Discrete event model of the miner tasks against the stratum loop, simulated time in us.
+//Workers run blocks of 256 nonces, between blocks they check for a new job like mining.cpp does.
+//  legacy: stratum slices fixed chunks into per miner queues on its 50ms loop (before the cursor)
+//  cursor: miners claim adaptive chunks from NonceCursor themselves
+#define SIM_WORKERS_MAX        8
+#define SIM_LOOP_US            50000     //vTaskDelay(50) of the stratum loop
+#define SIM_POLL_US            2000      //vTaskDelay(2) of an idle miner
+#define SIM_STALL_PERCENT      5         //Stratum iterations blocked on the socket...
+#define SIM_STALL_MAX_US       1000000   //...up to the readStringUntil timeout
+#define SIM_NOTIFY_MIN_US      5000000
+#define SIM_NOTIFY_MAX_US      60000000
+
+//Old scheduler constants
+#define SIM_LEGACY_DEPTH       5
+#define SIM_LEGACY_CHUNK_SW    4096
+#define SIM_LEGACY_CHUNK_HW    (16*1024)
+
+static uint64_t s_sim_rng = 0x5343484544ull;
+static uint32_t sim_rng()
+{
+    s_sim_rng ^= s_sim_rng << 13;
+    s_sim_rng ^= s_sim_rng >> 7;
+    s_sim_rng ^= s_sim_rng << 17;
+    return (uint32_t)(s_sim_rng >> 16);
+}
+
+struct SimWorker
+{
+    double rate;            //nonces per us
+    double next;            //time of the next block boundary or poll
+    bool busy;
+    uint8_t job;            //job id of the nonces in work
+    uint32_t left;          //nonces left of the claim
+    uint32_t queue;         //legacy: queued chunks
+    uint32_t chunk;         //legacy: chunk size
+    uint32_t blocks;        //cursor: next claim size
+    double chunk_start;
+    uint32_t chunk_nonces;
+    double idle_since;
+    double idle_us;
+    uint64_t nonces;
+    uint64_t claims;
+};
+
+struct SimReport
+{
+    uint32_t jobs;
+    uint32_t stalls;
+};
+
+static SimReport simulate(bool cursor_mode, SimWorker* workers, int count, double duration_us)
+{
+    SimReport report = { 0, 0 };
+    NonceCursor cursor;
+    uint8_t job = 0;
+    bool published = false;
+    bool notify_pending = true;     //First job comes with the first stratum iteration
+    double next_loop = 0;
+    double next_notify = SIM_NOTIFY_MIN_US + sim_rng() % (SIM_NOTIFY_MAX_US - SIM_NOTIFY_MIN_US);
+
+    for (int w = 0; w < count; ++w)
+    {
+        workers[w].next = 0;
+        workers[w].busy = false;
+        workers[w].left = 0;
+        workers[w].queue = 0;
+        workers[w].blocks = NONCE_CHUNK_BLOCKS_START;
+        workers[w].idle_since = 0;
+        workers[w].idle_us = 0;
+        workers[w].nonces = 0;
+        workers[w].claims = 0;
+    }
+
+    while (true)
+    {
+        //Earliest event: notify arrival, stratum iteration or a worker block boundary
+        double t = next_loop;
+        int who = -1;
+        for (int w = 0; w < count; ++w)
+            if (workers[w].next < t)
+            {
+                t = workers[w].next;
+                who = w;
+            }
+        if (next_notify < t)
+        {
+            notify_pending = true;
+            next_notify += SIM_NOTIFY_MIN_US + sim_rng() % (SIM_NOTIFY_MAX_US - SIM_NOTIFY_MIN_US);
+            continue;
+        }
+        if (t >= duration_us)
+            break;
+
+        if (who < 0)
+        {
+            //Stratum: handles what arrived, then refills (legacy) and sleeps
+            if (notify_pending)
+            {
+                notify_pending = false;
+                job++;
+                report.jobs++;
+                cursor.reset(job);
+                published = true;
+            }
+            //Ring depth counts the chunk in work, stale requests are skipped right away
+            for (int w = 0; w < count; ++w)
+                workers[w].queue = SIM_LEGACY_DEPTH - (workers[w].busy && workers[w].job == job ? 1 : 0);
+            next_loop = t + SIM_LOOP_US;
+            if (sim_rng() % 100 < SIM_STALL_PERCENT)
+            {
+                next_loop += sim_rng() % SIM_STALL_MAX_US;
+                report.stalls++;
+            }
+            continue;
+        }
+
+        SimWorker& wk = workers[who];
+        if (wk.busy)
+        {
+            wk.nonces += NONCE_BLOCK;
+            wk.left -= NONCE_BLOCK;
+            if (wk.job != job)
+                wk.left = 0; //Early abort on the job id check
+        }
+        if (wk.busy && wk.left)
+        {
+            wk.next = t + NONCE_BLOCK / wk.rate;
+            continue;
+        }
+
+        //Chunk done, take the next one
+        if (wk.busy && cursor_mode)
+            wk.blocks = nonce_chunk_blocks(wk.blocks, wk.chunk_nonces - wk.left, (uint32_t)(t - wk.chunk_start));
+        uint32_t claimed = 0;
+        if (published)
+        {
+            if (cursor_mode)
+            {
+                uint32_t first;
+                claimed = cursor.claim(job, NONCE_BLOCKS_MAX, wk.blocks, first) * NONCE_BLOCK;
+            } else if (wk.queue)
+            {
+                wk.queue--;
+                claimed = wk.chunk;
+            }
+        }
+        if (claimed)
+        {
+            if (!wk.busy)
+                wk.idle_us += t - wk.idle_since;
+            wk.busy = true;
+            wk.job = job;
+            wk.left = claimed;
+            wk.chunk_start = t;
+            wk.chunk_nonces = claimed;
+            wk.claims++;
+            wk.next = t + NONCE_BLOCK / wk.rate;
+        } else
+        {
+            if (wk.busy)
+                wk.idle_since = t;
+            wk.busy = false;
+            wk.next = t + SIM_POLL_US;
+        }
+    }
+
+    for (int w = 0; w < count; ++w)
+        if (!workers[w].busy)
+            workers[w].idle_us += duration_us - workers[w].idle_since;
+    return report;
+}
+
+//Threads claiming from one cursor: every block of every job handed out exactly once
+static uint32_t claim_stress()
+{
+    const int threads = 4;
+    const uint32_t limit = 1 << 16;
+    std::vector<uint8_t> owner(limit);
+    NonceCursor cursor;
+    uint32_t errors = 0;
+
+    for (uint8_t job = 1; job <= 8; ++job)
+    {
+        memset(owner.data(), 0, limit);
+        cursor.reset(job);
+        std::thread pool[threads];
+        for (int i = 0; i < threads; ++i)
+            pool[i] = std::thread([&, i]() {
+                uint32_t blocks = 1 + i * 3, first;
+                uint32_t claimed;
+                while ((claimed = cursor.claim(job, limit, blocks, first)) != 0)
+                {
+                    for (uint32_t b = first; b < first + claimed; ++b)
+                        owner[b]++;
+                    if ((first & 0x3F) == 0)
+                        std::this_thread::yield();
+                }
+            });
+        for (int i = 0; i < threads; ++i)
+            pool[i].join();
+        for (uint32_t b = 0; b < limit; ++b)
+            if (owner[b] != 1)
+                errors++;
+        //A stale job id gets nothing
+        uint32_t first;
+        if (cursor.claim(job + 1, limit, 1, first) != 0)
+            errors++;
+    }
+    return errors;
+}
+
+int host_sched_sim(int argc, char** argv)
+{
+    //Defaults: S3 hardware sha and one software miner, kH/s
+    double seconds = 600;
+    double rates[SIM_WORKERS_MAX] = { 300, 50 };
+    int count = 2;
+    if (argc > 0)
+        seconds = atof(argv[0]);
+    if (argc > 1)
+    {
+        count = 0;
+        for (int i = 1; i < argc && count < SIM_WORKERS_MAX; ++i)
+            rates[count++] = atof(argv[i]);
+    }
+
+    SimWorker workers[SIM_WORKERS_MAX];
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        bool cursor_mode = mode == 1;
+        for (int w = 0; w < count; ++w)
+        {
+            workers[w].rate = rates[w] / 1000.0;
+            workers[w].chunk = w == 0 ? SIM_LEGACY_CHUNK_HW : SIM_LEGACY_CHUNK_SW;
+        }
+        s_sim_rng = 0x5343484544ull; //Same notify and stall pattern for both
+        SimReport report = simulate(cursor_mode, workers, count, seconds * 1000000.0);
+        if (mode == 0)
+            printf("sched: %.0fs simulated, %u jobs, %u stratum stalls\n", seconds, report.jobs, report.stalls);
+        for (int w = 0; w < count; ++w)
+        {
+            const SimWorker& wk = workers[w];
+            printf("  %-6s worker %d %7.1f kH/s  idle %6.2f%%  %8llu chunks of %6.0f nonces avg\n",
+                   cursor_mode ? "cursor" : "legacy", w, rates[w],
+                   100.0 * wk.idle_us / (seconds * 1000000.0), (unsigned long long)wk.claims,
+                   wk.claims ? (double)wk.nonces / wk.claims : 0.0);
+        }
+    }
+
+    uint32_t errors = claim_stress();
+    printf("sched: cursor claim stress %u errors\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "host.h"
+#include "vardiff.h"
+
+//ShareVardiff in simulated time, one step per runStratumWorker round: the miners hash at a
+//rate that jumps between phases, shares arrive as a Poisson process at the pool difficulty.
+//One pool takes every mining.suggest_difficulty, the other ignores them all
+#define VARDIFF_TICK_MS         50
+#define VARDIFF_PHASE_S_DEFAULT 3600
+
+static uint64_t s_vardiff_rng = 0x56415244494646ull;
+static double vardiff_uniform()
+{
+    s_vardiff_rng ^= s_vardiff_rng << 13;
+    s_vardiff_rng ^= s_vardiff_rng >> 7;
+    s_vardiff_rng ^= s_vardiff_rng << 17;
+    return ((s_vardiff_rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static uint32_t vardiff_poisson(double lambda)
+{
+    double limit = exp(-lambda), p = vardiff_uniform();
+    uint32_t k = 0;
+    while (p > limit)
+    {
+        p *= vardiff_uniform();
+        k++;
+    }
+    return k;
+}
+
+//One run over the phases, returns errors
+static uint32_t vardiff_run(bool pool_follows, uint32_t phase_s)
+{
+    static const double s_rates[] = { 300e3, 1100e3, 40e3 };   //ESP32, S3 with HW SHA, a slow board
+    ShareVardiff vardiff;
+    double pool_difficulty = 0.00015;
+    uint32_t now = 0;
+    uint64_t nonces = 0;
+    uint32_t errors = 0;
+    vardiff.difficulty(pool_difficulty, now);
+
+    for (size_t phase = 0; phase < sizeof(s_rates) / sizeof(s_rates[0]); ++phase)
+    {
+        double rate = s_rates[phase];
+        uint32_t suggestions = vardiff.suggestions();
+        uint32_t shares = 0;
+        uint32_t settled_ms = 0;
+        for (uint32_t t = 0; t < phase_s * 1000; t += VARDIFF_TICK_MS)
+        {
+            now += VARDIFF_TICK_MS;
+            double hashed = rate * VARDIFF_TICK_MS / 1000.0 * (0.9 + 0.2 * vardiff_uniform());
+            nonces += (uint64_t)hashed;
+            uint32_t found = vardiff_poisson(hashed / (pool_difficulty * 4294967296.0));
+            for (uint32_t s = 0; s < found; ++s)
+                vardiff.share();
+            if (vardiff.tick(nonces, now) && pool_follows)
+            {
+                pool_difficulty = vardiff.suggested();
+                vardiff.difficulty(pool_difficulty, now);
+            }
+            //Cadence over the last two thirds of the phase
+            if (t >= phase_s * 1000 / 3)
+            {
+                if (!settled_ms)
+                    settled_ms = now;
+                shares += found;
+            }
+        }
+
+        char line[256];
+        vardiff.format(line, sizeof(line), now);
+        double interval = shares ? (now - settled_ms) / 1000.0 / shares : 0;
+        double expected = pool_difficulty * 4294967296.0 / rate;
+        suggestions = vardiff.suggestions() - suggestions;
+        printf("vardiff %s %7.0f kH/s: %u suggestions, pool diff %.6g, share every %.1f s (expected %.1f s)\n",
+               pool_follows ? "follows" : "ignores", rate / 1000, suggestions, pool_difficulty, interval, expected);
+        printf("  %s\n", line);
+
+        if (fabs(vardiff.hashrate() - rate) > rate * 0.1)
+        {
+            printf("FAIL vardiff: hashrate %.0f measured for %.0f\n", vardiff.hashrate(), rate);
+            errors++;
+        }
+        //Powers of two within the hysteresis of the target: expected interval 18..50s
+        double wanted = rate * VARDIFF_SHARE_INTERVAL_S / 4294967296.0;
+        if (fabs(log2(vardiff.suggested() / wanted)) > VARDIFF_HYSTERESIS)
+        {
+            printf("FAIL vardiff: suggests %.6g for a target of %.6g\n", vardiff.suggested(), wanted);
+            errors++;
+        }
+        if (pool_follows && (interval < VARDIFF_SHARE_INTERVAL_S / 2.0 || interval > VARDIFF_SHARE_INTERVAL_S * 2.0))
+        {
+            printf("FAIL vardiff: a share every %.1f s\n", interval);
+            errors++;
+        }
+        //A pool that ignores them gets one suggestion per hashrate change, not one per retarget
+        if (suggestions > (pool_follows ? 2u : 1u))
+        {
+            printf("FAIL vardiff: %u suggestions in one phase\n", suggestions);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int host_vardiff_sim(int argc, char** argv)
+{
+    uint32_t phase_s = argc > 0 ? (uint32_t)atoi(argv[0]) : VARDIFF_PHASE_S_DEFAULT;
+    printf("vardiff: target a share every %d s, %u s per hashrate phase\n", VARDIFF_SHARE_INTERVAL_S, phase_s);
+    uint32_t errors = vardiff_run(true, phase_s) + vardiff_run(false, phase_s);
+    if (errors)
+        printf("FAIL vardiff: %u errors\n", errors);
+    return errors ? 1 : 0;
+}
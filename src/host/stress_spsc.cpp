@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "host.h"
+#include "spsc_ring.h"
+
+//Same shape as the mining.cpp rings: stratum pushes requests and drains results,
+//every miner task has its own pair
+#define STRESS_MINERS          2
+#define STRESS_ITEMS_DEFAULT   2000000
+
+struct StressRequest
+{
+    uint32_t id;
+    uint32_t nonce_start;
+    uint8_t payload[256];   //JobRequest sized, detects torn slots
+};
+
+struct StressResult
+{
+    uint32_t id;
+    uint32_t nonce;
+    uint32_t check;
+};
+
+static SpscRing<StressRequest, 16> s_request_ring[STRESS_MINERS];
+static SpscRing<StressResult, 16> s_result_ring[STRESS_MINERS];
+
+static uint32_t payload_check(const uint8_t* payload)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 256; ++i)
+        h = (h ^ payload[i]) * 16777619u;
+    return h;
+}
+
+//Random short stalls on both sides so the rings run full, empty and in between
+static void jitter(uint32_t& state)
+{
+    state = state * 1664525u + 1013904223u;
+    uint32_t r = state >> 24;
+    if (r < 4)
+        std::this_thread::yield();
+    else if (r < 12)
+        for (volatile uint32_t i = 0; i < (r << 4); ++i) {}
+}
+
+static void miner(int miner_id, uint32_t items, uint32_t* errors)
+{
+    uint32_t state = 0x1234 + miner_id;
+    for (uint32_t n = 0; n < items; ++n)
+    {
+        StressRequest* job;
+        while ((job = s_request_ring[miner_id].front()) == NULL)
+            std::this_thread::yield();
+
+        StressResult result;
+        result.id = job->id;
+        result.nonce = job->nonce_start;
+        result.check = payload_check(job->payload);
+        if (job->id != n || job->nonce_start != n * 4096 || job->payload[0] != (uint8_t)n)
+            (*errors)++;
+        s_request_ring[miner_id].pop();
+        jitter(state);
+
+        while (!s_result_ring[miner_id].push(result))
+            std::this_thread::yield();
+    }
+}
+
+int host_spsc_stress(int argc, char** argv)
+{
+    uint32_t items = STRESS_ITEMS_DEFAULT;
+    if (argc > 0)
+        items = strtoul(argv[0], NULL, 0);
+
+    uint32_t miner_errors[STRESS_MINERS] = { 0 };
+    std::thread miners[STRESS_MINERS];
+    for (int m = 0; m < STRESS_MINERS; ++m)
+        miners[m] = std::thread(miner, m, items, &miner_errors[m]);
+
+    //Stratum side: round robin between the miners, like JobsRefill and the result drain
+    uint32_t pushed[STRESS_MINERS] = { 0 }, received[STRESS_MINERS] = { 0 };
+    uint32_t errors = 0, full = 0;
+    uint32_t state = 0x4E455244;
+    uint64_t t0 = host_micros();
+    bool done = false;
+    while (!done)
+    {
+        done = true;
+        for (int m = 0; m < STRESS_MINERS; ++m)
+        {
+            while (pushed[m] < items)
+            {
+                StressRequest* job = s_request_ring[m].prepare();
+                if (!job)
+                {
+                    full++;
+                    break;
+                }
+                job->id = pushed[m];
+                job->nonce_start = pushed[m] * 4096;
+                for (int i = 0; i < 256; ++i)
+                    job->payload[i] = (uint8_t)(pushed[m] + i * 7);
+                s_request_ring[m].commit();
+                pushed[m]++;
+            }
+
+            StressResult res;
+            while (s_result_ring[m].pop(res))
+            {
+                //Results must come back once each, in order, with the payload the miner saw intact
+                uint8_t payload[256];
+                for (int i = 0; i < 256; ++i)
+                    payload[i] = (uint8_t)(received[m] + i * 7);
+                if (res.id != received[m] || res.nonce != received[m] * 4096 || res.check != payload_check(payload))
+                {
+                    if (errors < 8)
+                        printf("FAIL miner %d: result %u, expected %u\n", m, res.id, received[m]);
+                    errors++;
+                }
+                received[m]++;
+            }
+            if (received[m] < items)
+                done = false;
+        }
+        jitter(state);
+    }
+    uint64_t us = host_micros() - t0;
+
+    for (int m = 0; m < STRESS_MINERS; ++m)
+    {
+        miners[m].join();
+        errors += miner_errors[m];
+        if (s_request_ring[m].size() != 0 || s_result_ring[m].size() != 0)
+            errors++;
+    }
+
+    printf("spsc: %d miners x %u jobs in %.2fs, %u times full, %u errors\n",
+           STRESS_MINERS, items, us / 1000000.0, full, errors);
+    return errors ? 1 : 0;
+}
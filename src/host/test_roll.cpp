@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "stratum_parse.h"
+#include "job_header.h"
+#include "mbedtls/sha256.h"
+#include "ShaTests/nerdSHA256plus.h"
+
+//Header rolling end to end, the way runJobDispatcher does it: version rolling (BIP 310) over
+//the mask the pool granted in its mining.configure answer, then the next extranonce2 from the
+//cached coinbase prefix. Every header is mined until a share passes the 16 bit prefilter, the
+//share goes out as a mining.submit line and is checked the way a pool does it, from the notify
+//and the submit alone. The pool side refuses version rolling, grants the BIP 320 bits or only two
+#define ROLL_JOBS_DEFAULT  9
+#define ROLL_STEPS         6
+
+static const struct {
+    const char* answer;     //to mining.configure
+    uint32_t mask;          //granted
+} s_pool_configure[] = {
+    { "{\"id\":1,\"result\":null,\"error\":[20,\"Unknown method\",null]}", 0 },
+    { "{\"id\":1,\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"1fffe000\"},\"error\":null}", 0x1fffe000 },
+    { "{\"id\":1,\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"00006000\"},\"error\":null}", 0x00006000 },
+};
+
+static uint64_t s_roll_rng = 0x524F4C4C21ull;
+static uint32_t roll_rng()
+{
+    s_roll_rng ^= s_roll_rng << 13;
+    s_roll_rng ^= s_roll_rng >> 7;
+    s_roll_rng ^= s_roll_rng << 17;
+    return (uint32_t)(s_roll_rng >> 16);
+}
+
+struct PoolShare
+{
+    char job_id[JOB_ID_SIZE];
+    char extranonce2[2 * EXTRANONCE_SIZE + 1];
+    uint32_t ntime;
+    uint32_t nonce;
+    bool version_rolled;    //6th param present
+    uint32_t version_bits;
+};
+
+static bool pool_read_submit(const char* line, const char* worker, PoolShare& share)
+{
+    char name[80];
+    char ntime[9], nonce[9], version_bits[9];
+    unsigned long id;
+    int count = sscanf(line, "{\"id\":%lu,\"method\":\"mining.submit\",\"params\":[\"%79[^\"]\",\"%63[^\"]\",\"%64[^\"]\",\"%8[^\"]\",\"%8[^\"]\",\"%8[^\"]\"]}",
+                       &id, name, share.job_id, share.extranonce2, ntime, nonce, version_bits);
+    if (count != 6 && count != 7)
+        return false;
+    share.ntime = strtoul(ntime, NULL, 16);
+    share.nonce = strtoul(nonce, NULL, 16);
+    share.version_rolled = count == 7;
+    share.version_bits = share.version_rolled ? strtoul(version_bits, NULL, 16) : 0;
+    return strcmp(name, worker) == 0;
+}
+
+static void pool_sha256d(const uint8_t* data, size_t size, uint8_t hash[32])
+{
+    uint8_t inter[32];
+    mbedtls_sha256_ret(data, size, inter, 0);
+    mbedtls_sha256_ret(inter, 32, hash, 0);
+}
+
+static void put_le32(uint8_t* out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out[i] = value >> (8 * i);
+}
+
+//Header hash as the pool sees it, straight from the notify text and not through the parser:
+//coinbase from the coinb1/coinb2 hex around both extranonces, merkle path folded in, nonce and
+//ntime from the submit, version bits applied as BIP 310 says. The quoted params are
+//job_id prevhash coinb1 coinb2 branches... version nbits ntime
+#define ROLL_PARAMS_MAX  (4 + MAX_MERKLE_BRANCHES + 3)
+
+static uint32_t pool_hex32(const char* hex)
+{
+    return strtoul(hex, NULL, 16);
+}
+
+static bool pool_share_hash(const char* notify, const char* extranonce1, uint32_t version_mask, const PoolShare& share, uint8_t hash[32])
+{
+    static char s_text[STRATUM_LINE_MAX];
+    static uint8_t s_coinbase[COINBASE_SIZE + 2 * EXTRANONCE_SIZE + COINBASE2_SIZE];
+    const char* params[ROLL_PARAMS_MAX];
+    int count = 0;
+    strcpy(s_text, notify);
+    char* p = strstr(s_text, "\"params\":[");
+    if (!p)
+        return false;
+    for (p = strchr(p + 9, '"'); p && count < ROLL_PARAMS_MAX; p = strchr(p + 1, '"'))
+    {
+        params[count++] = ++p;
+        p = strchr(p, '"');
+        if (!p)
+            return false;
+        *p = 0;
+    }
+    if (count < 7 || strcmp(params[0], share.job_id) != 0)
+        return false;
+
+    size_t size = host_from_hex(params[2], s_coinbase, COINBASE_SIZE);
+    size += host_from_hex(extranonce1, s_coinbase + size, EXTRANONCE_SIZE);
+    size += host_from_hex(share.extranonce2, s_coinbase + size, EXTRANONCE_SIZE);
+    size += host_from_hex(params[3], s_coinbase + size, COINBASE2_SIZE);
+
+    uint8_t node[64];
+    pool_sha256d(s_coinbase, size, node);
+    for (int k = 4; k < count - 3; ++k)
+    {
+        host_from_hex(params[k], node + 32, 32);
+        pool_sha256d(node, 64, node);
+    }
+
+    //Stratum sends the previous hash as 32 bit words in the other byte order
+    uint8_t header[80];
+    uint8_t prev_block_hash[32];
+    host_from_hex(params[1], prev_block_hash, 32);
+    uint32_t version = pool_hex32(params[count - 3]);
+    if (share.version_rolled)
+    {
+        if (share.version_bits & ~version_mask)
+            return false;
+        version = (version & ~version_mask) | (share.version_bits & version_mask);
+    }
+    put_le32(header, version);
+    for (int i = 0; i < 32; i += 4)
+        put_le32(header + 4 + i, ((uint32_t)prev_block_hash[i] << 24) | ((uint32_t)prev_block_hash[i + 1] << 16) |
+                                 ((uint32_t)prev_block_hash[i + 2] << 8) | prev_block_hash[i + 3]);
+    memcpy(header + 36, node, 32);
+    put_le32(header + 68, share.ntime);
+    put_le32(header + 72, pool_hex32(params[count - 2]));
+    put_le32(header + 76, share.nonce);
+    pool_sha256d(header, 80, hash);
+    return share.ntime == pool_hex32(params[count - 1]);
+}
+
+struct RollTemplate
+{
+    uint64_t extranonce2;
+    uint32_t version;
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[NERD_BAKE_WORDS];
+};
+
+//JobTemplateRoll: next version over the same second block while there is one, else next extranonce2
+static void roll_next(RollTemplate& work, const job_merkle_cache& cache, size_t extranonce2_size, uint32_t roll_mask)
+{
+    if (roll_mask && job_version_roll(work.version, roll_mask))
+    {
+        job_header_version(work.sha_buffer, work.version);
+        nerd_mids(work.midstate, work.sha_buffer);
+        nerd_sha256_bake_midstate(work.midstate, work.bake);
+        return;
+    }
+    work.extranonce2++;
+    work.version = cache.job->version;
+    job_extranonce2_header(cache, work.extranonce2, extranonce2_size, work.sha_buffer);
+    nerd_mids(work.midstate, work.sha_buffer);
+    nerd_sha256_bake(work.midstate, work.sha_buffer + 64, work.bake);
+}
+
+int host_roll_test(int argc, char** argv)
+{
+    static char s_notify[STRATUM_LINE_MAX];
+    static char s_line[STRATUM_LINE_MAX];
+    static stratum_message s_msg;
+    static mining_job s_job;
+    static const size_t s_extranonce2_sizes[] = { 2, 4, 8 };
+    const char* worker = "bc1qexampleworker.nerd";
+    uint32_t jobs = argc > 0 ? (uint32_t)atoi(argv[0]) : ROLL_JOBS_DEFAULT;
+    uint32_t errors = 0, shares = 0, version_shares = 0;
+
+    for (uint32_t j = 0; j < jobs; ++j)
+    {
+        //mining.configure answer, through the firmware parser
+        const size_t pools = sizeof(s_pool_configure) / sizeof(s_pool_configure[0]);
+        uint32_t version_mask = 0;
+        size_t size = strlen(s_pool_configure[j % pools].answer);
+        memcpy(s_line, s_pool_configure[j % pools].answer, size + 1);
+        parse_stratum_line(s_line, size, s_msg);
+        if (s_msg.id == 1)
+            version_mask = s_msg.version_mask;
+        if (version_mask != s_pool_configure[j % pools].mask)
+        {
+            printf("FAIL job %u: mining.configure answer gave mask %08x\n", j, version_mask);
+            errors++;
+        }
+
+        size = host_make_notify(s_notify, j % 2 ? 16 : 12);
+        memcpy(s_line, s_notify, size + 1);
+        if (parse_stratum_line(s_line, size, s_msg) != MINING_NOTIFY || !stratum_notify_job(s_msg, s_job))
+        {
+            printf("FAIL job %u: notify not parsed\n", j);
+            errors++;
+            continue;
+        }
+        char extranonce1_hex[9];
+        uint8_t extranonce1[4];
+        snprintf(extranonce1_hex, sizeof(extranonce1_hex), "%08x", roll_rng());
+        host_from_hex(extranonce1_hex, extranonce1, sizeof(extranonce1));
+        size_t extranonce2_size = s_extranonce2_sizes[j % 3];
+
+        job_merkle_cache cache;
+        RollTemplate work;
+        uint32_t roll_mask = job_version_roll_mask(s_job, version_mask);
+        job_merkle_begin(cache, s_job, extranonce1, sizeof(extranonce1));
+        memset(work.sha_buffer, 0, sizeof(work.sha_buffer));
+        work.sha_buffer[80] = 0x80;
+        work.sha_buffer[126] = 0x02;
+        work.sha_buffer[127] = 0x80;
+        work.extranonce2 = 0;
+        work.version = 0;
+        for (int step = 0; step < ROLL_STEPS; ++step)
+        {
+            uint8_t last_header[64];
+            memcpy(last_header, work.sha_buffer, 64);
+            roll_next(work, cache, extranonce2_size, step ? roll_mask : 0);
+            if (memcmp(work.sha_buffer, last_header, 64) == 0)
+            {
+                printf("FAIL job %u step %d: header did not change\n", j, step);
+                errors++;
+            }
+
+            //Mine from a random nonce until the prefilter lets one through, like a miner task
+            uint8_t hash[32];
+            uint32_t nonce = roll_rng();
+            for (;; ++nonce)
+            {
+                memcpy(work.sha_buffer + 76, &nonce, 4);
+                if (nerd_sha256d_baked(work.midstate, work.sha_buffer + 64, work.bake, hash, nerd_zero_bits_mask(NERD_ZERO_BITS_MIN)))
+                    break;
+            }
+
+            uint8_t extranonce2_bytes[EXTRANONCE_SIZE];
+            char submit[512];
+            job_extranonce2(work.extranonce2, extranonce2_size, extranonce2_bytes);
+            PoolShare share;
+            uint8_t pool_hash[32];
+            if (!stratum_submit_line(submit, sizeof(submit), 100 + shares, worker, s_job, extranonce2_bytes, extranonce2_size, nonce,
+                                     version_mask, work.version) ||
+                !pool_read_submit(submit, worker, share) || strlen(share.extranonce2) != 2 * extranonce2_size ||
+                share.version_rolled != (version_mask != 0) ||
+                !pool_share_hash(s_notify, extranonce1_hex, version_mask, share, pool_hash))
+            {
+                printf("FAIL job %u step %d: bad submit %s", j, step, submit);
+                errors++;
+                continue;
+            }
+            if (memcmp(pool_hash, hash, 32) != 0 || pool_hash[31] != 0 || pool_hash[30] != 0)
+            {
+                printf("FAIL job %u step %d: pool header does not hash to the share\n", j, step);
+                errors++;
+            }
+            shares++;
+            if (work.version != s_job.version)
+                version_shares++;
+        }
+    }
+
+    printf("roll: %u jobs, %u shares (%u on rolled versions) checked against the pool side header, %u errors\n",
+           jobs, shares, version_shares, errors);
+    return errors ? 1 : 0;
+}
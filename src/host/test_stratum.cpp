@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "stratum_parse.h"
+
+//Feeds a pool session through StratumFramer + parse_stratum_line in random socket sized
+//pieces and counts every heap allocation made while doing it: there must be none
+#define STRATUM_ROUNDS_DEFAULT  2000
+#define STRATUM_READ_MAX        1460    //One TCP segment
+
+//Captured session (public-pool.io style), one message per line as the pool sends them
+static const char s_transcript[] =
+    "{\"id\":1,\"result\":[[[\"mining.set_difficulty\",\"b4b6693b72a50c7116db18d6497cac52\"],[\"mining.notify\",\"ae6812eb4cd7735a302a8a9dd95cf71f\"]],\"08000002\",4],\"error\":null}\n"
+    "{\"id\":2,\"result\":true,\"error\":null}\n"
+    "{\"id\":3,\"result\":true,\"error\":null}\r\n"
+    "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[0.0014]}\n"
+    "{\"params\": [\"bf\", \"4d16b6f85af6e2198f44ae2a6de67f78487ae5611b77c6c0440b921e00000000\", "
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008\", "
+    "\"072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000\", [], "
+    "\"00000002\", \"1c2ac4af\", \"504e86b9\", false], \"id\": null, \"method\": \"mining.notify\"}\n"
+    "\n"
+    "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"65a3f1c0000019e4\","
+    "\"2b1e4c3ae0f11b5dbd7d0ec10d4d5ac1e1c37c6b00025ad60000000000000000\","
+    "\"02000000010000000000000000000000000000000000000000000000000000000000000000ffffffff35035d0d0d0004\","
+    "\"0a7075626c69632d706f6f6cffffffff0200f2052a010000001600148aa8c9bcbe9c53c1b13e2b8b1b70b0ff0c1b2c8b00000000\","
+    "[\"a5d6cd3ef7a2e43e8a0e1fc8b4b3b4c7f33d5f90a1c8fa5fb4b5e05d5d3ccd3c\","
+    "\"0b3e1b26c6f0b55ac8fd1a5b5a3e45e8d2c35c6e27c4bd4f90e2a1e2b9f6b2a1\","
+    "\"f3b4bd1c2a6e7d8e9f0a1b2c3d4e5f60718293a4b5c6d7e8f9a0b1c2d3e4f506\"],"
+    "\"20000000\",\"17034219\",\"6641a3d2\",true]}\n"
+    "{\"id\":4,\"result\":true,\"error\":null}\n"
+    "{\"id\":5,\"result\":null,\"error\":[23,\"Low difficulty share\",null]}\n"
+    "{\"id\":null,\"method\":\"client.show_message\",\"params\":[\"say \\\"hi\\\" {not json]\"]}\n"
+    "{\"id\":6,\"result\":false,\"error\":{\"code\":21,\"message\":\"Job not found\"}}\n"
+    "{\"id\":7,\"result\":tru\n"
+    "{\"id\": 4294967295 , \"method\" : \"mining.set_difficulty\" , \"params\" : [ 65536 ] }\n"
+    "{\"id\":1,\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"1fffe000\"},\"error\":null}\n"
+    "{\"id\":null,\"method\":\"mining.set_version_mask\",\"params\":[\"00fff000\"]}\n";
+
+#define STRATUM_MESSAGES  14
+
+static uint32_t check_message(int index, const stratum_message& msg)
+{
+    static const stratum_method methods[STRATUM_MESSAGES] = {
+        STRATUM_SUCCESS, STRATUM_SUCCESS, STRATUM_SUCCESS, MINING_SET_DIFFICULTY, MINING_NOTIFY, MINING_NOTIFY,
+        STRATUM_SUCCESS, STRATUM_PARSE_ERROR, STRATUM_UNKNOWN, STRATUM_PARSE_ERROR, STRATUM_PARSE_ERROR, MINING_SET_DIFFICULTY,
+        STRATUM_SUCCESS, MINING_SET_VERSION_MASK,
+    };
+    static const unsigned long ids[STRATUM_MESSAGES] = { 1, 2, 3, 0, 0, 0, 4, 5, 0, 6, 0, 4294967295ul, 1, 0 };
+    uint32_t errors = 0;
+#define CHECK(x) do { if (!(x)) { printf("FAIL message %d: %s\n", index, #x); errors++; } } while (0)
+
+    CHECK(msg.method == methods[index]);
+    if (index != 10)
+        CHECK(msg.id == ids[index]);
+    switch (index)
+    {
+        case 0:
+            CHECK(msg.valid && !msg.error);
+            CHECK(msg.subscription && strcmp(msg.subscription, "ae6812eb4cd7735a302a8a9dd95cf71f") == 0);
+            CHECK(msg.extranonce1 && strcmp(msg.extranonce1, "08000002") == 0);
+            CHECK(msg.extranonce2_size == 4);
+            break;
+        case 1:
+            CHECK(msg.result && !msg.error);
+            break;
+        case 3:
+            CHECK(msg.difficulty == 0.0014);
+            break;
+        case 4:
+        {
+            uint8_t prev_block_hash[32];
+            host_from_hex("4d16b6f85af6e2198f44ae2a6de67f78487ae5611b77c6c0440b921e00000000", prev_block_hash, 32);
+            CHECK(msg.valid);
+            CHECK(msg.job_id && strcmp(msg.job_id, "bf") == 0);
+            CHECK(memcmp(msg.prev_block_hash, prev_block_hash, 32) == 0);
+            CHECK(msg.coinb1 && strlen(msg.coinb1) == 116);
+            CHECK(msg.coinb2 && strncmp(msg.coinb2, "072f736c", 8) == 0);
+            CHECK(msg.merkle_branch_count == 0);
+            CHECK(msg.version == 0x00000002);
+            CHECK(msg.nbits == 0x1c2ac4af);
+            CHECK(msg.ntime == 0x504e86b9);
+            CHECK(!msg.clean_jobs);
+            break;
+        }
+        case 5:
+        {
+            uint8_t branch[32];
+            host_from_hex("f3b4bd1c2a6e7d8e9f0a1b2c3d4e5f60718293a4b5c6d7e8f9a0b1c2d3e4f506", branch, 32);
+            CHECK(msg.valid);
+            CHECK(msg.job_id && strcmp(msg.job_id, "65a3f1c0000019e4") == 0);
+            CHECK(msg.merkle_branch_count == 3);
+            CHECK(memcmp(msg.merkle_branch[2], branch, 32) == 0);
+            CHECK(msg.version == 0x20000000 && msg.nbits == 0x17034219 && msg.ntime == 0x6641a3d2);
+            CHECK(msg.clean_jobs);
+            break;
+        }
+        case 7:
+            CHECK(msg.error && msg.error_code == 23);
+            CHECK(msg.error_msg && strcmp(msg.error_msg, "Low difficulty share") == 0);
+            break;
+        case 9:
+            CHECK(msg.error);
+            break;
+        case 11:
+            CHECK(msg.difficulty == 65536);
+            break;
+        case 12:
+            CHECK(msg.version_mask == 0x1fffe000);
+            break;
+        case 13:
+            CHECK(msg.valid && msg.version_mask == 0x00fff000);
+            break;
+    }
+#undef CHECK
+    return errors;
+}
+
+//One session through a fresh framer, reads of 1..max bytes. Returns allocations made
+static uint32_t feed(StratumFramer& framer, uint32_t& rng, size_t read_max, uint32_t& messages, uint32_t& errors)
+{
+    uint32_t allocations = host_allocations();
+    const char* in = s_transcript;
+    size_t left = sizeof(s_transcript) - 1;
+    messages = 0;
+    framer.reset();
+    while (left)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        size_t space;
+        char* buffer = framer.fill(space);
+        size_t size = 1 + (rng >> 8) % read_max;
+        if (size > space)
+            size = space;
+        if (size > left)
+            size = left;
+        memcpy(buffer, in, size);
+        framer.filled(size);
+        in += size;
+        left -= size;
+
+        char* line;
+        size_t len;
+        while (framer.next(line, len))
+        {
+            stratum_message msg;
+            parse_stratum_line(line, len, msg);
+            if (messages < STRATUM_MESSAGES)
+                errors += check_message(messages, msg);
+            messages++;
+        }
+    }
+    return host_allocations() - allocations;
+}
+
+//Lines longer than the buffer are dropped whole, the framer picks up again after them
+static uint32_t oversized_check(StratumFramer& framer)
+{
+    static char s_long[STRATUM_LINE_MAX * 3];
+    uint32_t errors = 0;
+    size_t size = 0;
+    size += sprintf(s_long, "{\"id\":1,\"result\":true,\"error\":null}\n{\"id\":2,\"params\":[\"");
+    memset(s_long + size, 'a', STRATUM_LINE_MAX * 2);
+    size += STRATUM_LINE_MAX * 2;
+    size += sprintf(s_long + size, "\"]}\n{\"id\":3,\"result\":true,\"error\":null}\n");
+
+    framer.reset();
+    uint32_t overflows = framer.overflows();
+    unsigned long expected[] = { 1, 3 };
+    uint32_t messages = 0;
+    for (size_t offset = 0; offset < size;)
+    {
+        size_t space;
+        char* buffer = framer.fill(space);
+        size_t chunk = size - offset < space ? size - offset : space;
+        memcpy(buffer, s_long + offset, chunk);
+        framer.filled(chunk);
+        offset += chunk;
+        char* line;
+        size_t len;
+        while (framer.next(line, len))
+        {
+            stratum_message msg;
+            parse_stratum_line(line, len, msg);
+            if (messages >= 2 || msg.id != expected[messages])
+                errors++;
+            messages++;
+        }
+    }
+    if (messages != 2 || framer.overflows() == overflows)
+        errors++;
+    return errors;
+}
+
+//Bad notify params: the method is still reported so the caller can drop the job, but not valid
+static uint32_t notify_checks()
+{
+    static char s_line[STRATUM_LINE_MAX];
+    static const char* s_bad[] = {
+        "%064x\"],\"2000000\",\"17034219\",\"6641a3d2\",true]}",     //Short version
+        "%064x\"],\"20000000\",\"17034219\",\"6641a3dz\",true]}",    //Not hex
+        "%063x\"],\"20000000\",\"17034219\",\"6641a3d2\",true]}",    //Short branch
+        "%064x\"],\"20000000\",\"17034219\",6641,true]}",              //Number for a hex string
+    };
+    uint32_t errors = 0;
+    stratum_message msg;
+    for (size_t i = 0; i < sizeof(s_bad) / sizeof(s_bad[0]); ++i)
+    {
+        size_t size = sprintf(s_line, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"1\",\"%064x\",\"00\",\"00\",[\"", 7);
+        size += sprintf(s_line + size, s_bad[i], 1);
+        if (parse_stratum_line(s_line, size, msg) != MINING_NOTIFY || msg.valid)
+            errors++;
+    }
+
+    //More branches than MAX_MERKLE_BRANCHES
+    size_t size = sprintf(s_line, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"1\",\"%064x\",\"00\",\"00\",[", 7);
+    for (int i = 0; i <= MAX_MERKLE_BRANCHES; ++i)
+        size += sprintf(s_line + size, "%s\"%064x\"", i ? "," : "", i);
+    size += sprintf(s_line + size, "],\"20000000\",\"17034219\",\"6641a3d2\",true]}");
+    if (parse_stratum_line(s_line, size, msg) != MINING_NOTIFY || msg.valid || msg.merkle_branch_count != -1)
+        errors++;
+
+    //Exactly MAX_MERKLE_BRANCHES is fine
+    size = sprintf(s_line, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"1\",\"%064x\",\"00\",\"00\",[", 7);
+    for (int i = 0; i < MAX_MERKLE_BRANCHES; ++i)
+        size += sprintf(s_line + size, "%s\"%064x\"", i ? "," : "", i);
+    size += sprintf(s_line + size, "],\"20000000\",\"17034219\",\"6641a3d2\",true]}");
+    if (parse_stratum_line(s_line, size, msg) != MINING_NOTIFY || !msg.valid || msg.merkle_branch_count != MAX_MERKLE_BRANCHES ||
+        msg.merkle_branch[MAX_MERKLE_BRANCHES - 1][31] != MAX_MERKLE_BRANCHES - 1 || msg.prev_block_hash[31] != 7)
+        errors++;
+    return errors;
+}
+
+int host_stratum_test(int argc, char** argv)
+{
+    uint32_t rounds = argc > 0 ? (uint32_t)atoi(argv[0]) : STRATUM_ROUNDS_DEFAULT;
+    static StratumFramer s_framer;
+    uint32_t rng = 0x57A7;
+    uint32_t errors = 0, allocations = 0, total = 0;
+
+    uint64_t time_start = host_micros();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        uint32_t messages;
+        //First round in one piece, then byte by byte, then random segments
+        size_t read_max = round == 0 ? sizeof(s_transcript) : round == 1 ? 1 : STRATUM_READ_MAX;
+        allocations += feed(s_framer, rng, read_max, messages, errors);
+        if (messages != STRATUM_MESSAGES)
+        {
+            printf("FAIL round %u: %u messages, expected %d\n", round, messages, STRATUM_MESSAGES);
+            errors++;
+        }
+        total += messages;
+    }
+    uint64_t elapsed = host_micros() - time_start;
+
+    if (oversized_check(s_framer))
+    {
+        printf("FAIL oversized line not dropped cleanly\n");
+        errors++;
+    }
+    if (notify_checks())
+    {
+        printf("FAIL malformed notify params not flagged\n");
+        errors++;
+    }
+    if (allocations)
+    {
+        printf("FAIL %u heap allocations for %u messages\n", allocations, total);
+        errors++;
+    }
+
+    printf("stratum: %u messages in %u rounds, %.2f us/message, %u allocations, %u errors\n",
+           total, rounds, total ? (double)elapsed / total : 0.0, allocations, errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "stratum_parse.h"
+#include "submit_pipeline.h"
+
+//Share submission through SubmitPipeline against a simulated socket and pool, in simulated
+//time: the socket takes a random part of what is offered or nothing at all (send buffer full),
+//the pool answers every complete line after a random round trip, rejects some and never
+//answers a few. A share found while the socket is stuck must not wait for it
+#define SUBMIT_SHARES_DEFAULT  20000
+#define SUBMIT_TICK_US         50000     //One runStratumWorker round
+#define SUBMIT_STALL_TICKS     160       //Socket stuck for 8s now and then, bad WiFi
+
+static uint64_t s_submit_rng = 0x5355424D4954ull;
+static uint32_t submit_rng()
+{
+    s_submit_rng ^= s_submit_rng << 13;
+    s_submit_rng ^= s_submit_rng >> 7;
+    s_submit_rng ^= s_submit_rng << 17;
+    return (uint32_t)(s_submit_rng >> 16);
+}
+
+//Pool side: bytes as received, answers in flight
+struct SimPool
+{
+    char received[SUBMIT_LINE_MAX];
+    size_t size;
+    unsigned long next_id;          //JSON-RPC id the next line must carry
+    struct { unsigned long id; uint32_t due_us; bool accepted; } answers[64];
+    int answers_count;
+    uint32_t lines, torn, unanswered;
+};
+
+static SimPool s_pool;
+
+//Every complete line must be a whole mining.submit with the next id
+static void pool_receive(const char* data, size_t size, uint32_t now, uint32_t& errors)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (s_pool.size == sizeof(s_pool.received))
+        {
+            errors++;
+            s_pool.size = 0;
+        }
+        s_pool.received[s_pool.size++] = data[i];
+        if (data[i] != '\n')
+            continue;
+        unsigned long id;
+        if (sscanf(s_pool.received, "{\"id\":%lu,\"method\":\"mining.submit\"", &id) != 1 || id != s_pool.next_id)
+            s_pool.torn++;
+        s_pool.next_id = id + 1;
+        s_pool.lines++;
+        s_pool.size = 0;
+        //1 in 50 never answered, 1 in 20 rejected, 20..500ms round trip
+        if (submit_rng() % 50 == 0 || s_pool.answers_count == 64)
+        {
+            s_pool.unanswered++;
+            continue;
+        }
+        s_pool.answers[s_pool.answers_count].id = id;
+        s_pool.answers[s_pool.answers_count].accepted = submit_rng() % 20 != 0;
+        s_pool.answers[s_pool.answers_count].due_us = now + 20000 + submit_rng() % 480000;
+        s_pool.answers_count++;
+    }
+}
+
+int host_submit_test(int argc, char** argv)
+{
+    static SubmitPipeline s_pipeline;
+    static mining_job s_job;
+    uint32_t shares = argc > 0 ? (uint32_t)atoi(argv[0]) : SUBMIT_SHARES_DEFAULT;
+    uint32_t errors = 0;
+    uint32_t now = 0;
+    uint32_t stall = 0;
+    uint32_t submitted = 0, answered = 0, accepted = 0;
+    uint32_t writes = 0, would_block = 0;
+    unsigned long id = 100;
+    uint8_t extranonce2[4] = { 0, 0, 0, 1 };
+
+    strcpy(s_job.job_id, "65a3f1c0000019e4");
+    s_job.ntime = 0x6641a3d2;
+    s_pool.next_id = id + 1;
+
+    uint32_t allocations = host_allocations();
+    while (submitted < shares)
+    {
+        now += SUBMIT_TICK_US;
+        if (stall)
+            stall--;
+        else if (submit_rng() % 1000 == 0)
+            stall = SUBMIT_STALL_TICKS;
+
+        //Pool answers that are due, in whatever order they come
+        for (int a = 0; a < s_pool.answers_count;)
+        {
+            if ((int32_t)(now - s_pool.answers[a].due_us) < 0)
+            {
+                a++;
+                continue;
+            }
+            SubmitAnswer answer;
+            if (s_pipeline.answer(s_pool.answers[a].id, s_pool.answers[a].accepted, now, answer))
+            {
+                answered++;
+                accepted += s_pool.answers[a].accepted;
+                if (answer.share.diff != (double)s_pool.answers[a].id)
+                    errors++;
+            }
+            s_pool.answers[a] = s_pool.answers[--s_pool.answers_count];
+        }
+
+        //Result drain: ~3 shares a second, in bursts of up to 4
+        for (uint32_t n = submit_rng() % 16 ? 0 : 1 + submit_rng() % 4; n > 0 && submitted < shares; --n)
+        {
+            size_t space;
+            char* line = s_pipeline.prepare(space, now);
+            submitted++;
+            if (!line)
+                continue;
+            id++;
+            size_t size = stratum_submit_line(line, space, id, "bc1qexampleworker.nerd", s_job, extranonce2, sizeof(extranonce2),
+                                              submit_rng(), 0, 0);
+            if (!size)
+            {
+                errors++;
+                continue;
+            }
+            SubmitShare share = { (double)id, false, false };
+            s_pipeline.commit(id, size, share, now);
+        }
+
+        //Flush: a stuck socket takes nothing, otherwise a random part
+        if (!s_pipeline.flush([&](const char* data, size_t size) {
+                writes++;
+                if (stall)
+                {
+                    would_block++;
+                    return 0;
+                }
+                size_t taken = 1 + submit_rng() % (size + 40);
+                if (taken > size)
+                    taken = size;
+                pool_receive(data, taken, now, errors);
+                return (int)taken;
+            }, now))
+            errors++;
+    }
+    allocations = host_allocations() - allocations;
+
+    const SubmitStats& stats = s_pipeline.stats();
+    char report[256];
+    s_pipeline.format(report, sizeof(report));
+    printf("submit: %u shares, %u socket writes (%u would block)\n", shares, writes, would_block);
+    printf("submit: %s\n", report);
+
+    //Every share is accounted for once, nothing went out torn or out of order
+    if (stats.queued + stats.dropped != submitted)
+    {
+        printf("FAIL submit: %u queued + %u dropped of %u\n", stats.queued, stats.dropped, submitted);
+        errors++;
+    }
+    if (s_pool.torn || s_pool.lines != stats.sent)
+    {
+        printf("FAIL submit: pool got %u lines (%u torn), %u sent\n", s_pool.lines, s_pool.torn, stats.sent);
+        errors++;
+    }
+    if (stats.accepted + stats.rejected != answered || stats.accepted != accepted)
+    {
+        printf("FAIL submit: %u accepted %u rejected, %u answers\n", stats.accepted, stats.rejected, answered);
+        errors++;
+    }
+    if (stats.dropped == 0 || stats.lost < s_pool.unanswered / 2)
+    {
+        printf("FAIL submit: stalls did not fill the window (%u dropped) or unanswered shares not lost (%u)\n",
+               stats.dropped, stats.lost);
+        errors++;
+    }
+    if (allocations)
+        printf("FAIL submit: %u heap allocations\n", allocations);
+    if (errors)
+        printf("FAIL submit: %u errors\n", errors);
+    return errors || allocations ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#include <string.h>
+#include "ShaTests/nerdSHA256plus.h"
+#include "job_header.h"
+
+static const uint32_t s_sha256_iv[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+
+// Streams data through the sha256 state, whole blocks are compressed straight from the input
+static void sha_absorb(uint32_t* state, uint8_t* tail, uint32_t& size, const uint8_t* data, size_t data_size)
+{
+    size_t used = size % 64;
+    size += data_size;
+    if (used)
+    {
+        size_t fill = 64 - used < data_size ? 64 - used : data_size;
+        memcpy(tail + used, data, fill);
+        data += fill;
+        data_size -= fill;
+        if (used + fill < 64)
+            return;
+        nerd_sha256_block(state, tail);
+    }
+    for (; data_size >= 64; data += 64, data_size -= 64)
+        nerd_sha256_block(state, data);
+    memcpy(tail, data, data_size);
+}
+
+void job_merkle_begin(job_merkle_cache& cache, const mining_job& job, const uint8_t* extranonce1, size_t extranonce1_size)
+{
+    cache.job = &job;
+    memcpy(cache.state, s_sha256_iv, sizeof(cache.state));
+    cache.size = 0;
+    sha_absorb(cache.state, cache.tail, cache.size, job.coinb1, job.coinb1_size);
+    sha_absorb(cache.state, cache.tail, cache.size, extranonce1, extranonce1_size);
+}
+
+void job_coinbase_hash(const job_merkle_cache& cache, const uint8_t* extranonce2, size_t extranonce2_size, uint8_t hash[32])
+{
+    const mining_job& job = *cache.job;
+    uint32_t state[8];
+    uint8_t tail[64];
+    uint32_t size = cache.size;
+    memcpy(state, cache.state, sizeof(state));
+    memcpy(tail, cache.tail, size % 64);
+
+    sha_absorb(state, tail, size, extranonce2, extranonce2_size);
+    sha_absorb(state, tail, size, job.coinb2, job.coinb2_size);
+
+    // Padding: 0x80, zeros, bit length big endian in the last 8 bytes
+    uint64_t bits = (uint64_t)size * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t pad = (size % 64 < 56 ? 56 : 120) - size % 64;
+    for (int i = 0; i < 8; ++i)
+        padding[pad + i] = bits >> (56 - 8 * i);
+    sha_absorb(state, tail, size, padding, pad + 8);
+
+    uint8_t inter[32];
+    for (int i = 0; i < 8; ++i)
+    {
+        inter[4 * i] = state[i] >> 24;
+        inter[4 * i + 1] = state[i] >> 16;
+        inter[4 * i + 2] = state[i] >> 8;
+        inter[4 * i + 3] = state[i];
+    }
+    nerd_sha256_32(inter, hash);
+}
+
+void job_merkle_root(const mining_job& job, const uint8_t coinbase_hash[32], uint8_t root[32])
+{
+    uint8_t concatenated[64];
+
+    memcpy(concatenated, coinbase_hash, 32);
+    for (int k = 0; k < job.merkle_branch_count; k++)
+    {
+        memcpy(concatenated + 32, job.merkle_branch[k], 32);
+        nerd_sha256d_64(concatenated, concatenated);
+    }
+    memcpy(root, concatenated, 32);
+}
+
+void job_block_header(const mining_job& job, const uint8_t merkle_root[32], uint8_t header[80])
+{
+    for (size_t j = 0; j < 4; j++)
+    {
+        header[j] = job.version >> (8 * j);
+        header[68 + j] = job.ntime >> (8 * j);
+        header[72 + j] = job.nbits >> (8 * j);
+        header[76 + j] = 0;
+    }
+    for (size_t i = 0; i < 32; i += 4)
+    {
+        for (size_t j = 0; j < 4; j++)
+            header[4 + i + j] = job.prev_block_hash[i + 3 - j];
+    }
+    memcpy(header + 36, merkle_root, 32);
+}
+
+void job_extranonce2(uint64_t value, size_t extranonce2_size, uint8_t* out)
+{
+    for (size_t i = extranonce2_size; i-- > 0; value >>= 8)
+        out[i] = value;
+}
+
+void job_extranonce2_header(const job_merkle_cache& cache, uint64_t extranonce2, size_t extranonce2_size, uint8_t header[80])
+{
+    uint8_t extranonce[EXTRANONCE_SIZE];
+    uint8_t hash[32];
+    job_extranonce2(extranonce2, extranonce2_size, extranonce);
+    job_coinbase_hash(cache, extranonce, extranonce2_size, hash);
+    job_merkle_root(*cache.job, hash, hash);
+    job_block_header(*cache.job, hash, header);
+}
+
+void job_header_version(uint8_t header[80], uint32_t version)
+{
+    for (size_t j = 0; j < 4; j++)
+        header[j] = version >> (8 * j);
+}
@@ -0,0 +1,57 @@
+#ifndef JOB_HEADER_H
+#define JOB_HEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stratum_parse.h"
+
+// Block header assembly from a binary mining_job. Portable, also built by [env:native]
+
+// Coinbase sha256 state after coinb1 + extranonce1, which stay the same while extranonce2 changes.
+// The merkle branches are the job's own, decoded once with it
+struct job_merkle_cache
+{
+    const mining_job* job;
+    uint32_t state[8];      // whole blocks hashed so far
+    uint8_t tail[64];       // bytes of the block being filled
+    uint32_t size;          // bytes absorbed, tail included
+};
+
+// Once per job (and extranonce1)
+void job_merkle_begin(job_merkle_cache& cache, const mining_job& job, const uint8_t* extranonce1, size_t extranonce1_size);
+
+// Double sha256 of coinb1 + extranonce1 + extranonce2 + coinb2, only the blocks from extranonce2 on are hashed
+void job_coinbase_hash(const job_merkle_cache& cache, const uint8_t* extranonce2, size_t extranonce2_size, uint8_t hash[32]);
+
+// Folds the merkle branches into the coinbase hash
+void job_merkle_root(const mining_job& job, const uint8_t coinbase_hash[32], uint8_t root[32]);
+
+// 80 byte header as hashed: version, ntime and nbits little endian, prev hash with
+// every 4-byte word swapped, nonce 0
+void job_block_header(const mining_job& job, const uint8_t merkle_root[32], uint8_t header[80]);
+
+// extranonce2 as the pool gets it: a counter, big endian over extranonce2_size bytes
+void job_extranonce2(uint64_t value, size_t extranonce2_size, uint8_t* out);
+
+// Coinbase, merkle root and header of the cached job for one more extranonce2
+void job_extranonce2_header(const job_merkle_cache& cache, uint64_t extranonce2, size_t extranonce2_size, uint8_t header[80]);
+
+// Version rolling (BIP 310): the bits rolled are those the pool granted that are clear in the
+// job version, so a pool that ors or xors the submitted bits into it gets the same header
+static inline uint32_t job_version_roll_mask(const mining_job& job, uint32_t version_mask)
+{
+    return version_mask & ~job.version;
+}
+
+// Next version over the roll mask bits, false once all of them were used
+static inline bool job_version_roll(uint32_t& version, uint32_t roll_mask)
+{
+    uint32_t bits = (((version & roll_mask) | ~roll_mask) + 1) & roll_mask;
+    version = (version & ~roll_mask) | bits;
+    return bits != 0;
+}
+
+// Version field of a header built by job_block_header, the rest of the header is left as it is
+void job_header_version(uint8_t header[80], uint32_t version);
+
+#endif // JOB_HEADER_H
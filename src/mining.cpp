@@ -1,5 +1,4 @@
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include <WiFi.h>
 #include <esp_task_wdt.h>
 #include <nvs_flash.h>
@@ -13,15 +12,21 @@
 #include "timeconst.h"
 #include "drivers/displays/display.h"
 #include "drivers/storage/storage.h"
-#include <mutex>
-#include <list>
-#include <map>
+#include <soc/soc_caps.h>
 #include "mbedtls/sha256.h"
 #include "i2c_master.h"
-
-//10 Jobs per second
-#define NONCE_PER_JOB_SW 4096
-#define NONCE_PER_JOB_HW 16*1024
+#include "spsc_ring.h"
+#include "nonce_cursor.h"
+#include "notify_trace.h"
+#include "job_header.h"
+#include "vardiff.h"
+
+//Miner task ids as created in setup(): MinerHw-0 + MinerSw-1 with HW sha, MinerSw-0 + MinerSw-1 without
+#if (SOC_CPU_CORES_NUM >= 2)
+#define MINER_TASKS 2
+#else
+#define MINER_TASKS 1
+#endif
 
 //#define I2C_SLAVE
 
@@ -38,6 +43,12 @@
 #include <sha/sha_parallel_engine.h>
 #endif
 
+#ifdef HW_SHA_DMA
+#include <esp_private/gdma.h>
+#include <soc/lldesc.h>
+#include <esp_heap_caps.h>
+#endif
+
 #endif
 
 nvs_handle_t stat_handle;
@@ -68,6 +79,14 @@ mining_subscribe mWorker;
 mining_job mJob;
 monitor_data mMonitor;
 static bool volatile isMinerSuscribed = false;
+static StratumFramer s_stratum_framer;  //Pool messages are received and parsed in place here
+static SubmitPipeline s_submit_pipeline; //Shares queued for the socket and waiting for their answer
+static ShareVardiff s_vardiff;          //Difficulty suggested to the pool from the measured hashrate
+static uint64_t s_i2c_nonces = 0;       //Hashed by I2C slaves, not in the miner counters
+#ifdef NOTIFY_TRACE
+NotifyTracer g_notify_tracer;
+static NotifyHistogram s_notify_histogram;
+#endif
 unsigned long mLastTXtoPool = millis();
 
 int saveIntervals[7] = {5 * 60, 15 * 60, 30 * 60, 1 * 3600, 3 * 3600, 6 * 3600, 12 * 3600};
@@ -87,14 +106,14 @@ bool checkPoolConnection(void) {
   //Resolve first time pool DNS and save IP
   if(serverIP == IPAddress(1,1,1,1)) {
     WiFi.hostByName(Settings.PoolAddress.c_str(), serverIP);
-    Serial.printf("Resolved DNS and save ip (first time) got: %s\n", serverIP.toString());
+    Serial.printf("Resolved DNS and save ip (first time) got: %s\n", serverIP.toString().c_str());
   }
 
   //Try connecting pool IP
   if (!client.connect(serverIP, Settings.PoolPort)) {
     Serial.println("Imposible to connect to : " + Settings.PoolAddress);
     WiFi.hostByName(Settings.PoolAddress.c_str(), serverIP);
-    Serial.printf("Resolved DNS got: %s\n", serverIP.toString());
+    Serial.printf("Resolved DNS got: %s\n", serverIP.toString().c_str());
     return false;
   }
 
@@ -119,9 +138,11 @@ bool checkPoolInactivity(unsigned int keepAliveTime, unsigned long inactivityTim
     if ( time_now > mLastTXtoPool + keepAliveTime)
     {
       mLastTXtoPool = time_now;
+      if (s_submit_pipeline.writing())
+        return false; //Not in the middle of a submit line
       Serial.println("  Sending  : KeepAlive suggest_difficulty");
       //if (client.print("{}\n") == 0) {
-      tx_suggest_difficulty(client, DEFAULT_DIFFICULTY);
+      tx_suggest_difficulty(client, s_vardiff.suggested());
       /*if(tx_suggest_difficulty(client, DEFAULT_DIFFICULTY)){
         Serial.println("  Sending keepAlive to pool -> Detected client disconnected");
         return true;
@@ -139,68 +160,359 @@ bool checkPoolInactivity(unsigned int keepAliveTime, unsigned long inactivityTim
   return false;
 }
 
-struct JobRequest
+//Work of one mining.notify at one pool difficulty.
+//Filled once by stratum, read only for the miners while it is current or in work
+struct JobTemplate
 {
   uint32_t id;
-  uint32_t nonce_start;
-  uint32_t nonce_count;
+  uint32_t epoch;        //s_job_epoch while this job is the current one
+  uint8_t cursor_id;     //s_nonce_cursor job id of its nonce range
+  uint64_t extranonce2;
+  uint32_t version;      //Header version, rolled within the pool's mask
   double difficulty;
+  uint32_t zero_mask; //nerd_zero_bits_mask for the difficulty
   uint8_t sha_buffer[128];
   uint32_t midstate[8];
-  uint32_t bake[16];
+  uint32_t bake[NERD_BAKE_WORDS];
+  #ifdef HARDWARE_SHA265
+  #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
+  uint32_t hw_midstate[8];
+  #endif
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  uint8_t hw_sha_buffer[128]; //sha_buffer with swapped words
+  #endif
+  #endif
+  uint32_t nonce_start;  //Nonce of cursor block 0
+  uint32_t nonce_blocks; //Blocks of NONCE_BLOCK nonces the miners may claim
 };
 
 struct JobResult
 {
   uint32_t id;
+  uint64_t extranonce2;
+  uint32_t version;
   uint32_t nonce;
   uint32_t nonce_count;
   double difficulty;
   uint8_t hash[32];
+  uint32_t candidates; //nonces passing the early reject filter, the other nonce_count - candidates were rejected
 };
 
-static std::mutex s_job_mutex;
-std::list<std::shared_ptr<JobRequest>> s_job_request_list_sw;
-#ifdef HARDWARE_SHA265
-std::list<std::shared_ptr<JobRequest>> s_job_request_list_hw;
+//One result ring per miner task, stratum consumes them.
+//Miners claim their nonce ranges from s_nonce_cursor, stratum only publishes the template
+#ifdef I2C_SLAVE
+#define RESULT_RINGS (MINER_TASKS+1) //Last one for i2c slave results found by stratum
+#else
+#define RESULT_RINGS MINER_TASKS
 #endif
-std::list<std::shared_ptr<JobResult>> s_job_result_list;
-static volatile uint8_t s_working_current_job_id = 0xFF;
+static SpscRing<JobResult, 16> s_job_result_ring[RESULT_RINGS];
+static NonceCursor s_nonce_cursor;
 
-static void JobPush(std::list<std::shared_ptr<JobRequest>> &job_list,  uint32_t id, uint32_t nonce_start, uint32_t nonce_count, double difficulty,
-                    const uint8_t* sha_buffer, const uint32_t* midstate, const uint32_t* bake)
+//Moved by the dispatcher on every new job and on stop. Miners compare it with the epoch
+//of their template every JOB_EPOCH_STRIDE nonces and leave the range once it moved
+#ifndef JOB_EPOCH_STRIDE
+#define JOB_EPOCH_STRIDE 256  //Power of 2, up to NONCE_BLOCK
+#endif
+static std::atomic<uint32_t> s_job_epoch(0);
+static std::atomic<uint32_t> s_job_epoch_us(0); //micros() when the work in progress went stale
+
+//Current template plus one in work per miner, one spare to fill.
+//A miner announces the template it works on in s_job_in_use before it reads it
+#define JOB_TEMPLATES (MINER_TASKS+2)
+static JobTemplate s_job_templates[JOB_TEMPLATES];
+static uint32_t s_job_template_next = 0;
+static std::atomic<const JobTemplate*> s_job_current(NULL);
+static std::atomic<const JobTemplate*> s_job_in_use[MINER_TASKS];
+
+static bool JobTemplateFree(const JobTemplate* work)
 {
-  std::shared_ptr<JobRequest> job = std::make_shared<JobRequest>();
-  job->id = id;
-  job->nonce_start = nonce_start;
-  job->nonce_count = nonce_count;
-  job->difficulty = difficulty;
-  memcpy(job->sha_buffer, sha_buffer, sizeof(job->sha_buffer));
-  memcpy(job->midstate, midstate, sizeof(job->midstate));
-  memcpy(job->bake, bake, sizeof(job->bake));
-  job_list.push_back(job);
+  if (work == s_job_current.load())
+    return false;
+  for (int miner_id = 0; miner_id < MINER_TASKS; ++miner_id)
+    if (s_job_in_use[miner_id].load() == work)
+      return false;
+  return true;
 }
 
-struct Submition
+static JobTemplate* JobTemplateAlloc(const JobTemplate* current)
 {
-  double diff;
-  bool is32bit;
-  bool isValid;
+  while (1)
+  {
+    for (int i = 0; i < JOB_TEMPLATES; ++i)
+    {
+      JobTemplate* work = &s_job_templates[(s_job_template_next + i) % JOB_TEMPLATES];
+      if (work != current && JobTemplateFree(work))
+      {
+        s_job_template_next = (work - s_job_templates + 1) % JOB_TEMPLATES;
+        return work;
+      }
+    }
+    vTaskDelay(1); //Not reached, every miner holds one template at most
+  }
+}
+
+//Queued templates are read only, a new pool difficulty gets its own copy
+static JobTemplate* JobTemplateRetarget(JobTemplate* work, double difficulty)
+{
+  JobTemplate* next = JobTemplateAlloc(work);
+  *next = *work;
+  next->difficulty = difficulty;
+  next->zero_mask = nerd_zero_bits_mask(nerd_zero_bits_from_diff(difficulty));
+  return next;
+}
+
+enum JobPublishKind
+{
+  JOB_PUBLISH_NEW,      //New job: ranges in work are stale
+  JOB_PUBLISH_ROLL,     //Same job, next version or extranonce2: ranges in work stay valid
+  JOB_PUBLISH_RETARGET, //Same job and header, new difficulty
 };
 
-static void MiningJobStop(uint32_t &job_pool, std::map<uint32_t, std::shared_ptr<Submition>> & submition_map)
+//Miners move to work with their next claim. A new job restarts the nonce range and moves
+//the epoch first, a rolled header only restarts the range, a retargeted template of
+//the same job goes on from where the cursor is
+static void JobPublish(const JobTemplate* work, JobPublishKind kind)
 {
+  if (kind != JOB_PUBLISH_RETARGET)
+    s_nonce_cursor.reset(work->cursor_id);
+  if (kind == JOB_PUBLISH_NEW)
   {
-    std::lock_guard<std::mutex> lock(s_job_mutex);
-    s_job_result_list.clear();
-    s_job_request_list_sw.clear();
-    #ifdef HARDWARE_SHA265
-    s_job_request_list_hw.clear();
-    #endif
+    if (s_job_current.load() != NULL)
+      s_job_epoch_us.store(micros());
+    s_job_epoch.store(work->epoch);
+  }
+  s_job_current.store(work);
+}
+
+//Nothing to claim until the next JobPublish, ranges in work are left at the next epoch check
+static void JobRetire(uint32_t epoch)
+{
+  s_job_current.store(NULL);
+  s_job_epoch_us.store(micros());
+  s_job_epoch.store(epoch);
+}
+
+//Stratum only parses, templates are built and published by the dispatcher task.
+//Requests are handled in order, so a stop can't be overtaken by the job before it
+enum DispatchKind
+{
+  DISPATCH_NEW_JOB,
+  DISPATCH_DIFFICULTY,
+  DISPATCH_STOP,
+};
+
+struct DispatchRequest
+{
+  uint8_t kind;
+  uint32_t id;
+  double difficulty;
+  uint32_t nonce_start;
+  uint32_t nonce_blocks;
+  uint8_t sha_buffer[128];
+  //Kept by the dispatcher to roll extranonce2 when the nonce range runs out
+  mining_job job;
+  uint8_t extranonce1[EXTRANONCE_SIZE];
+  uint8_t extranonce1_size;
+  uint8_t extranonce2_size;
+  uint64_t extranonce2;
+  uint32_t version_mask;  //Version rolling granted by the pool, 0 when not
+};
+
+//Dispatcher task notification bits
+#define DISPATCH_EVENT_REQUEST   (1 << 0)  //s_dispatch_ring has requests
+#define DISPATCH_EVENT_LOW_WATER (1 << 1)  //Current template has less than DISPATCH_LOW_WATER_BLOCKS left to claim
+
+//~45s of work for a S3 at full speed
+#define DISPATCH_LOW_WATER_BLOCKS (1 << 16)
+
+//extranonce2 of the first template of a job, the dispatcher counts up from there
+#define EXTRANONCE2_START 1
+
+static SpscRing<DispatchRequest, 4> s_dispatch_ring;
+static TaskHandle_t volatile s_dispatcher_task = NULL;
+
+static void DispatchSignal(uint32_t event)
+{
+  if (s_dispatcher_task)
+    xTaskNotify(s_dispatcher_task, event, eSetBits);
+}
+
+static DispatchRequest* DispatchPrepare()
+{
+  DispatchRequest* request;
+  while ((request = s_dispatch_ring.prepare()) == NULL)
+    vTaskDelay(1); //Dispatcher is still building the previous template
+  return request;
+}
+
+static void DispatchCommit()
+{
+  s_dispatch_ring.commit();
+  DispatchSignal(DISPATCH_EVENT_REQUEST);
+}
+
+//Range of about blocks blocks of the current template for miner_id.
+//NULL when there is no job or its range is used up
+static const JobTemplate* JobClaim(int miner_id, uint32_t blocks, uint32_t &nonce_start, uint32_t &nonce_count)
+{
+  while (1)
+  {
+    const JobTemplate* work = s_job_current.load();
+    s_job_in_use[miner_id].store(work);
+    if (work != s_job_current.load())
+      continue; //Replaced meanwhile, the slot may be refilled already
+    if (!work)
+      return NULL;
+    uint32_t first_block;
+    uint32_t claimed = s_nonce_cursor.claim(work->cursor_id, work->nonce_blocks, blocks, first_block);
+    if (claimed)
+    {
+      if (first_block + claimed + DISPATCH_LOW_WATER_BLOCKS >= work->nonce_blocks)
+        DispatchSignal(DISPATCH_EVENT_LOW_WATER);
+      nonce_start = work->nonce_start + first_block * NONCE_BLOCK;
+      nonce_count = claimed * NONCE_BLOCK;
+      NOTIFY_TRACE_FIRST(work->id);
+      return work;
+    }
+    if (work == s_job_current.load() && s_nonce_cursor.job_id() == work->cursor_id)
+      return NULL; //Used up
+    //Otherwise the cursor is already reset for the template being published
+  }
+}
+
+//Seqlock per miner task: the miner is the only writer, readers retry on a torn copy
+struct MinerStats
+{
+  std::atomic<uint32_t> seq;
+  miner_counters counters;
+};
+static MinerStats s_miner_stats[MINER_TASKS];
+
+static miner_counters* MinerStatsBegin(int miner_id)
+{
+  MinerStats& stats = s_miner_stats[miner_id];
+  stats.seq.store(stats.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return &stats.counters;
+}
+
+static void MinerStatsEnd(int miner_id)
+{
+  MinerStats& stats = s_miner_stats[miner_id];
+  stats.seq.store(stats.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//Accounts a range started at time_start, returns its duration.
+//Work done after the epoch moved is stale, its nonces are estimated at the range's rate
+static uint32_t MinerStatsRange(int miner_id, const JobTemplate* work, const JobResult* result, uint32_t nonce_count, uint32_t time_start)
+{
+  uint32_t time_end = micros();
+  uint32_t elapsed = time_end - time_start;
+  uint32_t stale_us = 0;
+  uint32_t stale_nonces = 0;
+  if (s_job_epoch.load() != work->epoch)
+  {
+    stale_us = time_end - s_job_epoch_us.load();
+    if (stale_us > elapsed)
+      stale_us = elapsed;
+    if (elapsed)
+      stale_nonces = (uint64_t)result->nonce_count * stale_us / elapsed;
   }
-  s_working_current_job_id = 0xFF;
+
+  miner_counters* counters = MinerStatsBegin(miner_id);
+  counters->nonces += result->nonce_count;
+  counters->candidates += result->candidates;
+  counters->busy_us += elapsed;
+  counters->stale_nonces += stale_nonces;
+  counters->stale_us += stale_us;
+  if (result->nonce_count < nonce_count)
+    counters->jobs_aborted++;
+  else
+    counters->jobs_completed++;
+  MinerStatsEnd(miner_id);
+  return elapsed;
+}
+
+static void MinerStatsIdle(int miner_id, uint32_t idle_us)
+{
+  miner_counters* counters = MinerStatsBegin(miner_id);
+  counters->idle_us += idle_us;
+  MinerStatsEnd(miner_id);
+}
+
+int getMinerCounters(miner_counters* counters, int max_miners)
+{
+  int miners = max_miners < MINER_TASKS ? max_miners : MINER_TASKS;
+  for (int miner_id = 0; miner_id < miners; ++miner_id)
+  {
+    MinerStats& stats = s_miner_stats[miner_id];
+    uint32_t seq;
+    do
+    {
+      seq = stats.seq.load(std::memory_order_acquire);
+      memcpy(&counters[miner_id], &stats.counters, sizeof(miner_counters));
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != stats.seq.load(std::memory_order_relaxed));
+  }
+  return miners;
+}
+
+static void MiningJobStop(uint32_t &job_pool)
+{
+  if (job_pool != 0xFFFFFFFF)
+  {
+    DispatchRequest* request = DispatchPrepare();
+    request->kind = DISPATCH_STOP;
+    DispatchCommit();
+  }
+  for (int i = 0; i < RESULT_RINGS; ++i)
+    while (s_job_result_ring[i].front())
+      s_job_result_ring[i].pop();
   job_pool = 0xFFFFFFFF;
-  submition_map.clear();
+  s_submit_pipeline.reset();
+}
+
+//The pool answered a share
+static void SubmitAnswered(unsigned long submit_id, bool accepted)
+{
+  SubmitAnswer answer;
+  if (!s_submit_pipeline.answer(submit_id, accepted, micros(), answer))
+    return;
+  if (accepted)
+  {
+    if (answer.share.diff > best_diff)
+      best_diff = answer.share.diff;
+    if (answer.share.is32bit)
+      shares++;
+    mMonitor.NerdStatus = NM_accepted;
+    if (answer.share.isValid)
+    {
+      Serial.println("CONGRATULATIONS! Valid block found");
+      valids++;
+    }
+  } else
+    Serial.printf("Refuse submition %lu\n", submit_id);
+  #ifdef DEBUG_MINING
+  Serial.printf("[SUBMIT] %lu %s, queued %u us, round trip %u us\n", submit_id, accepted ? "accepted" : "rejected", answer.queue_us, answer.rtt_us);
+  #endif
+  if (s_submit_pipeline.answers() >= SUBMIT_REPORT)
+  {
+    char line[256];
+    s_submit_pipeline.format(line, sizeof(line));
+    Serial.printf("[SUBMIT] %s\n", line);
+    s_submit_pipeline.report_done();
+  }
+}
+
+//Nonces hashed since boot by everything that mines for this pool session
+static uint64_t VardiffNonces()
+{
+  miner_counters counters[MINER_TASKS];
+  uint64_t nonces = s_i2c_nonces;
+  int miners = getMinerCounters(counters, MINER_TASKS);
+  for (int i = 0; i < miners; ++i)
+    nonces += counters[i].nonces;
+  return nonces;
 }
 
 #ifdef RANDOM_NONCE
@@ -216,6 +528,27 @@ static uint32_t RandomGet()
 
 #endif
 
+#ifdef NOTIFY_TRACE
+//Templates that reached a miner, one line each and the stage histograms every NOTIFY_TRACE_REPORT
+static void NotifyTraceReport()
+{
+  NotifyTraceRecord record;
+  char line[256];
+  while (g_notify_tracer.collect(record))
+  {
+    notify_trace_format(record, line, sizeof(line), "us");
+    Serial.printf("[TRACE] %s\n", line);
+    s_notify_histogram.add(record);
+    if (s_notify_histogram.count() < NOTIFY_TRACE_REPORT)
+      continue;
+    Serial.printf("[TRACE] Notify to first claim, %u templates\n", s_notify_histogram.count());
+    for (int i = 0; s_notify_histogram.format(i, line, sizeof(line), "us"); ++i)
+      Serial.printf("[TRACE] %s\n", line);
+    s_notify_histogram.reset();
+  }
+}
+#endif
+
 void runStratumWorker(void *name) {
 
 // TEST: https://bitcoin.stackexchange.com/questions/22929/full-example-data-for-scrypt-stratum-client
@@ -227,8 +560,6 @@ void runStratumWorker(void *name) {
   Serial.printf("### [Total Heap / Free heap / Min free heap]: %d / %d / %d \n", ESP.getHeapSize(), ESP.getFreeHeap(), ESP.getMinFreeHeap());
   #endif
 
-  std::map<uint32_t, std::shared_ptr<Submition>> s_submition_map;
-
 #ifdef I2C_SLAVE
   std::vector<uint8_t> i2c_slave_vector;
 
@@ -247,16 +578,21 @@ void runStratumWorker(void *name) {
 
   // connect to pool  
   double currentPoolDifficulty = DEFAULT_DIFFICULTY;
-  uint32_t nonce_pool = 0;
   uint32_t job_pool = 0xFFFFFFFF;
   uint32_t last_job_time = millis();
+  uint32_t filter_nonces = 0;     //Early reject filter effectiveness on current job
+  uint32_t filter_candidates = 0;
+#ifdef I2C_SLAVE
+  uint32_t i2c_midstate[8];       //Slave nonces are checked again before submitting
+  uint32_t i2c_bake[NERD_BAKE_WORDS];
+#endif
 
   while(true) {
       
     if(WiFi.status() != WL_CONNECTED){
       // WiFi is disconnected, so reconnect now
       mMonitor.NerdStatus = NM_Connecting;
-      MiningJobStop(job_pool, s_submition_map);
+      MiningJobStop(job_pool);
       WiFi.reconnect();
       vTaskDelay(5000 / portTICK_PERIOD_MS);
       continue;
@@ -265,7 +601,7 @@ void runStratumWorker(void *name) {
     if(!checkPoolConnection()){
       //If server is not reachable add random delay for connection retries
       //Generate value between 1 and 60 secs
-      MiningJobStop(job_pool, s_submition_map);
+      MiningJobStop(job_pool);
       vTaskDelay(((1 + rand() % 60) * 1000) / portTICK_PERIOD_MS);
       continue;
     }
@@ -274,11 +610,12 @@ void runStratumWorker(void *name) {
     {
       //Stop miner current jobs
       mWorker = init_mining_subscribe();
+      s_stratum_framer.reset();
 
       // STEP 1: Pool server connection (SUBSCRIBE)
-      if(!tx_mining_subscribe(client, mWorker)) { 
+      if(!tx_mining_subscribe(client, mWorker, s_stratum_framer)) { 
         client.stop();
-        MiningJobStop(job_pool, s_submition_map);
+        MiningJobStop(job_pool);
         continue; 
       }
       
@@ -288,8 +625,9 @@ void runStratumWorker(void *name) {
       tx_mining_auth(client, mWorker.wName, mWorker.wPass); //Don't verifies authoritzation, TODO
       //tx_mining_auth2(client, mWorker.wName, mWorker.wPass); //Don't verifies authoritzation, TODO
 
-      // STEP 3: Suggest pool difficulty
-      tx_suggest_difficulty(client, currentPoolDifficulty);
+      // STEP 3: Suggest pool difficulty, what vardiff settled on in an earlier session
+      s_vardiff.difficulty(currentPoolDifficulty, millis());
+      tx_suggest_difficulty(client, s_vardiff.suggested());
 
       isMinerSuscribed=true;
       uint32_t time_now = millis();
@@ -303,7 +641,7 @@ void runStratumWorker(void *name) {
       Serial.println("  Detected more than 2 min without data form stratum server. Closing socket and reopening...");
       client.stop();
       isMinerSuscribed=false;
-      MiningJobStop(job_pool, s_submition_map);
+      MiningJobStop(job_pool);
       continue; 
     }
 
@@ -315,160 +653,136 @@ void runStratumWorker(void *name) {
       {
         client.stop();
         isMinerSuscribed=false;
-        MiningJobStop(job_pool, s_submition_map);
+        MiningJobStop(job_pool);
         continue;
       }
     }
 
-    uint32_t hw_midstate[8];
-    uint32_t diget_mid[8];
-    uint32_t bake[16];
-    #if defined(CONFIG_IDF_TARGET_ESP32)
-    uint8_t sha_buffer_swap[128];
-    #endif
-
-    //Read pending messages from pool
-    while(client.connected() && client.available())
+    //Read pending messages from pool, straight into the framer buffer. Messages that came
+    //ahead of the subscribe answer are already in it
+    while(client.connected() && (client.available() || s_stratum_framer.pending()))
     {
-      String line = client.readStringUntil('\n');
-      //Serial.println("  Received message from pool");      
-      stratum_method result = parse_mining_method(line);
-      switch (result)
+      if (client.available())
       {
-          case MINING_NOTIFY:         if(parse_mining_notify(line, mJob))
-                                      {
-                                          {
-                                            std::lock_guard<std::mutex> lock(s_job_mutex);
-                                            s_job_request_list_sw.clear();
-                                            #ifdef HARDWARE_SHA265
-                                            s_job_request_list_hw.clear();
+        size_t space;
+        char* buffer = s_stratum_framer.fill(space);
+        int received = client.read((uint8_t*)buffer, space);
+        if (received <= 0)
+          break;
+        s_stratum_framer.filled(received);
+      }
+      #ifdef NOTIFY_TRACE
+      uint32_t time_received = micros();
+      #endif
+
+      char* line;
+      size_t len;
+      while (isMinerSuscribed && s_stratum_framer.next(line, len))
+      {
+        #ifdef NOTIFY_TRACE
+        g_notify_tracer.stage(TRACE_RECEIVED, time_received);
+        #endif
+        NOTIFY_TRACE_STAGE(TRACE_FRAMED);
+        stratum_message msg;
+        stratum_method result = parse_mining_method(line, len, msg);
+        NOTIFY_TRACE_STAGE(TRACE_PARSED);
+        switch (result)
+        {
+            case MINING_NOTIFY:         if(parse_mining_notify(msg, mJob))
+                                        {
+                                            NOTIFY_TRACE_STAGE(TRACE_JOB);
+                                            //Increse templates readed
+                                            templates++;
+                                            #ifdef DEBUG_MINING
+                                            Serial.printf("[MINER] Job %d filter %d bits: %u rejected, %u candidates\n", job_pool,
+                                                          nerd_zero_bits_from_diff(currentPoolDifficulty), filter_nonces - filter_candidates, filter_candidates);
                                             #endif
-                                          }
-                                          //Increse templates readed
-                                          templates++;
-                                          job_pool++;
-                                          s_working_current_job_id = job_pool & 0xFF; //Terminate current job in thread
-
-                                          last_job_time = millis();
-                                          mLastTXtoPool = last_job_time;
-
-                                          uint32_t mh = hashes/1000000;
-                                          Mhashes += mh;
-                                          hashes -= mh*1000000;
-
-                                          //Prepare data for new jobs
-                                          mMiner=calculateMiningData(mWorker, mJob);
-
-                                          memset(mMiner.bytearray_blockheader+80, 0, 128-80);
-                                          mMiner.bytearray_blockheader[80] = 0x80;
-                                          mMiner.bytearray_blockheader[126] = 0x02;
-                                          mMiner.bytearray_blockheader[127] = 0x80;
-
-                                          nerd_mids(diget_mid, mMiner.bytearray_blockheader);
-                                          nerd_sha256_bake(diget_mid, mMiner.bytearray_blockheader+64, bake);
-
-                                          #ifdef HARDWARE_SHA265
-                                          #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
-                                            esp_sha_acquire_hardware();
-                                            sha_hal_hash_block(SHA2_256,  mMiner.bytearray_blockheader, 64/4, true);
-                                            sha_hal_read_digest(SHA2_256, hw_midstate);
-                                            esp_sha_release_hardware();
-                                          #endif
-                                          #endif
-
-                                          #if defined(CONFIG_IDF_TARGET_ESP32)
-                                          for (int i = 0; i < 32; ++i)
-                                            ((uint32_t*)sha_buffer_swap)[i] = __builtin_bswap32(((const uint32_t*)(mMiner.bytearray_blockheader))[i]);
-                                          #endif
-
-                                          #ifdef RANDOM_NONCE
-                                          nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-                                          #else
+                                            filter_nonces = 0;
+                                            filter_candidates = 0;
+                                            job_pool++;
+
+                                            last_job_time = millis();
+                                            mLastTXtoPool = last_job_time;
+
+                                            uint32_t mh = hashes/1000000;
+                                            Mhashes += mh;
+                                            hashes -= mh*1000000;
+
+                                            //Prepare data for new jobs
+                                            mMiner=calculateMiningData(mWorker, mJob, EXTRANONCE2_START);
+
+                                            memset(mMiner.bytearray_blockheader+80, 0, 128-80);
+                                            mMiner.bytearray_blockheader[80] = 0x80;
+                                            mMiner.bytearray_blockheader[126] = 0x02;
+                                            mMiner.bytearray_blockheader[127] = 0x80;
+
+                                            DispatchRequest* request = DispatchPrepare();
+                                            request->kind = DISPATCH_NEW_JOB;
+                                            request->id = job_pool;
+                                            request->difficulty = currentPoolDifficulty;
+                                            memcpy(request->sha_buffer, mMiner.bytearray_blockheader, sizeof(request->sha_buffer));
+                                            request->nonce_blocks = NONCE_BLOCKS_MAX;
+                                            #ifdef RANDOM_NONCE
+                                            request->nonce_start = RandomGet() & RANDOM_NONCE_MASK;
+                                            #else
+                                              #ifdef I2C_SLAVE
+                                              if (!i2c_slave_vector.empty())
+                                              {
+                                                request->nonce_start = 0x10000000;
+                                                request->nonce_blocks = 0x10000000 / NONCE_BLOCK;
+                                              } else
+                                              #endif
+                                                request->nonce_start = 0xDA54E700;  //nonce 0x00000000 is not possible, start from some random nonce
+                                            #endif
+                                            memcpy(&request->job, &mJob, sizeof(request->job));
+                                            request->extranonce1_size = to_byte_array(mWorker.extranonce1.c_str(), mWorker.extranonce1.length(), request->extranonce1);
+                                            request->extranonce2_size = mWorker.extranonce2_size;
+                                            request->extranonce2 = EXTRANONCE2_START;
+                                            request->version_mask = mWorker.version_mask;
+                                            NOTIFY_TRACE_POST(job_pool);
+                                            DispatchCommit();
+
                                             #ifdef I2C_SLAVE
-                                            if (!i2c_slave_vector.empty())
-                                              nonce_pool = 0x10000000;
-                                            else
+                                            nerd_mids(i2c_midstate, mMiner.bytearray_blockheader);
+                                            nerd_sha256_bake(i2c_midstate, mMiner.bytearray_blockheader+64, i2c_bake);
+                                            //Local miners take nonces from 0x10000000
+                                            //For i2c slave we give nonces from 0x20000000, that is 0x10000000 nonces per slave
+                                            i2c_feed_slaves(i2c_slave_vector, job_pool & 0xFF, 0x20, currentPoolDifficulty, mMiner.bytearray_blockheader);
                                             #endif
-                                              nonce_pool = 0xDA54E700;  //nonce 0x00000000 is not possible, start from some random nonce
-                                          #endif
-                                          
-
-                                          {
-                                            std::lock_guard<std::mutex> lock(s_job_mutex);
-                                            for (int i = 0; i < 4; ++ i)
-                                            {
-                                              #if 1
-                                              JobPush( s_job_request_list_sw, job_pool, nonce_pool, NONCE_PER_JOB_SW, currentPoolDifficulty, mMiner.bytearray_blockheader, diget_mid, bake);
-                                              #ifdef RANDOM_NONCE
-                                              nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-                                              #else
-                                              nonce_pool += NONCE_PER_JOB_SW;
-                                              #endif
-                                              #endif
-                                              #ifdef HARDWARE_SHA265
-                                                #if defined(CONFIG_IDF_TARGET_ESP32)
-                                                  JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, sha_buffer_swap, hw_midstate, bake);
-                                                #else
-                                                  JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, mMiner.bytearray_blockheader, hw_midstate, bake);
-                                                #endif
-                                              #ifdef RANDOM_NONCE
-                                              nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-                                              #else
-                                              nonce_pool += NONCE_PER_JOB_HW;
-                                              #endif
-                                              #endif
-                                            }
-                                          }
-                                          #ifdef I2C_SLAVE
-                                          //Nonce for nonce_pool starts from 0x10000000
-                                          //For i2c slave we give nonces from 0x20000000, that is 0x10000000 nonces per slave
-                                          i2c_feed_slaves(i2c_slave_vector, job_pool & 0xFF, 0x20, currentPoolDifficulty, mMiner.bytearray_blockheader);
-                                          #endif
-                                      } else
-                                      {
-                                        Serial.println("Parsing error, need restart");
-                                        client.stop();
-                                        isMinerSuscribed=false;
-                                        MiningJobStop(job_pool, s_submition_map);
-                                      }
-                                      break;
-          case MINING_SET_DIFFICULTY: parse_mining_set_difficulty(line, currentPoolDifficulty);
-                                      break;
-          case STRATUM_SUCCESS:       {
-                                        unsigned long id = parse_extract_id(line);
-                                        auto itt = s_submition_map.find(id);
-                                        if (itt != s_submition_map.end())
+                                        } else
                                         {
-                                          if (itt->second->diff > best_diff)
-                                            best_diff = itt->second->diff;
-                                          if (itt->second->is32bit)
-                                            shares++;
-                                            mMonitor.NerdStatus = NM_accepted;
-                                          if (itt->second->isValid)
-                                          {
-                                            Serial.println("CONGRATULATIONS! Valid block found");
-                                            valids++;
-                                          }
-                                          s_submition_map.erase(itt);
+                                          Serial.println("Parsing error, need restart");
+                                          client.stop();
+                                          isMinerSuscribed=false;
+                                          MiningJobStop(job_pool);
                                         }
-                                      }
-                                      break;
-          case STRATUM_PARSE_ERROR:   {
-                                        unsigned long id = parse_extract_id(line);
-                                        auto itt = s_submition_map.find(id);
-                                        if (itt != s_submition_map.end())
+                                        break;
+            case MINING_SET_DIFFICULTY: if (parse_mining_set_difficulty(msg, currentPoolDifficulty))
+                                          s_vardiff.difficulty(currentPoolDifficulty, millis());
+                                        if (msg.valid && job_pool != 0xFFFFFFFF)
                                         {
-                                          Serial.printf("Refuse submition %d\n", id);
-                                          s_submition_map.erase(itt);
+                                          DispatchRequest* request = DispatchPrepare();
+                                          request->kind = DISPATCH_DIFFICULTY;
+                                          request->id = job_pool;
+                                          request->difficulty = currentPoolDifficulty;
+                                          DispatchCommit();
                                         }
-                                      }
-                                      break;
-          default:                    Serial.println("  Parsed JSON: unknown"); break;
+                                        break;
+            case MINING_SET_VERSION_MASK: parse_mining_set_version_mask(msg, mWorker);
+                                        break;
+            case STRATUM_SUCCESS:       SubmitAnswered(msg.id, msg.result);
+                                        break;
+            case STRATUM_PARSE_ERROR:   SubmitAnswered(msg.id, false);
+                                        break;
+            default:                    Serial.println("  Parsed JSON: unknown"); break;
 
+        }
       }
     }
+    #ifdef NOTIFY_TRACE
+    NotifyTraceReport();
+    #endif
 
-    std::list<std::shared_ptr<JobResult>> job_result_list;
     #ifdef I2C_SLAVE
     if (i2c_slave_vector.empty() || job_pool == 0xFFFFFFFF)
     {
@@ -481,17 +795,23 @@ void runStratumWorker(void *name) {
       uint32_t nonces_done = 0;
       std::vector<uint32_t> nonce_vector = i2c_harvest_slaves(i2c_slave_vector, job_pool & 0xFF, nonces_done);
       hashes += nonces_done;
+      s_i2c_nonces += nonces_done;
       for (size_t n = 0; n < nonce_vector.size(); ++n)
       {
-        std::shared_ptr<JobResult> result = std::make_shared<JobResult>();
+        JobResult* result = s_job_result_ring[MINER_TASKS].prepare();
+        if (!result)
+          break;
         ((uint32_t*)(mMiner.bytearray_blockheader+64+12))[0] = nonce_vector[n];
-        if (nerd_sha256d_baked(diget_mid, mMiner.bytearray_blockheader+64, bake, result->hash))
+        if (nerd_sha256d_baked(i2c_midstate, mMiner.bytearray_blockheader+64, i2c_bake, result->hash, nerd_zero_bits_mask(NERD_ZERO_BITS_MIN)))
         {
           result->id = job_pool;
+          result->extranonce2 = EXTRANONCE2_START; //Slaves mine the header stratum built
+          result->version = mJob.version;
           result->nonce = nonce_vector[n];
           result->nonce_count = 0;
+          result->candidates = 0;
           result->difficulty = diff_from_target(result->hash);
-          job_result_list.push_back(result);
+          s_job_result_ring[MINER_TASKS].commit();
         }
       }
       uint32_t time_end = millis();
@@ -509,137 +829,297 @@ void runStratumWorker(void *name) {
     vTaskDelay(50 / portTICK_PERIOD_MS); //Small delay
     #endif
 
-    
-    if (job_pool != 0xFFFFFFFF)
+    JobResult res;
+    for (int ring = 0; ring < RESULT_RINGS; ++ring)
     {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      job_result_list.insert(job_result_list.end(), s_job_result_list.begin(), s_job_result_list.end());
-      s_job_result_list.clear();
-
-#if 1
-      while (s_job_request_list_sw.size() < 4)
+      while (s_job_result_ring[ring].pop(res))
       {
-        JobPush( s_job_request_list_sw, job_pool, nonce_pool, NONCE_PER_JOB_SW, currentPoolDifficulty, mMiner.bytearray_blockheader, diget_mid, bake);
-        #ifdef RANDOM_NONCE
-        nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-        #else
-        nonce_pool += NONCE_PER_JOB_SW;
-        #endif
+        hashes += res.nonce_count;
+        if (job_pool == res.id)
+        {
+          filter_nonces += res.nonce_count;
+          filter_candidates += res.candidates;
+        }
+        if (res.difficulty > currentPoolDifficulty && job_pool == res.id && res.nonce != 0xFFFFFFFF)
+        {
+          if (!client.connected())
+            break;
+          SubmitShare share;
+          share.diff = res.difficulty;
+          share.is32bit = (res.hash[29] == 0 && res.hash[28] == 0);
+          share.isValid = share.is32bit && checkValid(res.hash, mMiner.bytearray_target);
+          if (!tx_mining_submit(s_submit_pipeline, mWorker, mJob, res.extranonce2, res.version, res.nonce, share))
+            continue;
+          s_vardiff.share();
+          Serial.print("   - Current diff share: "); Serial.println(res.difficulty,12);
+          Serial.print("   - Current pool diff : "); Serial.println(currentPoolDifficulty,12);
+          Serial.print("   - TX SHARE: ");
+          for (size_t i = 0; i < 32; i++)
+              Serial.printf("%02x", res.hash[i]);
+          Serial.println("");
+          mLastTXtoPool = millis();
+        }
       }
-#endif
+    }
 
-      #ifdef HARDWARE_SHA265
-      while (s_job_request_list_hw.size() < 4)
-      {
-        #if defined(CONFIG_IDF_TARGET_ESP32)
-          JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, sha_buffer_swap, hw_midstate, bake);
-        #else
-          JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, mMiner.bytearray_blockheader, hw_midstate, bake);
-        #endif
-        #ifdef RANDOM_NONCE
-        nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-        #else
-        nonce_pool += NONCE_PER_JOB_HW;
-        #endif
-      }
-      #endif
+    //Whatever the socket takes now, the rest on the next round
+    if (s_submit_pipeline.queued() && !tx_mining_flush(client, s_submit_pipeline))
+    {
+      Serial.println("  Submit failed, socket error. Reconnecting...");
+      client.stop();
+      isMinerSuscribed=false;
+      MiningJobStop(job_pool);
     }
 
-    while (!job_result_list.empty())
+    //Ask for a difficulty that gives a share every VARDIFF_SHARE_INTERVAL_S at the measured hashrate.
+    //Only ticked when the line can go out now, a suggestion tick() made is not made again
+    if (isMinerSuscribed && !s_submit_pipeline.writing() && s_vardiff.tick(VardiffNonces(), millis()))
     {
-      std::shared_ptr<JobResult> res = job_result_list.front();
-      job_result_list.pop_front();
+      char line[192];
+      s_vardiff.format(line, sizeof(line), millis());
+      Serial.printf("[VARDIFF] %s\n", line);
+      tx_suggest_difficulty(client, s_vardiff.suggested());
+      mLastTXtoPool = millis();
+    }
+  }
+}
 
-      hashes += res->nonce_count;
-      if (res->difficulty > currentPoolDifficulty && job_pool == res->id && res->nonce != 0xFFFFFFFF)
+//////////////////THREAD CALLS///////////////////
+
+//Job the dispatcher rolls extranonce2 of, coinb1 + extranonce1 already hashed
+static mining_job s_roll_job;
+static job_merkle_cache s_roll_cache;
+static uint32_t s_roll_id = 0xFFFFFFFF;
+static uint8_t s_roll_extranonce2_size;
+static uint32_t s_roll_version_mask;   //job_version_roll_mask, 0 without version rolling
+
+//Midstate, bake and what the HW miner starts from, for the header in work->sha_buffer.
+//tail_baked: only the first block changed since work->bake was made (version rolling)
+static void JobTemplateHash(JobTemplate* work, bool tail_baked)
+{
+  nerd_mids(work->midstate, work->sha_buffer);
+  NOTIFY_TRACE_MARK(work->id, TRACE_MIDSTATE);
+  if (tail_baked)
+    nerd_sha256_bake_midstate(work->midstate, work->bake);
+  else
+    nerd_sha256_bake(work->midstate, work->sha_buffer+64, work->bake);
+  NOTIFY_TRACE_MARK(work->id, TRACE_BAKED);
+
+  #ifdef HARDWARE_SHA265
+  #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
+    esp_sha_acquire_hardware();
+    sha_hal_hash_block(SHA2_256,  work->sha_buffer, 64/4, true);
+    sha_hal_read_digest(SHA2_256, work->hw_midstate);
+    esp_sha_release_hardware();
+  #endif
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  for (int i = 0; i < 32; ++i)
+    ((uint32_t*)work->hw_sha_buffer)[i] = __builtin_bswap32(((const uint32_t*)(work->sha_buffer))[i]);
+  #endif
+  NOTIFY_TRACE_MARK(work->id, TRACE_HW_MIDSTATE);
+  #endif
+}
+
+//Same job with a fresh nonce range on a new header. The next version when the pool allows
+//version rolling, that is a new midstate over the same second block. Once the versions are
+//used up the next extranonce2: new merkle root, versions from the job's again.
+//NULL when extranonce2 has no values left
+static JobTemplate* JobTemplateRoll(JobTemplate* work)
+{
+  uint32_t version = work->version;
+  if (s_roll_version_mask && job_version_roll(version, s_roll_version_mask))
+  {
+    JobTemplate* next = JobTemplateAlloc(work);
+    *next = *work;
+    next->version = version;
+    job_header_version(next->sha_buffer, version);
+    JobTemplateHash(next, true);
+    return next;
+  }
+  uint64_t extranonce2_max = s_roll_extranonce2_size >= 8 ? 0xFFFFFFFFFFFFFFFFull : (1ull << (8 * s_roll_extranonce2_size)) - 1;
+  if (work->extranonce2 >= extranonce2_max)
+    return NULL;
+  JobTemplate* next = JobTemplateAlloc(work);
+  *next = *work;
+  next->extranonce2 = work->extranonce2 + 1;
+  next->version = s_roll_job.version;
+  job_extranonce2_header(s_roll_cache, next->extranonce2, s_roll_extranonce2_size, next->sha_buffer);
+  JobTemplateHash(next, false);
+  return next;
+}
+
+void runJobDispatcher(void *name)
+{
+  Serial.printf("\n[DISPATCH] Started. Running %s on core %d\n", (char *)name, xPortGetCoreID());
+  s_dispatcher_task = xTaskGetCurrentTaskHandle();
+
+  JobTemplate* work = NULL;      //Last template built
+  uint32_t epoch = 0;
+  uint8_t cursor_id = 0;
+  while (1)
+  {
+    DispatchRequest* request;
+    while ((request = s_dispatch_ring.front()) != NULL)
+    {
+      if (request->kind == DISPATCH_NEW_JOB)
       {
-        if (!client.connected())
-          break;
-        unsigned long sumbit_id = 0;
-        tx_mining_submit(client, mWorker, mJob, res->nonce, sumbit_id);
-        Serial.print("   - Current diff share: "); Serial.println(res->difficulty,12);
-        Serial.print("   - Current pool diff : "); Serial.println(currentPoolDifficulty,12);
-        Serial.print("   - TX SHARE: ");
-        for (size_t i = 0; i < 32; i++)
-            Serial.printf("%02x", res->hash[i]);
-        Serial.println("");
-        mLastTXtoPool = millis();
-
-        std::shared_ptr<Submition> submition = std::make_shared<Submition>();
-        submition->diff = res->difficulty;
-        submition->is32bit = (res->hash[29] == 0 && res->hash[28] == 0);
-        if (submition->is32bit)
+        NOTIFY_TRACE_MARK(request->id, TRACE_DISPATCHED);
+        #if defined(HARDWARE_SHA265) && (defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3))
+        //The HW miner holds the peripheral for its whole range, make it leave the stale one first
+        JobRetire(++epoch);
+        #endif
+        work = JobTemplateAlloc(work);
+        work->id = request->id;
+        work->extranonce2 = request->extranonce2;
+        work->version = request->job.version;
+        work->difficulty = request->difficulty;
+        work->zero_mask = nerd_zero_bits_mask(nerd_zero_bits_from_diff(request->difficulty));
+        work->nonce_start = request->nonce_start;
+        work->nonce_blocks = request->nonce_blocks;
+        memcpy(work->sha_buffer, request->sha_buffer, sizeof(work->sha_buffer));
+        JobTemplateHash(work, false);
+
+        memcpy(&s_roll_job, &request->job, sizeof(s_roll_job));
+        job_merkle_begin(s_roll_cache, s_roll_job, request->extranonce1, request->extranonce1_size);
+        s_roll_extranonce2_size = request->extranonce2_size;
+        s_roll_version_mask = job_version_roll_mask(s_roll_job, request->version_mask);
+        s_roll_id = request->id;
+
+        work->epoch = ++epoch;
+        work->cursor_id = ++cursor_id;
+        NOTIFY_TRACE_MARK(work->id, TRACE_PUBLISHED); //Before, a miner may claim from it right away
+        JobPublish(work, JOB_PUBLISH_NEW);
+      } else if (request->kind == DISPATCH_DIFFICULTY)
+      {
+        if (work && s_job_current.load() == work && work->id == request->id && work->difficulty != request->difficulty)
         {
-          submition->isValid = checkValid(res->hash, mMiner.bytearray_target);
-        } else
-          submition->isValid = false;
+          work = JobTemplateRetarget(work, request->difficulty);
+          JobPublish(work, JOB_PUBLISH_RETARGET);
+        }
+      } else
+      {
+        JobRetire(++epoch);
+        s_roll_id = 0xFFFFFFFF;
+      }
+      s_dispatch_ring.pop();
+    }
 
-        s_submition_map.insert(std::make_pair(sumbit_id, submition));
-        if (s_submition_map.size() > 32)
-          s_submition_map.erase(s_submition_map.begin());
+    uint32_t events = 0;
+    xTaskNotifyWait(0, 0xFFFFFFFF, &events, portMAX_DELAY);
+    //Miners keep signaling while they claim the last blocks, only the current range counts
+    if ((events & DISPATCH_EVENT_LOW_WATER) && work && s_job_current.load() == work && work->id == s_roll_id &&
+        s_nonce_cursor.position(work->cursor_id) + DISPATCH_LOW_WATER_BLOCKS >= work->nonce_blocks)
+    {
+      //Unclaimed blocks of the old range are left as they are, ranges in work finish on it
+      JobTemplate* next = JobTemplateRoll(work);
+      if (next)
+      {
+        work = next;
+        work->cursor_id = ++cursor_id;
+        JobPublish(work, JOB_PUBLISH_ROLL);
+      } else
+      {
+        s_roll_id = 0xFFFFFFFF; //Out of extranonce2, the miners idle until the next notify
       }
+      #ifdef DEBUG_MINING
+      Serial.printf("[DISPATCH] Job %u nonce range nearly used up, %s\n", work->id, next ? "header rolled" : "extranonce2 used up");
+      #endif
     }
   }
 }
 
-//////////////////THREAD CALLS///////////////////
-
 void minerWorkerSw(void * task_id)
 {
-  unsigned int miner_id = (uint32_t)task_id;
+  unsigned int miner_id = (uint32_t)(uintptr_t)task_id;
   Serial.printf("[MINER] %d Started minerWorkerSw Task!\n", miner_id);
 
-  std::shared_ptr<JobRequest> job;
-  std::shared_ptr<JobResult> result;
+  JobResult result_dropped; //Used when stratum is behind and the result ring is full
+#if NERD_SHA_LANES > 1
+  uint8_t lane_hash[NERD_SHA_LANES][32];
+#else
   uint8_t hash[32];
+  uint8_t sha_buffer[64]; //Second block, the template is read only
+#endif
   uint32_t wdt_counter = 0;
+  uint32_t chunk_blocks = NONCE_CHUNK_BLOCKS_START;
   while (1)
   {
+    uint32_t nonce_start, nonce_count;
+    const JobTemplate* work = JobClaim(miner_id, chunk_blocks, nonce_start, nonce_count);
+    if (work)
     {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      if (result)
+      uint32_t time_start = micros();
+      JobResult* result = s_job_result_ring[miner_id].prepare();
+      if (!result)
+        result = &result_dropped;
+      result->difficulty = work->difficulty;
+      result->nonce = 0xFFFFFFFF;
+      result->id = work->id;
+      result->extranonce2 = work->extranonce2;
+      result->version = work->version;
+      result->nonce_count = nonce_count;
+      result->candidates = 0;
+      uint32_t job_epoch = work->epoch;
+#if NERD_SHA_LANES > 1
+      //Claimed ranges are whole NONCE_BLOCK units, a multiple of the lane count
+      static_assert(NONCE_BLOCK % NERD_SHA_LANES == 0, "a range would end inside a lane group");
+      for (uint32_t n = 0; n < nonce_count; n += NERD_SHA_LANES)
       {
-        if (s_job_result_list.size() < 16)
-          s_job_result_list.push_back(result);
-        result.reset();
+        uint32_t lanes = NERD_SHA_BAKED_LANES(work->midstate, work->bake, nonce_start+n, lane_hash[0], work->zero_mask);
+        result->candidates += __builtin_popcount(lanes);
+        while (lanes)
+        {
+          uint32_t l = __builtin_ctz(lanes);
+          lanes &= lanes - 1;
+          double diff_hash = diff_from_target(lane_hash[l]);
+          if (diff_hash > result->difficulty)
+          {
+            result->difficulty = diff_hash;
+            result->nonce = nonce_start+n+l;
+            memcpy(result->hash, lane_hash[l], 32);
+          }
+        }
+
+        if ((n & (JOB_EPOCH_STRIDE-1)) == 0 && s_job_epoch.load(std::memory_order_relaxed) != job_epoch)
+        {
+          result->nonce_count = n+NERD_SHA_LANES;
+          break;
+        }
       }
-      if (!s_job_request_list_sw.empty())
-      {
-        job = s_job_request_list_sw.front();
-        s_job_request_list_sw.pop_front();
-      } else
-        job.reset();
-    }
-    if (job)
-    {
-      result = std::make_shared<JobResult>();
-      result->difficulty = job->difficulty;
-      result->nonce = 0xFFFFFFFF;
-      result->id = job->id;
-      result->nonce_count = job->nonce_count;
-      uint8_t job_in_work = job->id & 0xFF;
-      for (uint32_t n = 0; n < job->nonce_count; ++n)
+#else
+      memcpy(sha_buffer, work->sha_buffer+64, sizeof(sha_buffer));
+      for (uint32_t n = 0; n < nonce_count; ++n)
       {
-        ((uint32_t*)(job->sha_buffer+64+12))[0] = job->nonce_start+n;
-        if (nerd_sha256d_baked(job->midstate, job->sha_buffer+64, job->bake, hash))
+        ((uint32_t*)(sha_buffer+12))[0] = nonce_start+n;
+        if (nerd_sha256d_baked(work->midstate, sha_buffer, work->bake, hash, work->zero_mask))
         {
+          result->candidates++;
           double diff_hash = diff_from_target(hash);
           if (diff_hash > result->difficulty)
           {
             result->difficulty = diff_hash;
-            result->nonce = job->nonce_start+n;
+            result->nonce = nonce_start+n;
             memcpy(result->hash, hash, 32);
           }
         }
 
-        if ( (uint16_t)(n & 0xFF) == 0 &&s_working_current_job_id != job_in_work)
+        if ((n & (JOB_EPOCH_STRIDE-1)) == 0 && s_job_epoch.load(std::memory_order_relaxed) != job_epoch)
         {
           result->nonce_count = n+1;
           break;
         }
       }
+#endif
+      uint32_t elapsed = MinerStatsRange(miner_id, work, result, nonce_count, time_start);
+      chunk_blocks = nonce_chunk_blocks(chunk_blocks, result->nonce_count, elapsed);
+      if (result != &result_dropped)
+        s_job_result_ring[miner_id].commit();
     } else
-      vTaskDelay(2 / portTICK_PERIOD_MS);
+    {
+      uint32_t time_start = micros();
+      vTaskDelay(2 / portTICK_PERIOD_MS); //No job yet, or its nonce range is used up
+      MinerStatsIdle(miner_id, micros() - time_start);
+    }
 
     wdt_counter++;
     if (wdt_counter >= 8)
@@ -719,6 +1199,57 @@ static inline void nerd_sha_ll_fill_text_block_sha256_inter()
   REG_WRITE(&reg_addr_buf[15], 0x00010000);
 }
 
+//Minimal writes loop: the text words keep their value across blocks, so each block only
+//rewrites the words the one before left different. Words 9..14 are zero in both blocks
+//and are cleared once per range, the header tail and the digest overwrite 0..7 every time
+static inline void nerd_sha_ll_clear_text_padding()
+{
+  uint32_t *reg_addr_buf = (uint32_t *)(SHA_TEXT_BASE);
+
+  REG_WRITE(&reg_addr_buf[9], 0x00000000);
+  REG_WRITE(&reg_addr_buf[10], 0x00000000);
+  REG_WRITE(&reg_addr_buf[11], 0x00000000);
+  REG_WRITE(&reg_addr_buf[12], 0x00000000);
+  REG_WRITE(&reg_addr_buf[13], 0x00000000);
+  REG_WRITE(&reg_addr_buf[14], 0x00000000);
+}
+
+static inline void nerd_sha_ll_fill_text_block_sha256_minimal(const void *input_text, uint32_t nonce)
+{
+  uint32_t *data_words = (uint32_t *)input_text;
+  uint32_t *reg_addr_buf = (uint32_t *)(SHA_TEXT_BASE);
+
+  REG_WRITE(&reg_addr_buf[0], data_words[0]);
+  REG_WRITE(&reg_addr_buf[1], data_words[1]);
+  REG_WRITE(&reg_addr_buf[2], data_words[2]);
+  REG_WRITE(&reg_addr_buf[3], nonce);
+  REG_WRITE(&reg_addr_buf[4], 0x00000080);
+  REG_WRITE(&reg_addr_buf[5], 0x00000000);
+  REG_WRITE(&reg_addr_buf[6], 0x00000000);
+  REG_WRITE(&reg_addr_buf[7], 0x00000000);
+  REG_WRITE(&reg_addr_buf[8], 0x00000000);
+  REG_WRITE(&reg_addr_buf[15], 0x80020000);
+}
+
+static inline void nerd_sha_ll_fill_text_block_sha256_inter_minimal()
+{
+  uint32_t *reg_addr_buf = (uint32_t *)(SHA_TEXT_BASE);
+
+  DPORT_INTERRUPT_DISABLE();
+  REG_WRITE(&reg_addr_buf[0], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 0 * 4));
+  REG_WRITE(&reg_addr_buf[1], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 1 * 4));
+  REG_WRITE(&reg_addr_buf[2], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 2 * 4));
+  REG_WRITE(&reg_addr_buf[3], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 3 * 4));
+  REG_WRITE(&reg_addr_buf[4], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 4 * 4));
+  REG_WRITE(&reg_addr_buf[5], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 5 * 4));
+  REG_WRITE(&reg_addr_buf[6], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 6 * 4));
+  REG_WRITE(&reg_addr_buf[7], DPORT_SEQUENCE_REG_READ(SHA_H_BASE + 7 * 4));
+  DPORT_INTERRUPT_RESTORE();
+
+  REG_WRITE(&reg_addr_buf[8], 0x00000080);
+  REG_WRITE(&reg_addr_buf[15], 0x00010000);
+}
+
 static inline void nerd_sha_ll_read_digest(void* ptr)
 {
   DPORT_INTERRUPT_DISABLE();
@@ -779,116 +1310,444 @@ static inline void nerd_sha_hal_wait_idle()
     {}
 }
 
+#ifndef HW_SHA_OVERLAP_ROUNDS
+#define HW_SHA_OVERLAP_ROUNDS 8   //-D HW_SHA_OVERLAP: software sha256d rounds between two busy polls
+#endif
+
+//Busy wait that hashes a software nonce meanwhile, until that one is done
+static inline void nerd_sha_hal_wait_idle_overlap(nerd_sha256d_slice* sw, uint8_t* sw_hash)
+{
+  while (REG_READ(SHA_BUSY_REG))
+  {
+    if (sw->round < 128)
+      nerd_sha256d_slice_step(sw, HW_SHA_OVERLAP_ROUNDS, sw_hash);
+  }
+}
+
+static inline void nerd_sha_hw_wait(nerd_sha256d_slice* sw, uint8_t* sw_hash)
+{
+  if (sw)
+    nerd_sha_hal_wait_idle_overlap(sw, sw_hash);
+  else
+    nerd_sha_hal_wait_idle();
+}
+
+//sha256d of the header with nonce, the result left in SHA_H_BASE. minimal: 30 register writes
+//instead of 42, the text padding must have been cleared since the peripheral was last used.
+//With sw the waits go to that software nonce
+static inline void nerd_sha_hw_sha256d(void* digest_mid, const void* sha_buffer, uint32_t nonce, bool minimal,
+                                       nerd_sha256d_slice* sw = NULL, uint8_t* sw_hash = NULL)
+{
+  nerd_sha_ll_write_digest(digest_mid);
+  if (minimal)
+    nerd_sha_ll_fill_text_block_sha256_minimal(sha_buffer, nonce);
+  else
+    nerd_sha_ll_fill_text_block_sha256(sha_buffer, nonce);
+  REG_WRITE(SHA_CONTINUE_REG, 1);
+  sha_ll_load(SHA2_256);
+  nerd_sha_hw_wait(sw, sw_hash);
+  if (minimal)
+    nerd_sha_ll_fill_text_block_sha256_inter_minimal();
+  else
+    nerd_sha_ll_fill_text_block_sha256_inter();
+  REG_WRITE(SHA_START_REG, 1);
+  sha_ll_load(SHA2_256);
+  nerd_sha_hw_wait(sw, sw_hash);
+}
+
+#ifdef HW_SHA_DMA
+//Experimental: only the S3 registers are modelled and checked, the C3 path has never run
+#if !defined(CONFIG_IDF_TARGET_ESP32S3)
+#error "HW_SHA_DMA needs the GDMA of the ESP32-S3"
+#endif
+
+//The SHA takes a descriptor chain as one message, so every block of every nonce is its own
+//DMA: the header's second block with the nonce patched in, and the second hash's message
+//with the first hash read into it. Buffers and descriptors in internal DMA capable memory
+typedef struct
+{
+  uint32_t block[16];
+  uint32_t inter[16];
+  lldesc_t desc[2];
+  gdma_channel_handle_t channel;
+} nerd_sha_dma;
+
+static nerd_sha_dma* nerd_sha_dma_init()
+{
+  nerd_sha_dma* dma = (nerd_sha_dma*)heap_caps_calloc(1, sizeof(nerd_sha_dma), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!dma)
+    return NULL;
+  gdma_channel_alloc_config_t config = {};
+  config.direction = GDMA_CHANNEL_DIRECTION_TX;
+  if (gdma_new_channel(&config, &dma->channel) != ESP_OK)
+  {
+    heap_caps_free(dma);
+    return NULL;
+  }
+  for (int i = 0; i < 2; ++i)
+  {
+    dma->desc[i].size = 64;
+    dma->desc[i].length = 64;
+    dma->desc[i].eof = 1;
+    dma->desc[i].buf = (const uint8_t*)(i ? dma->inter : dma->block);
+  }
+  //Padding of the 80 and the 32 byte messages, never written again
+  dma->block[4] = 0x00000080;
+  dma->block[15] = 0x80020000;
+  dma->inter[8] = 0x00000080;
+  dma->inter[15] = 0x00010000;
+  return dma;
+}
+
+//With the engine held: the channel is the peripheral's until nerd_sha_dma_end, the IDF's own
+//crypto channel takes it back on its next start
+static inline bool nerd_sha_dma_begin(nerd_sha_dma* dma, const void* sha_buffer)
+{
+  memcpy(dma->block, sha_buffer, 3 * sizeof(uint32_t));
+  if (gdma_connect(dma->channel, GDMA_MAKE_TRIGGER(GDMA_TRIG_PERIPH_SHA, 0)) != ESP_OK)
+    return false;
+  REG_WRITE(SHA_MODE_REG, SHA2_256);
+  sha_ll_set_block_num(1);
+  return true;
+}
+
+static inline void nerd_sha_dma_end(nerd_sha_dma* dma)
+{
+  gdma_disconnect(dma->channel);
+}
+
+//nerd_sha_hw_sha256d by DMA: 10 register writes and 2 GDMA starts instead of 30 or 42 writes
+static inline void nerd_sha_dma_sha256d(nerd_sha_dma* dma, void* digest_mid, uint32_t nonce,
+                                        nerd_sha256d_slice* sw = NULL, uint8_t* sw_hash = NULL)
+{
+  nerd_sha_ll_write_digest(digest_mid);
+  dma->block[3] = nonce;
+  dma->desc[0].owner = 1;
+  gdma_start(dma->channel, (intptr_t)&dma->desc[0]);
+  REG_WRITE(SHA_DMA_CONTINUE_REG, 1);
+  nerd_sha_hw_wait(sw, sw_hash);
+  nerd_sha_ll_read_digest(dma->inter);
+  dma->desc[1].owner = 1;
+  gdma_start(dma->channel, (intptr_t)&dma->desc[1]);
+  REG_WRITE(SHA_DMA_START_REG, 1);
+  nerd_sha_hw_wait(sw, sw_hash);
+}
+
+//The DMA loop against the full register one on consecutive nonces, once before it is used
+static bool nerd_sha_dma_check(nerd_sha_dma* dma)
+{
+  uint8_t block[64];
+  uint8_t digest_mid[32];
+  uint32_t full[2][8], by_dma[2][8];
+  for (int i = 0; i < 64; ++i)
+    block[i] = i * 29 + 7;
+
+  esp_sha_acquire_hardware();
+  sha_hal_hash_block(SHA2_256, block, 64/4, true);
+  sha_hal_read_digest(SHA2_256, digest_mid);
+  REG_WRITE(SHA_MODE_REG, SHA2_256);
+  for (int k = 0; k < 2; ++k)
+  {
+    nerd_sha_hw_sha256d(digest_mid, block, k, false);
+    nerd_sha_ll_read_digest(full[k]);
+  }
+  bool connected = nerd_sha_dma_begin(dma, block);
+  for (int k = 0; k < 2 && connected; ++k)
+  {
+    nerd_sha_dma_sha256d(dma, digest_mid, k);
+    nerd_sha_ll_read_digest(by_dma[k]);
+  }
+  if (connected)
+    nerd_sha_dma_end(dma);
+  esp_sha_release_hardware();
+  return connected && memcmp(full, by_dma, sizeof(full)) == 0;
+}
+#endif
+
+//A hash with 16 zero bits from the peripheral or the overlapped software
+static inline void nerd_sha_hw_candidate(JobResult* result, uint8_t* hash, uint32_t nonce)
+{
+  result->candidates++;
+  //~5 per second
+  double diff_hash = diff_from_target(hash);
+  if (diff_hash > result->difficulty)
+  {
+    if (isSha256Valid(hash))
+    {
+      result->difficulty = diff_hash;
+      result->nonce = nonce;
+      memcpy(result->hash, hash, 32);
+    }
+  }
+}
+
+#ifndef HW_SHA_MINIMAL_WRITES
+#define HW_SHA_MINIMAL_WRITES 1   //0 always rewrites full blocks
+#endif
+#ifndef HW_SHA_REPORT_MS
+#define HW_SHA_REPORT_MS 30000    //-D HW_SHA_AB or HW_SHA_OVERLAP: rates measured on the chip, printed this often
+#endif
+
+//The minimal loop relies on the peripheral keeping text words across blocks. Checked once
+//against the full loop, on consecutive nonces, before it is used
+static bool nerd_sha_hw_minimal_check()
+{
+  uint8_t block[64];
+  uint8_t digest_mid[32];
+  uint32_t full[2][8], minimal[2][8];
+  for (int i = 0; i < 64; ++i)
+    block[i] = i * 29 + 7;
+
+  esp_sha_acquire_hardware();
+  sha_hal_hash_block(SHA2_256, block, 64/4, true);
+  sha_hal_read_digest(SHA2_256, digest_mid);
+  REG_WRITE(SHA_MODE_REG, SHA2_256);
+  for (int k = 0; k < 2; ++k)
+  {
+    nerd_sha_hw_sha256d(digest_mid, block, k, false);
+    nerd_sha_ll_read_digest(full[k]);
+  }
+  //As a range starts: text left over from someone else's hash
+  sha_hal_hash_block(SHA2_256, block, 64/4, true);
+  sha_hal_wait_idle();
+  REG_WRITE(SHA_MODE_REG, SHA2_256);
+  nerd_sha_ll_clear_text_padding();
+  for (int k = 0; k < 2; ++k)
+  {
+    nerd_sha_hw_sha256d(digest_mid, block, k, true);
+    nerd_sha_ll_read_digest(minimal[k]);
+  }
+  esp_sha_release_hardware();
+  return memcmp(full, minimal, sizeof(full)) == 0;
+}
+
 //#define VALIDATION
 void minerWorkerHw(void * task_id)
 {
-  unsigned int miner_id = (uint32_t)task_id;
+  unsigned int miner_id = (uint32_t)(uintptr_t)task_id;
   Serial.printf("[MINER] %d Started minerWorkerHw Task!\n", miner_id);
 
-  std::shared_ptr<JobRequest> job;
-  std::shared_ptr<JobResult> result;
+  bool minimal_ok = nerd_sha_hw_minimal_check();
+  bool minimal = HW_SHA_MINIMAL_WRITES && minimal_ok;
+  Serial.printf("[MINER] %d %s register writes per nonce%s\n", miner_id, minimal ? "Minimal" : "Full",
+                minimal_ok ? "" : ", text registers not kept across blocks");
+#ifdef HW_SHA_DMA
+  nerd_sha_dma* dma = nerd_sha_dma_init();
+  bool dma_ok = dma && nerd_sha_dma_check(dma);
+  bool use_dma = dma_ok;
+  Serial.printf("[MINER] %d SHA blocks %s\n", miner_id, dma_ok ? "by DMA" : "by register writes, DMA unavailable");
+#endif
+#ifdef HW_SHA_OVERLAP
+  //Software sha256d in the peripheral's busy waits, nonces taken from the top of the range
+  bool overlap = true;
+  nerd_sha256d_slice sw;
+  uint32_t sw_hash[8];
+  uint64_t overlap_nonces[2] = { 0, 0 }; //hardware, software
+  uint64_t overlap_us = 0;
+  uint32_t overlap_report = millis();
+#endif
+#ifdef HW_SHA_AB
+  //Alternates the loops range by range, both rates printed every HW_SHA_REPORT_MS
+#if defined(HW_SHA_DMA)
+  static const char* const ab_names[2] = { "register writes", "DMA" };
+#elif defined(HW_SHA_OVERLAP)
+  static const char* const ab_names[2] = { "HW only", "HW + SW overlap" };
+#else
+  static const char* const ab_names[2] = { "full", "minimal writes" };
+#endif
+  uint64_t ab_nonces[2] = { 0, 0 };
+  uint64_t ab_us[2] = { 0, 0 };
+  uint32_t ab_report = millis();
+#endif
+
+  JobResult result_dropped; //Used when stratum is behind and the result ring is full
   uint8_t interResult[64];
   uint8_t hash[32];
   uint8_t digest_mid[32];
   uint8_t sha_buffer[64];
   uint32_t wdt_counter = 0;
+  uint32_t chunk_blocks = NONCE_CHUNK_BLOCKS_START;
 
 #ifdef VALIDATION
   uint8_t doubleHash[32];
-  uint32_t diget_mid[8];
-  uint32_t bake[16];
+  uint8_t sha_validation[64];
 #endif
 
   while (1)
   {
+    uint32_t nonce_start, nonce_count;
+    const JobTemplate* work = JobClaim(miner_id, chunk_blocks, nonce_start, nonce_count);
+    if (work)
     {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      if (result)
-      {
-        if (s_job_result_list.size() < 16)
-          s_job_result_list.push_back(result);
-        result.reset();
-      }
-      if (!s_job_request_list_hw.empty())
-      {
-        job = s_job_request_list_hw.front();
-        s_job_request_list_hw.pop_front();
-      } else
-        job.reset();
-    }
-    if (job)
-    {
-      result = std::make_shared<JobResult>();
-      result->id = job->id;
+      uint32_t time_start = micros();
+      JobResult* result = s_job_result_ring[miner_id].prepare();
+      if (!result)
+        result = &result_dropped;
+      result->id = work->id;
+      result->extranonce2 = work->extranonce2;
+      result->version = work->version;
       result->nonce = 0xFFFFFFFF;
-      result->nonce_count = job->nonce_count;
-      result->difficulty = job->difficulty;
-      uint8_t job_in_work = job->id & 0xFF;
-      memcpy(digest_mid, job->midstate, sizeof(digest_mid));
-      memcpy(sha_buffer, job->sha_buffer+64, sizeof(sha_buffer));
+      result->nonce_count = nonce_count;
+      result->difficulty = work->difficulty;
+      result->candidates = 0;
+      uint32_t job_epoch = work->epoch;
+      memcpy(digest_mid, work->hw_midstate, sizeof(digest_mid));
+      memcpy(sha_buffer, work->sha_buffer+64, sizeof(sha_buffer));
 #ifdef VALIDATION
-      nerd_mids(diget_mid, job->sha_buffer);
-      nerd_sha256_bake(diget_mid, job->sha_buffer+64, bake);
+      memcpy(sha_validation, work->sha_buffer+64, sizeof(sha_validation));
 #endif
 
+#ifdef HW_SHA_AB
+#if defined(HW_SHA_DMA)
+      use_dma = dma_ok && !use_dma;
+#elif defined(HW_SHA_OVERLAP)
+      overlap = !overlap;
+#else
+      minimal = minimal_ok && !minimal;
+#endif
+#endif
       esp_sha_acquire_hardware();
       REG_WRITE(SHA_MODE_REG, SHA2_256);
-      uint32_t nend = job->nonce_start + job->nonce_count;
-      for (uint32_t n = job->nonce_start; n < nend; ++n)
+      if (minimal)
+        nerd_sha_ll_clear_text_padding();
+#ifdef HW_SHA_DMA
+      bool range_dma = use_dma && nerd_sha_dma_begin(dma, sha_buffer);
+      if (use_dma && !range_dma)
       {
-        //nerd_sha_hal_wait_idle();
-        nerd_sha_ll_write_digest(digest_mid);
-        //nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256(sha_buffer, n);
-        //sha_ll_continue_block(SHA2_256);
-        REG_WRITE(SHA_CONTINUE_REG, 1);
-        
-        sha_ll_load(SHA2_256);
-        nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256_inter();
-        //sha_ll_start_block(SHA2_256);
-        REG_WRITE(SHA_START_REG, 1);
-        sha_ll_load(SHA2_256);
-        nerd_sha_hal_wait_idle();
+        //The channel could not take the SHA trigger back from the IDF's, register writes from now on
+        Serial.printf("[MINER] %d SHA blocks by register writes, GDMA connect failed\n", miner_id);
+        dma_ok = use_dma = false;
+      }
+#endif
+      //Offsets from nonce_start, the hardware counts up to end and the overlap takes end down
+      uint32_t end = nonce_count;
+#ifdef HW_SHA_OVERLAP
+      uint32_t sw_done = 0;   //Finished by the software, the top nonce_count - end of the range
+      bool sw_busy = false;
+#endif
+      uint32_t i;
+      for (i = 0; i < end; ++i)
+      {
+        uint32_t n = nonce_start + i; //Wraps at the end of the nonce space
+#ifdef HW_SHA_OVERLAP
+        if (overlap && !sw_busy && end - i > 1)
+        {
+          nerd_sha256d_slice_start(&sw, work->midstate, sha_buffer, nonce_start + --end);
+          sw_busy = true;
+        }
+        nerd_sha256d_slice* sw_step = sw_busy ? &sw : NULL;
+#else
+        nerd_sha256d_slice* sw_step = NULL;
+        uint32_t* sw_hash = NULL;
+#endif
+#ifdef HW_SHA_DMA
+        if (range_dma)
+          nerd_sha_dma_sha256d(dma, digest_mid, n, sw_step, (uint8_t*)sw_hash);
+        else
+#endif
+        nerd_sha_hw_sha256d(digest_mid, sha_buffer, n, minimal, sw_step, (uint8_t*)sw_hash);
         if (nerd_sha_ll_read_digest_if(hash))
         {
           //Serial.printf("Hw 16bit Share, nonce=0x%X\n", n);
 #ifdef VALIDATION
           //Validation
-          ((uint32_t*)(job->sha_buffer+64+12))[0] = n;
-          nerd_sha256d_baked(diget_mid, job->sha_buffer+64, bake, doubleHash);
-          for (int i = 0; i < 32; ++i)
+          ((uint32_t*)(sha_validation+12))[0] = n;
+          nerd_sha256d_baked(work->midstate, sha_validation, work->bake, doubleHash, nerd_zero_bits_mask(NERD_ZERO_BITS_MIN));
+          for (int b = 0; b < 32; ++b)
           {
-            if (hash[i] != doubleHash[i])
+            if (hash[b] != doubleHash[b])
             {
               Serial.println("***HW sha256 esp32s3 bug detected***");
               break;
             }
           }
 #endif
-          //~5 per second
-          double diff_hash = diff_from_target(hash);
-          if (diff_hash > result->difficulty)
-          {
-            if (isSha256Valid(hash))
-            {
-              result->difficulty = diff_hash;
-              result->nonce = n;
-              memcpy(result->hash, hash, sizeof(hash));
-            }
-          }
+          nerd_sha_hw_candidate(result, hash, n);
         }
+#ifdef HW_SHA_OVERLAP
+        if (sw_busy && sw.round == 128)
+        {
+          //Same 16 zero bits as nerd_sha_ll_read_digest_if
+          if ((uint16_t)(sw_hash[7] >> 16) == 0)
+            nerd_sha_hw_candidate(result, (uint8_t*)sw_hash, sw.nonce);
+          sw_busy = false;
+          sw_done++;
+        }
+#endif
         if (
-             (uint8_t)(n & 0xFF) == 0 &&
-             s_working_current_job_id != job_in_work)
+             (n & (JOB_EPOCH_STRIDE-1)) == 0 &&
+             s_job_epoch.load(std::memory_order_relaxed) != job_epoch)
         {
-          result->nonce_count = n-job->nonce_start+1;
+          //The software nonce in flight is dropped unhashed
+#ifdef HW_SHA_OVERLAP
+          result->nonce_count = i+1+sw_done;
+#else
+          result->nonce_count = i+1;
+#endif
           break;
         }
       }
+#ifdef HW_SHA_OVERLAP
+      if (sw_busy && i == end)
+      {
+        //The last nonce of the range, the hardware is done
+        while (!nerd_sha256d_slice_step(&sw, 128, (uint8_t*)sw_hash))
+        {}
+        if ((uint16_t)(sw_hash[7] >> 16) == 0)
+          nerd_sha_hw_candidate(result, (uint8_t*)sw_hash, sw.nonce);
+        sw_done++;
+      }
+#endif
+#ifdef HW_SHA_DMA
+      if (range_dma)
+        nerd_sha_dma_end(dma);
+#endif
       esp_sha_release_hardware();
+      uint32_t elapsed = MinerStatsRange(miner_id, work, result, nonce_count, time_start);
+#ifdef HW_SHA_OVERLAP
+      if (overlap)
+      {
+        overlap_nonces[0] += result->nonce_count - sw_done;
+        overlap_nonces[1] += sw_done;
+        overlap_us += elapsed;
+      }
+      if (millis() - overlap_report >= HW_SHA_REPORT_MS && overlap_us)
+      {
+        Serial.printf("[MINER] %d HW %.1f KH/s + SW %.1f KH/s = %.1f KH/s\n", miner_id,
+                      overlap_nonces[0] * 1000.0 / overlap_us, overlap_nonces[1] * 1000.0 / overlap_us,
+                      (overlap_nonces[0] + overlap_nonces[1]) * 1000.0 / overlap_us);
+        overlap_nonces[0] = overlap_nonces[1] = overlap_us = 0;
+        overlap_report = millis();
+      }
+#endif
+#ifdef HW_SHA_AB
+#if defined(HW_SHA_DMA)
+      bool ab = range_dma;
+#elif defined(HW_SHA_OVERLAP)
+      bool ab = overlap;
+#else
+      bool ab = minimal;
+#endif
+      ab_nonces[ab] += result->nonce_count;
+      ab_us[ab] += elapsed;
+      if (millis() - ab_report >= HW_SHA_REPORT_MS && ab_us[0] && ab_us[1])
+      {
+        Serial.printf("[HW A/B] %s %.1f KH/s, %s %.1f KH/s (%+.1f%%)\n",
+                      ab_names[0], ab_nonces[0] * 1000.0 / ab_us[0], ab_names[1], ab_nonces[1] * 1000.0 / ab_us[1],
+                      100.0 * ((double)ab_nonces[1] * ab_us[0] / ((double)ab_nonces[0] * ab_us[1]) - 1));
+        ab_nonces[0] = ab_nonces[1] = ab_us[0] = ab_us[1] = 0;
+        ab_report = millis();
+      }
+#endif
+      chunk_blocks = nonce_chunk_blocks(chunk_blocks, result->nonce_count, elapsed);
+      if (result != &result_dropped)
+        s_job_result_ring[miner_id].commit();
     } else
-      vTaskDelay(2 / portTICK_PERIOD_MS);
+    {
+      uint32_t time_start = micros();
+      vTaskDelay(2 / portTICK_PERIOD_MS); //No job yet, or its nonce range is used up
+      MinerStatsIdle(miner_id, micros() - time_start);
+    }
 
     wdt_counter++;
     if (wdt_counter >= 8)
@@ -949,22 +1808,22 @@ static inline void nerd_sha_ll_fill_text_block_sha256(const void *input_text)
     uint32_t *data_words = (uint32_t *)input_text;
     uint32_t *reg_addr_buf = (uint32_t *)(SHA_TEXT_BASE);
 
-    reg_addr_buf[0]  = data_words[0];
-    reg_addr_buf[1]  = data_words[1];
-    reg_addr_buf[2]  = data_words[2];
-    reg_addr_buf[3]  = data_words[3];
-    reg_addr_buf[4]  = data_words[4];
-    reg_addr_buf[5]  = data_words[5];
-    reg_addr_buf[6]  = data_words[6];
-    reg_addr_buf[7]  = data_words[7];
-    reg_addr_buf[8]  = data_words[8];
-    reg_addr_buf[9]  = data_words[9];
-    reg_addr_buf[10] = data_words[10];
-    reg_addr_buf[11] = data_words[11];
-    reg_addr_buf[12] = data_words[12];
-    reg_addr_buf[13] = data_words[13];
-    reg_addr_buf[14] = data_words[14];
-    reg_addr_buf[15] = data_words[15];
+    DPORT_REG_WRITE(&reg_addr_buf[0], data_words[0]);
+    DPORT_REG_WRITE(&reg_addr_buf[1], data_words[1]);
+    DPORT_REG_WRITE(&reg_addr_buf[2], data_words[2]);
+    DPORT_REG_WRITE(&reg_addr_buf[3], data_words[3]);
+    DPORT_REG_WRITE(&reg_addr_buf[4], data_words[4]);
+    DPORT_REG_WRITE(&reg_addr_buf[5], data_words[5]);
+    DPORT_REG_WRITE(&reg_addr_buf[6], data_words[6]);
+    DPORT_REG_WRITE(&reg_addr_buf[7], data_words[7]);
+    DPORT_REG_WRITE(&reg_addr_buf[8], data_words[8]);
+    DPORT_REG_WRITE(&reg_addr_buf[9], data_words[9]);
+    DPORT_REG_WRITE(&reg_addr_buf[10], data_words[10]);
+    DPORT_REG_WRITE(&reg_addr_buf[11], data_words[11]);
+    DPORT_REG_WRITE(&reg_addr_buf[12], data_words[12]);
+    DPORT_REG_WRITE(&reg_addr_buf[13], data_words[13]);
+    DPORT_REG_WRITE(&reg_addr_buf[14], data_words[14]);
+    DPORT_REG_WRITE(&reg_addr_buf[15], data_words[15]);
 }
 
 static inline void nerd_sha_ll_fill_text_block_sha256_upper(const void *input_text, uint32_t nonce)
@@ -972,36 +1831,36 @@ static inline void nerd_sha_ll_fill_text_block_sha256_upper(const void *input_te
     uint32_t *data_words = (uint32_t *)input_text;
     uint32_t *reg_addr_buf = (uint32_t *)(SHA_TEXT_BASE);
 
-    reg_addr_buf[0]  = data_words[0];
-    reg_addr_buf[1]  = data_words[1];
-    reg_addr_buf[2]  = data_words[2];
-    reg_addr_buf[3]  = __builtin_bswap32(nonce);
+    DPORT_REG_WRITE(&reg_addr_buf[0], data_words[0]);
+    DPORT_REG_WRITE(&reg_addr_buf[1], data_words[1]);
+    DPORT_REG_WRITE(&reg_addr_buf[2], data_words[2]);
+    DPORT_REG_WRITE(&reg_addr_buf[3], __builtin_bswap32(nonce));
 #if 1
-    reg_addr_buf[4]  = 0x80000000;
-    reg_addr_buf[5]  = 0x00000000;
-    reg_addr_buf[6]  = 0x00000000;
-    reg_addr_buf[7]  = 0x00000000;
-    reg_addr_buf[8]  = 0x00000000;
-    reg_addr_buf[9]  = 0x00000000;
-    reg_addr_buf[10] = 0x00000000;
-    reg_addr_buf[11] = 0x00000000;
-    reg_addr_buf[12] = 0x00000000;
-    reg_addr_buf[13] = 0x00000000;
-    reg_addr_buf[14] = 0x00000000;
-    reg_addr_buf[15] = 0x00000280;
+    DPORT_REG_WRITE(&reg_addr_buf[4], 0x80000000);
+    DPORT_REG_WRITE(&reg_addr_buf[5], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[6], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[7], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[8], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[9], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[10], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[11], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[12], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[13], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[14], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[15], 0x00000280);
 #else
-    reg_addr_buf[4]  = data_words[4];
-    reg_addr_buf[5]  = data_words[5];
-    reg_addr_buf[6]  = data_words[6];
-    reg_addr_buf[7]  = data_words[7];
-    reg_addr_buf[8]  = data_words[8];
-    reg_addr_buf[9]  = data_words[9];
-    reg_addr_buf[10] = data_words[10];
-    reg_addr_buf[11] = data_words[11];
-    reg_addr_buf[12] = data_words[12];
-    reg_addr_buf[13] = data_words[13];
-    reg_addr_buf[14] = data_words[14];
-    reg_addr_buf[15] = data_words[15];
+    DPORT_REG_WRITE(&reg_addr_buf[4], data_words[4]);
+    DPORT_REG_WRITE(&reg_addr_buf[5], data_words[5]);
+    DPORT_REG_WRITE(&reg_addr_buf[6], data_words[6]);
+    DPORT_REG_WRITE(&reg_addr_buf[7], data_words[7]);
+    DPORT_REG_WRITE(&reg_addr_buf[8], data_words[8]);
+    DPORT_REG_WRITE(&reg_addr_buf[9], data_words[9]);
+    DPORT_REG_WRITE(&reg_addr_buf[10], data_words[10]);
+    DPORT_REG_WRITE(&reg_addr_buf[11], data_words[11]);
+    DPORT_REG_WRITE(&reg_addr_buf[12], data_words[12]);
+    DPORT_REG_WRITE(&reg_addr_buf[13], data_words[13]);
+    DPORT_REG_WRITE(&reg_addr_buf[14], data_words[14]);
+    DPORT_REG_WRITE(&reg_addr_buf[15], data_words[15]);
 #endif
 }
 
@@ -1011,89 +1870,88 @@ static inline void nerd_sha_ll_fill_text_block_sha256_double()
 
 #if 0
     //No change
-    reg_addr_buf[0]  = data_words[0];
-    reg_addr_buf[1]  = data_words[1];
-    reg_addr_buf[2]  = data_words[2];
-    reg_addr_buf[3]  = data_words[3];
-    reg_addr_buf[4]  = data_words[4];
-    reg_addr_buf[5]  = data_words[5];
-    reg_addr_buf[6]  = data_words[6];
-    reg_addr_buf[7]  = data_words[7];
+    DPORT_REG_WRITE(&reg_addr_buf[0], data_words[0]);
+    DPORT_REG_WRITE(&reg_addr_buf[1], data_words[1]);
+    DPORT_REG_WRITE(&reg_addr_buf[2], data_words[2]);
+    DPORT_REG_WRITE(&reg_addr_buf[3], data_words[3]);
+    DPORT_REG_WRITE(&reg_addr_buf[4], data_words[4]);
+    DPORT_REG_WRITE(&reg_addr_buf[5], data_words[5]);
+    DPORT_REG_WRITE(&reg_addr_buf[6], data_words[6]);
+    DPORT_REG_WRITE(&reg_addr_buf[7], data_words[7]);
 #endif
-    reg_addr_buf[8]  = 0x80000000;
-    reg_addr_buf[9]  = 0x00000000;
-    reg_addr_buf[10] = 0x00000000;
-    reg_addr_buf[11] = 0x00000000;
-    reg_addr_buf[12] = 0x00000000;
-    reg_addr_buf[13] = 0x00000000;
-    reg_addr_buf[14] = 0x00000000;
-    reg_addr_buf[15] = 0x00000100;
+    DPORT_REG_WRITE(&reg_addr_buf[8], 0x80000000);
+    DPORT_REG_WRITE(&reg_addr_buf[9], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[10], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[11], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[12], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[13], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[14], 0x00000000);
+    DPORT_REG_WRITE(&reg_addr_buf[15], 0x00000100);
+}
+
+//sha256d of the header in sha_buffer (swapped words) with nonce, engine locked. The result
+//is left in the text registers for nerd_sha_ll_read_digest_swap_if
+static inline void nerd_sha_hw_sha256d(const void* sha_buffer, uint32_t nonce)
+{
+  //First block of the header
+  nerd_sha_ll_fill_text_block_sha256(sha_buffer);
+  sha_ll_start_block(SHA2_256);
+
+  //Second block with the nonce
+  nerd_sha_hal_wait_idle();
+  nerd_sha_ll_fill_text_block_sha256_upper((const uint8_t*)sha_buffer+64, nonce);
+  sha_ll_continue_block(SHA2_256);
+
+  nerd_sha_hal_wait_idle();
+  sha_ll_load(SHA2_256);
+
+  //LOAD put the first hash in text words 0..7, the second hash pads it
+  nerd_sha_hal_wait_idle();
+  nerd_sha_ll_fill_text_block_sha256_double();
+  sha_ll_start_block(SHA2_256);
+
+  nerd_sha_hal_wait_idle();
+  sha_ll_load(SHA2_256);
+  nerd_sha_hal_wait_idle(); //LOAD keeps the engine busy too, see sha_hal_read_digest
 }
 
 void minerWorkerHw(void * task_id)
 {
-  unsigned int miner_id = (uint32_t)task_id;
+  unsigned int miner_id = (uint32_t)(uintptr_t)task_id;
   Serial.printf("[MINER] %d Started minerWorkerHwEsp32D Task!\n", miner_id);
 
-  std::shared_ptr<JobRequest> job;
-  std::shared_ptr<JobResult> result;
+  JobResult result_dropped; //Used when stratum is behind and the result ring is full
   uint8_t hash[32];
   uint8_t sha_buffer[128];
+  uint32_t chunk_blocks = NONCE_CHUNK_BLOCKS_START;
 
   while (1)
   {
+    uint32_t nonce_start, nonce_count;
+    const JobTemplate* work = JobClaim(miner_id, chunk_blocks, nonce_start, nonce_count);
+    if (work)
     {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      if (result)
-      {
-        if (s_job_result_list.size() < 16)
-          s_job_result_list.push_back(result);
-        result.reset();
-      }
-      if (!s_job_request_list_hw.empty())
-      {
-        job = s_job_request_list_hw.front();
-        s_job_request_list_hw.pop_front();
-      } else
-        job.reset();
-    }
-    if (job)
-    {
-      result = std::make_shared<JobResult>();
-      result->id = job->id;
+      uint32_t time_start = micros();
+      JobResult* result = s_job_result_ring[miner_id].prepare();
+      if (!result)
+        result = &result_dropped;
+      result->id = work->id;
+      result->extranonce2 = work->extranonce2;
+      result->version = work->version;
       result->nonce = 0xFFFFFFFF;
-      result->nonce_count = job->nonce_count;
-      result->difficulty = job->difficulty;
-      uint8_t job_in_work = job->id & 0xFF;
-      memcpy(sha_buffer, job->sha_buffer, 80);
+      result->nonce_count = nonce_count;
+      result->difficulty = work->difficulty;
+      result->candidates = 0;
+      uint32_t job_epoch = work->epoch;
+      memcpy(sha_buffer, work->hw_sha_buffer, 80);
 
       esp_sha_lock_engine(SHA2_256);
-      for (uint32_t n = 0; n < job->nonce_count; ++n)
+      for (uint32_t n = 0; n < nonce_count; ++n)
       {
-        //((uint32_t*)(sha_buffer+64+12))[0] = __builtin_bswap32(job->nonce_start+n);
-
-        //sha_hal_hash_block(SHA2_256, s_test_buffer, 64/4, true);
-        //nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256(sha_buffer);
-        sha_ll_start_block(SHA2_256);
-
-        //sha_hal_hash_block(SHA2_256, s_test_buffer+64, 64/4, false);
-        nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256_upper(sha_buffer+64, job->nonce_start+n);
-        sha_ll_continue_block(SHA2_256);
-
-        nerd_sha_hal_wait_idle();
-        sha_ll_load(SHA2_256);
-
-        //sha_hal_hash_block(SHA2_256, interResult, 64/4, true);
-        nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256_double();
-        sha_ll_start_block(SHA2_256);
-
-        nerd_sha_hal_wait_idle();
-        sha_ll_load(SHA2_256);
+        nerd_sha_hw_sha256d(sha_buffer, nonce_start+n);
         if (nerd_sha_ll_read_digest_swap_if(hash))
         {
+          result->candidates++;
           //~5 per second
           double diff_hash = diff_from_target(hash);
           if (diff_hash > result->difficulty)
@@ -1101,22 +1959,30 @@ void minerWorkerHw(void * task_id)
             if (isSha256Valid(hash))
             {
               result->difficulty = diff_hash;
-              result->nonce = job->nonce_start+n;
+              result->nonce = nonce_start+n;
               memcpy(result->hash, hash, sizeof(hash));
             }
           }
         }
         if (
-             (uint8_t)(n & 0xFF) == 0 &&
-             s_working_current_job_id != job_in_work)
+             (n & (JOB_EPOCH_STRIDE-1)) == 0 &&
+             s_job_epoch.load(std::memory_order_relaxed) != job_epoch)
         {
           result->nonce_count = n+1;
           break;
         }
       }
       esp_sha_unlock_engine(SHA2_256);
+      uint32_t elapsed = MinerStatsRange(miner_id, work, result, nonce_count, time_start);
+      chunk_blocks = nonce_chunk_blocks(chunk_blocks, result->nonce_count, elapsed);
+      if (result != &result_dropped)
+        s_job_result_ring[miner_id].commit();
     } else
-      vTaskDelay(2 / portTICK_PERIOD_MS);
+    {
+      uint32_t time_start = micros();
+      vTaskDelay(2 / portTICK_PERIOD_MS); //No job yet, or its nonce range is used up
+      MinerStatsIdle(miner_id, micros() - time_start);
+    }
 
     esp_task_wdt_reset();
   }
@@ -1126,6 +1992,133 @@ void minerWorkerHw(void * task_id)
 
 #endif  //HARDWARE_SHA265
 
+#define BENCH_STRIDE 1024   //Nonces between two looks at the clock
+
+//Hashing benchmark, see sha_bench.h: the miners' own inner loops on sha_bench_header for
+//duration_ms, in the calling task. Nothing else should be mining. false when the kernel is
+//not in this build or its peripheral is not usable
+bool minerBenchKernel(ShaBenchKernel kernel, uint32_t duration_ms, uint64_t &hashes, uint32_t &elapsed_us)
+{
+  static JobTemplate work;
+  memset(&work, 0, sizeof(work));
+  memcpy(work.sha_buffer, sha_bench_header, sizeof(sha_bench_header));
+  work.sha_buffer[80] = 0x80;
+  work.sha_buffer[126] = 0x02;
+  work.sha_buffer[127] = 0x80;
+  work.zero_mask = nerd_zero_bits_mask(NERD_ZERO_BITS_MIN);
+  JobTemplateHash(&work, false);
+
+  bool available = kernel <= SHA_BENCH_SW_BAKED_X4;
+#if defined(HARDWARE_SHA265) && (defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3))
+  bool minimal = false;
+  if (kernel == SHA_BENCH_HW_PIO)
+  {
+    minimal = HW_SHA_MINIMAL_WRITES && nerd_sha_hw_minimal_check();
+    available = true;
+  }
+#ifdef HW_SHA_DMA
+  static nerd_sha_dma* dma = NULL;
+  static bool dma_ok = false;
+  if (kernel == SHA_BENCH_HW_DMA)
+  {
+    if (!dma)
+      dma_ok = (dma = nerd_sha_dma_init()) != NULL && nerd_sha_dma_check(dma);
+    available = dma_ok;
+  }
+#endif
+#endif
+#if defined(HARDWARE_SHA265) && defined(CONFIG_IDF_TARGET_ESP32)
+  available |= kernel == SHA_BENCH_HW_ESP32;
+#endif
+  if (!available)
+    return false;
+
+  nerdSHA256_context ctx;
+  memcpy(ctx.digest, work.midstate, sizeof(ctx.digest));
+  uint8_t sha_buffer[64];
+  memcpy(sha_buffer, work.sha_buffer+64, sizeof(sha_buffer));
+  uint8_t hash[4][32];
+  uint32_t nonce = 0;
+  uint32_t time_start = micros();
+  do
+  {
+    switch (kernel)
+    {
+      case SHA_BENCH_SW_SHA256D:
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; ++n)
+        {
+          ((uint32_t*)(sha_buffer+12))[0] = n;
+          nerd_sha256d(&ctx, sha_buffer, hash[0]);
+        }
+        break;
+      case SHA_BENCH_SW_BAKED:
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; ++n)
+        {
+          ((uint32_t*)(sha_buffer+12))[0] = n;
+          nerd_sha256d_baked(work.midstate, sha_buffer, work.bake, hash[0], work.zero_mask);
+        }
+        break;
+      case SHA_BENCH_SW_BAKED_X2:
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; n += 2)
+          nerd_sha256d_baked_x2(work.midstate, work.bake, n, hash[0], work.zero_mask);
+        break;
+      case SHA_BENCH_SW_BAKED_X4:
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; n += 4)
+          nerd_sha256d_baked_x4(work.midstate, work.bake, n, hash[0], work.zero_mask);
+        break;
+#if defined(HARDWARE_SHA265) && (defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3))
+      case SHA_BENCH_HW_PIO:
+        //A range of minerWorkerHw
+        esp_sha_acquire_hardware();
+        REG_WRITE(SHA_MODE_REG, SHA2_256);
+        if (minimal)
+          nerd_sha_ll_clear_text_padding();
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; ++n)
+        {
+          nerd_sha_hw_sha256d(work.hw_midstate, sha_buffer, n, minimal);
+          nerd_sha_ll_read_digest_if(hash[0]);
+        }
+        esp_sha_release_hardware();
+        break;
+#ifdef HW_SHA_DMA
+      case SHA_BENCH_HW_DMA:
+        esp_sha_acquire_hardware();
+        if (!nerd_sha_dma_begin(dma, sha_buffer))
+        {
+          esp_sha_release_hardware();
+          return false;
+        }
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; ++n)
+        {
+          nerd_sha_dma_sha256d(dma, work.hw_midstate, n);
+          nerd_sha_ll_read_digest_if(hash[0]);
+        }
+        nerd_sha_dma_end(dma);
+        esp_sha_release_hardware();
+        break;
+#endif
+#endif
+#if defined(HARDWARE_SHA265) && defined(CONFIG_IDF_TARGET_ESP32)
+      case SHA_BENCH_HW_ESP32:
+        esp_sha_lock_engine(SHA2_256);
+        for (uint32_t n = nonce; n < nonce + BENCH_STRIDE; ++n)
+        {
+          nerd_sha_hw_sha256d(work.hw_sha_buffer, n);
+          nerd_sha_ll_read_digest_swap_if(hash[0]);
+        }
+        esp_sha_unlock_engine(SHA2_256);
+        break;
+#endif
+      default:
+        break;
+    }
+    nonce += BENCH_STRIDE;
+  } while (micros() - time_start < duration_ms * 1000ull);
+  elapsed_us = micros() - time_start;
+  hashes = nonce;
+  return true;
+}
+
 
 #define DELAY 100
 #define REDRAW_EVERY 10
@@ -1203,6 +2196,30 @@ void resetStat() {
     saveStat();
 }
 
+#ifdef DEBUG_MINING
+//Per miner rates since the previous report, shows whether the HW or the SW miner is starving
+static void MinerStatsReport()
+{
+  static miner_counters s_last[MINER_TASKS];
+  miner_counters now[MINER_TASKS];
+  int miners = getMinerCounters(now, MINER_TASKS);
+  for (int miner_id = 0; miner_id < miners; ++miner_id)
+  {
+    const miner_counters& last = s_last[miner_id];
+    uint64_t busy_us = now[miner_id].busy_us - last.busy_us;
+    uint64_t total_us = busy_us + (now[miner_id].idle_us - last.idle_us);
+    if (total_us == 0)
+      total_us = 1;
+    Serial.printf("[MINER] %d: %.1f KH/s, busy %.1f%%, ranges %u done %u aborted, %u candidates, stale %u nonces %u us\n", miner_id,
+                  (now[miner_id].nonces - last.nonces) * 1000.0 / total_us, busy_us * 100.0 / total_us,
+                  now[miner_id].jobs_completed - last.jobs_completed, now[miner_id].jobs_aborted - last.jobs_aborted,
+                  now[miner_id].candidates - last.candidates,
+                  (uint32_t)(now[miner_id].stale_nonces - last.stale_nonces), (uint32_t)(now[miner_id].stale_us - last.stale_us));
+    s_last[miner_id] = now[miner_id];
+  }
+}
+#endif
+
 void runMonitor(void *name)
 {
 
@@ -1275,6 +2292,11 @@ void runMonitor(void *name)
       Serial.printf("### Max stack usage: %d\n", uxTaskGetStackHighWaterMark(NULL));
       #endif
 
+      #ifdef DEBUG_MINING
+      if (upTime % 10 == 0)
+        MinerStatsReport();
+      #endif
+
       seconds_elapsed++;
 
       if(seconds_elapsed % (saveIntervals[currentIntervalIndex]) == 0){
@@ -2,6 +2,8 @@
 #ifndef MINING_API_H
 #define MINING_API_H
 
+#include "sha_bench.h"
+
 // Mining
 #define MAX_NONCE_STEP  5000000U
 #define MAX_NONCE       25000000U
@@ -19,15 +21,34 @@
 void runMonitor(void *name);
 
 void runStratumWorker(void *name);
+void runJobDispatcher(void *name);
 void runMiner(void *name);
 
 void minerWorkerSw(void * task_id);
 void minerWorkerHw(void * task_id);
 
+//One benchmark kernel for duration_ms on sha_bench_header, false when not in this build
+bool minerBenchKernel(ShaBenchKernel kernel, uint32_t duration_ms, uint64_t &hashes, uint32_t &elapsed_us);
+
 String printLocalTime(void);
 
 void resetStat();
 
+//Per miner task counters since boot, see getMinerCounters
+typedef struct{
+  uint64_t nonces;
+  uint64_t busy_us;         //Hashing claimed ranges
+  uint64_t idle_us;         //No job or no range left to claim
+  uint32_t jobs_completed;  //Ranges hashed to the end
+  uint32_t jobs_aborted;    //Ranges left early on a job change
+  uint32_t candidates;      //Nonces passing the early reject filter
+  uint64_t stale_nonces;    //Hashed after a new job was published, estimated
+  uint64_t stale_us;
+} miner_counters;
+
+//Lock free snapshot for up to max_miners miner tasks, returns how many were filled
+int getMinerCounters(miner_counters* counters, int max_miners);
+
 typedef struct{
   uint8_t bytearray_target[32];
   uint8_t bytearray_pooltarget[32];
@@ -0,0 +1,76 @@
+#ifndef NONCE_CURSOR_H
+#define NONCE_CURSOR_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Nonces are handed out in blocks of NONCE_BLOCK, the miners check for a new job every 256 nonces anyway
+#define NONCE_BLOCK               256
+#define NONCE_BLOCKS_MAX          0xFFFFFF    // 24 bit block position, last block of the nonce space unused
+
+// Claim size: about NONCE_CHUNK_US of work at the miner's measured rate, ~10 results per second
+#define NONCE_CHUNK_US            100000
+#define NONCE_CHUNK_BLOCKS_START  16          // 4096 nonces until the first rate is known
+#define NONCE_CHUNK_BLOCKS_MIN    1
+#define NONCE_CHUNK_BLOCKS_MAX    1024
+
+// Shared nonce range cursor: job id in the top 8 bits, next free block in the low 24.
+// Stratum reset()s it for every new job, the miner tasks claim() ranges from it with a CAS,
+// so whoever is faster takes more and nobody waits for a refill.
+class NonceCursor
+{
+public:
+    NonceCursor() : cursor_(0) {}
+
+    void reset(uint8_t job_id)
+    {
+        cursor_.store((uint32_t)job_id << 24, std::memory_order_release);
+    }
+
+    uint8_t job_id() const { return cursor_.load(std::memory_order_acquire) >> 24; }
+
+    // Next free block of job_id, 0xFFFFFFFF once the cursor belongs to another job
+    uint32_t position(uint8_t job_id) const
+    {
+        uint32_t cursor = cursor_.load(std::memory_order_acquire);
+        return (cursor >> 24) == job_id ? cursor & 0xFFFFFF : 0xFFFFFFFF;
+    }
+
+    // Up to blocks blocks of job_id below limit (<= NONCE_BLOCKS_MAX).
+    // 0 when the cursor belongs to another job or the range is used up
+    uint32_t claim(uint8_t job_id, uint32_t limit, uint32_t blocks, uint32_t& first_block)
+    {
+        uint32_t cursor = cursor_.load(std::memory_order_relaxed);
+        uint32_t claimed;
+        do
+        {
+            if ((cursor >> 24) != job_id)
+                return 0;
+            first_block = cursor & 0xFFFFFF;
+            if (first_block >= limit)
+                return 0;
+            claimed = limit - first_block;
+            if (claimed > blocks)
+                claimed = blocks;
+        } while (!cursor_.compare_exchange_weak(cursor, cursor + claimed, std::memory_order_acq_rel, std::memory_order_relaxed));
+        return claimed;
+    }
+
+private:
+    std::atomic<uint32_t> cursor_;
+};
+
+// Next claim size after doing nonces in elapsed_us with a claim of blocks, halfway to the target
+static inline uint32_t nonce_chunk_blocks(uint32_t blocks, uint32_t nonces, uint32_t elapsed_us)
+{
+    uint64_t target = NONCE_CHUNK_BLOCKS_MAX;
+    if (elapsed_us)
+        target = (uint64_t)nonces * NONCE_CHUNK_US / elapsed_us / NONCE_BLOCK;
+    if (target < NONCE_CHUNK_BLOCKS_MIN)
+        target = NONCE_CHUNK_BLOCKS_MIN;
+    if (target > NONCE_CHUNK_BLOCKS_MAX)
+        target = NONCE_CHUNK_BLOCKS_MAX;
+    return (blocks + (uint32_t)target + 1) / 2;
+}
+
+#endif // NONCE_CURSOR_H
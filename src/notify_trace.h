@@ -0,0 +1,239 @@
+#ifndef NOTIFY_TRACE_H
+#define NOTIFY_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+// Notify to first hash latency: one timestamp per stage a new job goes through, from the
+// socket read that completed the notify line to the first nonce range a miner claims of it.
+// The firmware marks compile to nothing unless built with -D NOTIFY_TRACE
+enum NotifyStage
+{
+    TRACE_RECEIVED,         // read() that completed the line
+    TRACE_FRAMED,
+    TRACE_PARSED,
+    TRACE_JOB,              // binary mining_job filled
+    TRACE_COINBASE,
+    TRACE_MERKLE,
+    TRACE_HEADER,
+    TRACE_POSTED,           // dispatch request committed
+    TRACE_DISPATCHED,
+    TRACE_MIDSTATE,
+    TRACE_BAKED,
+    TRACE_HW_MIDSTATE,
+    TRACE_PUBLISHED,
+    TRACE_FIRST_CLAIM,
+    TRACE_STAGES
+};
+
+static const char* const s_notify_stage_names[TRACE_STAGES] = {
+    "received", "framed", "parsed", "job", "coinbase", "merkle", "header",
+    "posted", "dispatched", "midstate", "baked", "hw_midstate", "published", "first_claim",
+};
+
+#define NOTIFY_TRACE_SLOTS    4     // jobs in flight, by job id
+#define NOTIFY_TRACE_BUCKETS  21    // log2 buckets of a stage time, the last one open ended
+#define NOTIFY_TRACE_REPORT   16    // records between two histogram reports
+
+struct NotifyTraceRecord
+{
+    uint32_t job_id;
+    uint32_t stamp[TRACE_STAGES];   // 0 when the stage was not reached
+};
+
+// The stratum task fills the open record until the job has an id, post() hands it to the
+// dispatcher and the miners, collect() gives it back once a miner claimed from the job
+class NotifyTracer
+{
+public:
+    NotifyTracer()
+    {
+        memset(&open_, 0, sizeof(open_));
+        for (int s = 0; s < NOTIFY_TRACE_SLOTS; ++s)
+        {
+            slots_[s].job_id.store(0xFFFFFFFF, std::memory_order_relaxed);
+            slots_[s].reported.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // Stratum task, before post()
+    void stage(NotifyStage stage, uint32_t now) { open_.stamp[stage] = now ? now : 1; }
+
+    // Stratum task, right before the dispatch request is committed
+    void post(uint32_t job_id, uint32_t now)
+    {
+        stage(TRACE_POSTED, now);
+        Slot& slot = slots_[job_id % NOTIFY_TRACE_SLOTS];
+        slot.job_id.store(0xFFFFFFFF, std::memory_order_relaxed);
+        for (int s = 0; s < TRACE_STAGES; ++s)
+            slot.stamp[s].store(s <= TRACE_POSTED ? open_.stamp[s] : 0, std::memory_order_relaxed);
+        slot.reported.store(false, std::memory_order_relaxed);
+        slot.job_id.store(job_id, std::memory_order_release);
+        memset(&open_, 0, sizeof(open_));
+    }
+
+    // Dispatcher, marks for a job that was already replaced are dropped
+    void mark(uint32_t job_id, NotifyStage stage, uint32_t now)
+    {
+        Slot& slot = slots_[job_id % NOTIFY_TRACE_SLOTS];
+        if (slot.job_id.load(std::memory_order_acquire) == job_id)
+            slot.stamp[stage].store(now ? now : 1, std::memory_order_release);
+    }
+
+    // Miners, only the first claim of a job counts. One relaxed load once it is set
+    void first(uint32_t job_id, NotifyStage stage, uint32_t now)
+    {
+        Slot& slot = slots_[job_id % NOTIFY_TRACE_SLOTS];
+        uint32_t unset = 0;
+        if (slot.stamp[stage].load(std::memory_order_relaxed) == 0 && slot.job_id.load(std::memory_order_acquire) == job_id)
+            slot.stamp[stage].compare_exchange_strong(unset, now ? now : 1, std::memory_order_acq_rel);
+    }
+
+    // Stratum task: a job that reached its first claim and was not handed out yet
+    bool collect(NotifyTraceRecord& record)
+    {
+        for (int i = 0; i < NOTIFY_TRACE_SLOTS; ++i)
+        {
+            Slot& slot = slots_[i];
+            if (slot.reported.load(std::memory_order_relaxed) || slot.stamp[TRACE_FIRST_CLAIM].load(std::memory_order_acquire) == 0)
+                continue;
+            record.job_id = slot.job_id.load(std::memory_order_relaxed);
+            for (int s = 0; s < TRACE_STAGES; ++s)
+                record.stamp[s] = slot.stamp[s].load(std::memory_order_relaxed);
+            slot.reported.store(true, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> job_id;
+        std::atomic<uint32_t> stamp[TRACE_STAGES];
+        std::atomic<bool> reported;
+    };
+    NotifyTraceRecord open_;
+    Slot slots_[NOTIFY_TRACE_SLOTS];
+};
+
+// "job 12 2643us: framed 5 parsed 310 ..." time of every stage reached since the one before
+static inline size_t notify_trace_format(const NotifyTraceRecord& record, char* out, size_t size, const char* unit)
+{
+    uint32_t start = record.stamp[TRACE_RECEIVED];
+    uint32_t last = start;
+    int len = snprintf(out, size, "job %u %u%s:", record.job_id, record.stamp[TRACE_FIRST_CLAIM] - start, unit);
+    for (int s = TRACE_RECEIVED + 1; s < TRACE_STAGES && len > 0 && (size_t)len < size; ++s)
+    {
+        if (record.stamp[s] == 0)
+            continue;
+        len += snprintf(out + len, size - len, " %s %u", s_notify_stage_names[s], record.stamp[s] - last);
+        last = record.stamp[s];
+    }
+    return len;
+}
+
+// Per stage log2 histograms of the records added, plus the whole path as "total"
+class NotifyHistogram
+{
+public:
+    NotifyHistogram() { reset(); }
+
+    void reset() { memset(this, 0, sizeof(*this)); }
+
+    uint32_t count() const { return count_; }
+
+    void add(const NotifyTraceRecord& record)
+    {
+        uint32_t last = record.stamp[TRACE_RECEIVED];
+        for (int s = TRACE_RECEIVED + 1; s < TRACE_STAGES; ++s)
+        {
+            if (record.stamp[s] == 0)
+                continue;
+            sample(s, record.stamp[s] - last);
+            last = record.stamp[s];
+        }
+        sample(TOTAL, record.stamp[TRACE_FIRST_CLAIM] - record.stamp[TRACE_RECEIVED]);
+        count_++;
+    }
+
+    // Report line i, false past the last one. Stages that were never reached are left out
+    bool format(int line, char* out, size_t size, const char* unit) const
+    {
+        int row = TRACE_RECEIVED + 1;
+        for (; row <= TOTAL; ++row)
+        {
+            if (samples_[row] && line-- == 0)
+                break;
+        }
+        if (row > TOTAL)
+            return false;
+
+        int first = 0, last = NOTIFY_TRACE_BUCKETS - 1;
+        while (buckets_[row][first] == 0)
+            first++;
+        while (buckets_[row][last] == 0)
+            last--;
+        int len = snprintf(out, size, "%-12s n %4u  mean %8.1f  p50 < %7u  p90 < %7u  max %8u %s  |",
+                           row == TOTAL ? "total" : s_notify_stage_names[row], samples_[row],
+                           (double)sum_[row] / samples_[row], percentile(row, 50), percentile(row, 90), max_[row], unit);
+        // Counts from the first used bucket on, "<1" is the bucket of 0
+        len += snprintf(out + len, size - len, " <%u:", 1u << first);
+        for (int b = first; b <= last && len > 0 && (size_t)len < size; ++b)
+            len += snprintf(out + len, size - len, " %u", buckets_[row][b]);
+        return true;
+    }
+
+private:
+    static const int TOTAL = TRACE_STAGES;
+
+    void sample(int row, uint32_t value)
+    {
+        int bucket = value ? 32 - __builtin_clz(value) : 0;
+        if (bucket >= NOTIFY_TRACE_BUCKETS)
+            bucket = NOTIFY_TRACE_BUCKETS - 1;
+        buckets_[row][bucket]++;
+        samples_[row]++;
+        sum_[row] += value;
+        if (value > max_[row])
+            max_[row] = value;
+    }
+
+    // Upper bound of the bucket holding the percentile
+    uint32_t percentile(int row, uint32_t percent) const
+    {
+        uint32_t wanted = (samples_[row] * percent + 99) / 100;
+        uint32_t seen = 0;
+        for (int b = 0; b < NOTIFY_TRACE_BUCKETS; ++b)
+        {
+            seen += buckets_[row][b];
+            if (seen >= wanted)
+                return b < 31 ? 1u << b : 0xFFFFFFFF;
+        }
+        return 0xFFFFFFFF;
+    }
+
+    uint32_t count_;
+    uint32_t samples_[TRACE_STAGES + 1];
+    uint32_t max_[TRACE_STAGES + 1];
+    uint64_t sum_[TRACE_STAGES + 1];
+    uint32_t buckets_[TRACE_STAGES + 1][NOTIFY_TRACE_BUCKETS];
+};
+
+#ifdef NOTIFY_TRACE
+extern NotifyTracer g_notify_tracer;
+#define NOTIFY_TRACE_STAGE(trace_stage)         g_notify_tracer.stage(trace_stage, micros())
+#define NOTIFY_TRACE_MARK(job_id, trace_stage)  g_notify_tracer.mark(job_id, trace_stage, micros())
+#define NOTIFY_TRACE_POST(job_id)               g_notify_tracer.post(job_id, micros())
+#define NOTIFY_TRACE_FIRST(job_id)              g_notify_tracer.first(job_id, TRACE_FIRST_CLAIM, micros())
+#else
+#define NOTIFY_TRACE_STAGE(trace_stage)         ((void)0)
+#define NOTIFY_TRACE_MARK(job_id, trace_stage)  ((void)0)
+#define NOTIFY_TRACE_POST(job_id)               ((void)0)
+#define NOTIFY_TRACE_FIRST(job_id)              ((void)0)
+#endif
+
+#endif // NOTIFY_TRACE_H
@@ -0,0 +1,88 @@
+#ifndef SHA_BENCH_H
+#define SHA_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Hashing benchmark: every kernel hashes the same header for a fixed time and gives one JSON
+// line. The firmware (-D SHA_BENCHMARK or "bench" on the serial console) and the host
+// "bench --json" write the same schema, so results from boards and builds can be collected
+// and compared. Portable, also built by [env:native]
+//
+//   {"schema":1,"kernel":"sw_baked","target":"esp32s3","version":"V1.8.3","duration_ms":5000,
+//    "hashes":231000,"hashes_per_s":46200.0,"core":1,"core_load":[0.01,1.00],"free_heap":201432}
+//
+// core_load: busy fraction of every core while the kernel ran on "core", null where it is
+// not measured. free_heap: bytes after the run, 0 on the host
+#define SHA_BENCH_SCHEMA        1
+#ifndef SHA_BENCH_MS
+#define SHA_BENCH_MS            5000    // per kernel, -D to change
+#endif
+#define SHA_BENCH_CORES_MAX     2
+
+enum ShaBenchKernel
+{
+    SHA_BENCH_SW_SHA256D,   // nerd_sha256d
+    SHA_BENCH_SW_BAKED,     // nerd_sha256d_baked, minerWorkerSw's default
+    SHA_BENCH_SW_BAKED_X2,  // interleaved, -D NERD_SHA_LANES=2
+    SHA_BENCH_SW_BAKED_X4,
+    SHA_BENCH_HW_PIO,       // minerWorkerHw on S2/S3/C3, register writes
+    SHA_BENCH_HW_DMA,       // minerWorkerHw on S3 with -D HW_SHA_DMA
+    SHA_BENCH_HW_ESP32,     // minerWorkerHw on the ESP32 engine
+    SHA_BENCH_KERNELS
+};
+
+static inline const char* sha_bench_kernel_name(ShaBenchKernel kernel)
+{
+    static const char* const names[SHA_BENCH_KERNELS] = {
+        "sw_sha256d", "sw_baked", "sw_baked_x2", "sw_baked_x4", "hw_pio", "hw_dma", "hw_esp32"
+    };
+    return kernel < SHA_BENCH_KERNELS ? names[kernel] : "unknown";
+}
+
+// The header every kernel hashes, nonce words counting up from its own
+static const uint8_t sha_bench_header[80] = {
+    0x00, 0x00, 0x00, 0x22, 0x99, 0x44, 0xbb, 0xff, 0xbb, 0x00, 0x00, 0x77, 0x44, 0xcc, 0x11, 0x77,
+    0x88, 0x55, 0xbb, 0x44, 0x55, 0x00, 0x77, 0x88, 0x99, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xbb, 0xbb, 0x66, 0x11, 0x88, 0x33, 0x44, 0x99, 0xcc, 0x33, 0xff, 0x22,
+    0x11, 0xaa, 0x77, 0xee, 0xbb, 0x66, 0xee, 0xcc, 0xee, 0x66, 0xee, 0xdd, 0x77, 0x55, 0x22, 0x22,
+    0xcc, 0xcc, 0x66, 0xee, 0x22, 0xdd, 0x99, 0x66, 0x66, 0x88, 0x00, 0x11, 0x2e, 0x33, 0x41, 0x19,
+};
+
+struct ShaBenchResult
+{
+    ShaBenchKernel kernel;
+    const char* target;     // "esp32s3", "esp32", ... or "host"
+    const char* version;
+    uint64_t hashes;
+    uint32_t elapsed_us;
+    int core;
+    int cores;              // entries of core_load
+    float core_load[SHA_BENCH_CORES_MAX];   // 0..1, negative when not measured
+    uint32_t free_heap;
+};
+
+// The line with its newline, returns the length like snprintf
+static inline int sha_bench_json(char* out, size_t size, const ShaBenchResult& r)
+{
+    double rate = r.elapsed_us ? r.hashes * 1000000.0 / r.elapsed_us : 0;
+    char loads[16 * SHA_BENCH_CORES_MAX];
+    size_t used = 0;
+    for (int i = 0; i < r.cores && i < SHA_BENCH_CORES_MAX; ++i)
+    {
+        const char* sep = i ? "," : "";
+        if (r.core_load[i] < 0)
+            used += snprintf(loads + used, sizeof(loads) - used, "%snull", sep);
+        else
+            used += snprintf(loads + used, sizeof(loads) - used, "%s%.2f", sep, r.core_load[i]);
+    }
+    loads[used] = 0;
+    return snprintf(out, size,
+                    "{\"schema\":%d,\"kernel\":\"%s\",\"target\":\"%s\",\"version\":\"%s\",\"duration_ms\":%u,"
+                    "\"hashes\":%llu,\"hashes_per_s\":%.1f,\"core\":%d,\"core_load\":[%s],\"free_heap\":%u}\n",
+                    SHA_BENCH_SCHEMA, sha_bench_kernel_name(r.kernel), r.target, r.version, (unsigned)((r.elapsed_us + 500) / 1000),
+                    (unsigned long long)r.hashes, rate, r.core, loads, (unsigned)r.free_heap);
+}
+
+#endif // SHA_BENCH_H
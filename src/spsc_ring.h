@@ -0,0 +1,80 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Fixed capacity single producer / single consumer ring, items held by value.
+// Only the producer task may call prepare/commit/push and only the consumer
+// task front/pop, then no lock is needed. size() can be read from both sides.
+template <typename T, uint32_t CAPACITY>
+class SpscRing
+{
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "SpscRing capacity must be a power of 2");
+
+public:
+    SpscRing() : head_(0), tail_(0) {}
+
+    // Producer: free slot to fill in place, NULL when full. Published by commit()
+    T* prepare()
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= CAPACITY)
+            return NULL;
+        return &items_[head & (CAPACITY - 1)];
+    }
+
+    void commit()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool push(const T& item)
+    {
+        T* slot = prepare();
+        if (!slot)
+            return false;
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    // Consumer: oldest item, NULL when empty. The slot stays owned by the consumer until pop()
+    T* front()
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail)
+            return NULL;
+        return &items_[tail & (CAPACITY - 1)];
+    }
+
+    void pop()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool pop(T& item)
+    {
+        T* slot = front();
+        if (!slot)
+            return false;
+        item = *slot;
+        pop();
+        return true;
+    }
+
+    uint32_t size() const
+    {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        return head_.load(std::memory_order_acquire) - tail;
+    }
+
+    static constexpr uint32_t capacity() { return CAPACITY; }
+
+private:
+    T items_[CAPACITY];
+    std::atomic<uint32_t> head_;  // next slot to write, producer owned
+    std::atomic<uint32_t> tail_;  // next slot to read, consumer owned
+};
+
+#endif // SPSC_RING_H
@@ -1,18 +1,17 @@
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include <WiFi.h>
 #include "stratum.h"
-#include "cJSON.h"
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #include "esp_log.h"
 #include "lwip/sockets.h"
 #include "utils.h"
+#include "job_header.h"
 #include "version.h"
 
 
 
-StaticJsonDocument<BUFFER_JSON_DOC> doc;
 unsigned long id = 1;
 
 //Get next JSON RPC Id
@@ -33,32 +32,28 @@ bool verifyPayload (String* line){
   
 }
 
-bool checkError(const StaticJsonDocument<BUFFER_JSON_DOC> doc) {
-  
-  if (!doc.containsKey("error")) return false;
-  
-  if (doc["error"].size() == 0) return false;
-
-  Serial.printf("ERROR: %d | reason: %s \n", (const int) doc["error"][0], (const char*) doc["error"][1]);
-
-  return true;  
-}
-
-
 // STEP 1: Pool server connection (SUBSCRIBE)
     // Docs: 
     // - https://cs.braiins.com/stratum-v1/docs
     // - https://github.com/aeternity/protocol/blob/master/STRATUM.md#mining-subscribe
-bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe)
+bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe, StratumFramer& pending)
 {
     char payload[BUFFER] = {0};
     
-    // Subscribe
+    // Version rolling first (BIP 310), pools that do not know mining.configure answer with an error
     id = 1; //Initialize id messages
+    sprintf(payload, "{\"id\": %lu, \"method\": \"mining.configure\", \"params\": [[\"version-rolling\"], {\"version-rolling.mask\": \"%08x\", \"version-rolling.min-bit-count\": %d}]}\n",
+      id, VERSION_ROLLING_MASK, VERSION_ROLLING_MIN_BITS);
+    Serial.printf("[WORKER] ==> Mining configure\n");
+    Serial.print("  Sending  : "); Serial.print(payload);
+    client.print(payload);
+
+    // Subscribe
+    id = getNextId(id);
     #ifndef HAN
-    sprintf(payload, "{\"id\": %u, \"method\": \"mining.subscribe\", \"params\": [\"NerdMinerV2/%s\"]}\n", id, CURRENT_VERSION);
+    sprintf(payload, "{\"id\": %lu, \"method\": \"mining.subscribe\", \"params\": [\"NerdMinerV2/%s\"]}\n", id, CURRENT_VERSION);
     #else
-    sprintf(payload, "{\"id\": %u, \"method\": \"mining.subscribe\", \"params\": [\"HAN_SOLOminer/%s\"]}\n", id, CURRENT_VERSION);
+    sprintf(payload, "{\"id\": %lu, \"method\": \"mining.subscribe\", \"params\": [\"HAN_SOLOminer/%s\"]}\n", id, CURRENT_VERSION);
     #endif
     
     Serial.printf("[WORKER] ==> Mining subscribe\n");
@@ -67,19 +62,40 @@ bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe)
     
     vTaskDelay(200 / portTICK_PERIOD_MS); //Small delay
     
-    String line = client.readStringUntil('\n');
-    if(!parse_mining_subscribe(line, mSubscribe)) return false;
+    //Until the subscribe answer: the configure one, if the pool does not ignore it, and
+    //notifications BIP 310 pools (mining.set_version_mask) or eager ones (set_difficulty,
+    //notify) send in between. Each read waits up to the client's timeout
+    bool subscribed = false;
+    for (int lines = 0; lines < SUBSCRIBE_LINES_MAX && !subscribed; ++lines)
+    {
+        String line = client.readStringUntil('\n');
+        if(!verifyPayload(&line)) return false;
+        if(parse_mining_configure(line, mSubscribe)) continue;
+
+        stratum_message msg;
+        String text = line; //Parsed in place
+        stratum_method method = parse_stratum_line((char*)text.c_str(), text.length(), msg);
+        if(msg.id == id) {
+            if(!parse_mining_subscribe(line, mSubscribe)) return false;
+            subscribed = true;
+        } else if(method == MINING_SET_VERSION_MASK) {
+            Serial.print("  Receiving: "); Serial.println(line);
+            parse_mining_set_version_mask(msg, mSubscribe);
+        } else if(!pending.push(line.c_str(), line.length())) {
+            Serial.print("  Dropped  : "); Serial.println(line);
+        }
+    }
+    if(!subscribed) return false;
 
   
     Serial.print("    sub_details: "); Serial.println(mSubscribe.sub_details);
     Serial.print("    extranonce1: "); Serial.println(mSubscribe.extranonce1);
     Serial.print("    extranonce2_size: "); Serial.println(mSubscribe.extranonce2_size);
+    Serial.printf("    version_mask: %08x\n", mSubscribe.version_mask);
 
-    if((mSubscribe.extranonce1.length() == 0) ) { 
+    if((mSubscribe.extranonce1.length() == 0) || mSubscribe.extranonce1.length() + 2 * mSubscribe.extranonce2_size > 2 * EXTRANONCE_SIZE) { 
         Serial.printf("[WORKER] >>>>>>>>> Work aborted\n"); 
         Serial.printf("extranonce1 length: %u \n", mSubscribe.extranonce1.length());
-        doc.clear();
-        doc.garbageCollect();
         return false; 
     }
     return true;
@@ -87,28 +103,54 @@ bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe)
 
 bool parse_mining_subscribe(String line, mining_subscribe& mSubscribe)
 {
+    stratum_message msg;
     if(!verifyPayload(&line)) return false;
     Serial.print("  Receiving: "); Serial.println(line);
-   
-    DeserializationError error = deserializeJson(doc, line);
 
-    if (error || checkError(doc)) return false;
-    if (!doc.containsKey("result")) return false;
+    //Parsed in place, line is our own copy
+    parse_stratum_line((char*)line.c_str(), line.length(), msg);
+    if (msg.error) Serial.printf("ERROR: %d | reason: %s \n", msg.error_code, msg.error_msg ? msg.error_msg : "");
+    if (msg.method != STRATUM_SUCCESS || !msg.extranonce1) return false;
 
-    mSubscribe.sub_details = String((const char*) doc["result"][0][0][1]);
-    mSubscribe.extranonce1 = String((const char*) doc["result"][1]);
-    mSubscribe.extranonce2_size = doc["result"][2];
+    mSubscribe.sub_details = String(msg.subscription ? msg.subscription : "");
+    mSubscribe.extranonce1 = String(msg.extranonce1);
+    mSubscribe.extranonce2_size = msg.extranonce2_size;
 
     return true;
 }
 
+//True when line is the answer to mining.configure, version_mask is what the pool granted of it
+bool parse_mining_configure(String line, mining_subscribe& mSubscribe)
+{
+    stratum_message msg;
+    if(!verifyPayload(&line)) return false;
+    String text = line; //Parsed in place
+    if(parse_stratum_line((char*)text.c_str(), text.length(), msg) == STRATUM_PARSE_ERROR && !msg.error) return false;
+    if(msg.id != 1) return false;
+    Serial.print("  Receiving: "); Serial.println(line);
+    if(msg.error) Serial.printf("ERROR: %d | reason: %s \n", msg.error_code, msg.error_msg ? msg.error_msg : "");
+    mSubscribe.version_mask = msg.version_mask & VERSION_ROLLING_MASK;
+    return true;
+}
+
+//Applies from the next job on, templates already mining keep the mask they were rolled with
+bool parse_mining_set_version_mask(const stratum_message& msg, mining_subscribe& mSubscribe)
+{
+    Serial.println("    Parsing Method [SET VERSION MASK]");
+    if (!msg.valid) return false;
+
+    mSubscribe.version_mask = msg.version_mask & VERSION_ROLLING_MASK;
+    Serial.printf("    version_mask: %08x\n", mSubscribe.version_mask);
+    return true;
+}
+
 mining_subscribe init_mining_subscribe(void)
 {
     mining_subscribe new_mSub;
 
     new_mSub.extranonce1 = "";
-    new_mSub.extranonce2 = "";
     new_mSub.extranonce2_size = 0;
+    new_mSub.version_mask = 0;
     new_mSub.sub_details = "";
 
 
@@ -122,7 +164,7 @@ bool tx_mining_auth(WiFiClient& client, const char * user, const char * pass)
 
     // Authorize
     id = getNextId(id);
-    sprintf(payload, "{\"params\": [\"%s\", \"%s\"], \"id\": %u, \"method\": \"mining.authorize\"}\n", 
+    sprintf(payload, "{\"params\": [\"%s\", \"%s\"], \"id\": %lu, \"method\": \"mining.authorize\"}\n", 
       user, pass, id);
     
     Serial.printf("[WORKER] ==> Autorize work\n");
@@ -138,107 +180,89 @@ bool tx_mining_auth(WiFiClient& client, const char * user, const char * pass)
 }
 
 
-stratum_method parse_mining_method(String line)
+stratum_method parse_mining_method(char* line, size_t len, stratum_message& msg)
 {
-    if(!verifyPayload(&line)) return STRATUM_PARSE_ERROR;
     Serial.print("  Receiving: "); Serial.println(line);
-    
-    DeserializationError error = deserializeJson(doc, line);
-
-    if (error || checkError(doc)) return STRATUM_PARSE_ERROR;
-
-    if (!doc.containsKey("method")) {
-      // "error":null means success
-      if (doc["error"].isNull())
-        return STRATUM_SUCCESS;
-      else
-        return STRATUM_UNKNOWN;
-    }
-    stratum_method result = STRATUM_UNKNOWN;
 
-    if (strcmp("mining.notify", (const char*) doc["method"]) == 0) {
-        result = MINING_NOTIFY;
-    } else if (strcmp("mining.set_difficulty", (const char*) doc["method"]) == 0) {
-        result = MINING_SET_DIFFICULTY;
-    }
+    stratum_method method = parse_stratum_line(line, len, msg);
+    if (msg.error)
+        Serial.printf("ERROR: %d | reason: %s \n", msg.error_code, msg.error_msg ? msg.error_msg : "");
 
-    return result;
+    return method;
 }
 
-bool parse_mining_notify(String line, mining_job& mJob)
+bool parse_mining_notify(const stratum_message& msg, mining_job& mJob)
 {
     Serial.println("    Parsing Method [MINING NOTIFY]");
-    if(!verifyPayload(&line)) return false;
-   
-    DeserializationError error = deserializeJson(doc, line);
-
-    if (error) return false;
-    if (!doc.containsKey("params")) return false;
-
-    mJob.job_id = String((const char*) doc["params"][0]);
-    mJob.prev_block_hash = String((const char*) doc["params"][1]);
-    mJob.coinb1 = String((const char*) doc["params"][2]);
-    mJob.coinb2 = String((const char*) doc["params"][3]);
-    mJob.merkle_branch = doc["params"][4];
-    mJob.version = String((const char*) doc["params"][5]);
-    mJob.nbits = String((const char*) doc["params"][6]);
-    mJob.ntime = String((const char*) doc["params"][7]);
-    mJob.clean_jobs = doc["params"][8]; //bool
 
-    #ifdef DEBUG_MINING
-    Serial.print("    job_id: "); Serial.println(mJob.job_id);
-    Serial.print("    prevhash: "); Serial.println(mJob.prev_block_hash);
-    Serial.print("    coinb1: "); Serial.println(mJob.coinb1);
-    Serial.print("    coinb2: "); Serial.println(mJob.coinb2);
-    Serial.print("    merkle_branch size: "); Serial.println(mJob.merkle_branch.size());
-    Serial.print("    version: "); Serial.println(mJob.version);
-    Serial.print("    nbits: "); Serial.println(mJob.nbits);
-    Serial.print("    ntime: "); Serial.println(mJob.ntime);
-    Serial.print("    clean_jobs: "); Serial.println(mJob.clean_jobs);
-    #endif
     //Check if parameters where correctly received
-    if (checkError(doc)) {
+    if (!stratum_notify_job(msg, mJob)) {
       Serial.printf("[WORKER] >>>>>>>>> Work aborted\n"); 
       return false;
     }
+
+    #ifdef DEBUG_MINING
+    Serial.print("    job_id: "); Serial.println(mJob.job_id);
+    Serial.print("    prevhash: ");
+    for (size_t i = 0; i < sizeof(mJob.prev_block_hash); i++)
+        Serial.printf("%02x", mJob.prev_block_hash[i]);
+    Serial.println("");
+    Serial.print("    coinb1: "); Serial.println(msg.coinb1);
+    Serial.print("    coinb2: "); Serial.println(msg.coinb2);
+    Serial.print("    merkle_branch size: "); Serial.println(mJob.merkle_branch_count);
+    Serial.printf("    version: %08x\n", mJob.version);
+    Serial.printf("    nbits: %08x\n", mJob.nbits);
+    Serial.printf("    ntime: %08x\n", mJob.ntime);
+    Serial.print("    clean_jobs: "); Serial.println(mJob.clean_jobs);
+    #endif
     return true;
 }
 
 
-bool tx_mining_submit(WiFiClient& client, mining_subscribe mWorker, mining_job mJob, unsigned long nonce, unsigned long &submit_id)
+bool tx_mining_submit(SubmitPipeline& pipeline, const mining_subscribe& mWorker, const mining_job& mJob, uint64_t extranonce2, uint32_t version, unsigned long nonce, const SubmitShare& share)
 {
-    char payload[BUFFER] = {0};
+    uint8_t extranonce2_bytes[EXTRANONCE_SIZE];
+    size_t space;
+    char* payload = pipeline.prepare(space, micros());
+    if (!payload) {
+      Serial.println("  Submit window full, share dropped");
+      return false;
+    }
 
-    // Submit
+    // Submit, with the extranonce2 and version the share was mined on
     id = getNextId(id);
-    submit_id = id;
-    sprintf(payload, "{\"id\":%u,\"method\":\"mining.submit\",\"params\":[\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"]}\n",
-        id,
-        mWorker.wName,//"bc1qvv469gmw4zz6qa4u4dsezvrlmqcqszwyfzhgwj", //mWorker.name,
-        mJob.job_id.c_str(),
-        mWorker.extranonce2.c_str(),
-        mJob.ntime.c_str(),
-        String(nonce, HEX).c_str()
-        );
-    Serial.print("  Sending  : "); Serial.print(payload);
-    client.print(payload);
-    //Serial.print("  Receiving: "); Serial.println(client.readStringUntil('\n'));
+    job_extranonce2(extranonce2, mWorker.extranonce2_size, extranonce2_bytes);
+    size_t size = stratum_submit_line(payload, space, id, mWorker.wName, mJob, extranonce2_bytes, mWorker.extranonce2_size, nonce,
+                                      mWorker.version_mask, version);
+    if (!size)
+      return false;
+    pipeline.commit(id, size, share, micros());
+    Serial.print("  Queued   : "); Serial.print(payload);
 
     return true;
 }
 
-bool parse_mining_set_difficulty(String line, double& difficulty)
+//Writes as much of the queued submits as the socket takes right now
+bool tx_mining_flush(WiFiClient& client, SubmitPipeline& pipeline)
 {
-    Serial.println("    Parsing Method [SET DIFFICULTY]");
-    if(!verifyPayload(&line)) return false;
-   
-    DeserializationError error = deserializeJson(doc, line);
+    int fd = client.fd();
+    if (fd < 0)
+      return false;
+    return pipeline.flush([fd](const char* data, size_t size) {
+        int sent = send(fd, data, size, MSG_DONTWAIT);
+        if (sent < 0)
+          return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        return sent;
+    }, micros());
+}
 
-    if (error) return false;
-    if (!doc.containsKey("params")) return false;
+bool parse_mining_set_difficulty(const stratum_message& msg, double& difficulty)
+{
+    Serial.println("    Parsing Method [SET DIFFICULTY]");
+    if (!msg.valid) return false;
 
-    Serial.print("    difficulty: "); Serial.println((double)doc["params"][0],12);
-    difficulty = (double)doc["params"][0];
+    Serial.print("    difficulty: "); Serial.println(msg.difficulty,12);
+    difficulty = msg.difficulty;
 
     return true;
 }
@@ -248,24 +272,9 @@ bool tx_suggest_difficulty(WiFiClient& client, double difficulty)
     char payload[BUFFER] = {0};
 
     id = getNextId(id);
-    sprintf(payload, "{\"id\":%d,\"method\":\"mining.suggest_difficulty\",\"params\":[%.10g]}\n", id, difficulty);
+    sprintf(payload, "{\"id\":%lu,\"method\":\"mining.suggest_difficulty\",\"params\":[%.10g]}\n", id, difficulty);
     
     Serial.print("  Sending  : "); Serial.print(payload);
     return client.print(payload);
 
 }
-
-
-unsigned long parse_extract_id(const String &line)
-{
-    DeserializationError error = deserializeJson(doc, line);
-    if (error)
-        return 0;
-    
-    if (!doc.containsKey("id"))
-        return 0;
-
-    unsigned long id = doc["id"];
-
-    return id;
-}
\ No newline at end of file
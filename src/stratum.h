@@ -1,71 +1,56 @@
 #ifndef STRATUM_API_H
 #define STRATUM_API_H
 
-#include "cJSON.h"
 #include <stdint.h>
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include <WiFi.h>
+#include "stratum_parse.h"
+#include "submit_pipeline.h"
 
-#define MAX_MERKLE_BRANCHES 32
 #define HASH_SIZE 32
-#define COINBASE_SIZE 100
-#define COINBASE2_SIZE 128
 
-#define BUFFER_JSON_DOC 4096
 #define BUFFER 1024
 
+//Lines tx_mining_subscribe reads waiting for the subscribe answer before it gives up
+#define SUBSCRIBE_LINES_MAX 16
+
+//BIP 320 general purpose version bits, asked for with mining.configure (BIP 310)
+#define VERSION_ROLLING_MASK      0x1fffe000
+#define VERSION_ROLLING_MIN_BITS  2
+
 typedef struct {
     String sub_details;
     String extranonce1;
-    String extranonce2;
     int extranonce2_size;
+    uint32_t version_mask;  //Version rolling granted by the pool, 0 when not
     char wName[80];
     char wPass[20];
 } mining_subscribe;
 
-typedef struct {
-    String job_id;
-    String prev_block_hash;
-    String coinb1;
-    String coinb2;
-    String nbits;
-    JsonArray merkle_branch;
-    String version;
-    uint32_t target;
-    String ntime;
-    bool clean_jobs;
-} mining_job;
-
-typedef enum {
-    STRATUM_SUCCESS,
-    STRATUM_UNKNOWN,
-    STRATUM_PARSE_ERROR,
-    MINING_NOTIFY,
-    MINING_SET_DIFFICULTY
-} stratum_method;
-
 unsigned long getNextId(unsigned long id);
 bool verifyPayload (String* line);
-bool checkError(const StaticJsonDocument<BUFFER_JSON_DOC> doc);
 
 //Method Mining.subscribe
 mining_subscribe init_mining_subscribe(void);
-bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe);
+//Other messages the pool sends before the subscribe answer are kept in pending, in order
+bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe, StratumFramer& pending);
 bool parse_mining_subscribe(String line, mining_subscribe& mSubscribe);
 
+//Method Mining.configure, sent by tx_mining_subscribe
+bool parse_mining_configure(String line, mining_subscribe& mSubscribe);
+bool parse_mining_set_version_mask(const stratum_message& msg, mining_subscribe& mSubscribe);
+
 //Method Mining.authorise
 bool tx_mining_auth(WiFiClient& client, const char * user, const char * pass);
-stratum_method parse_mining_method(String line);
-bool parse_mining_notify(String line, mining_job& mJob);
+stratum_method parse_mining_method(char* line, size_t len, stratum_message& msg);
+bool parse_mining_notify(const stratum_message& msg, mining_job& mJob);
 
-//Method Mining.submit
-bool tx_mining_submit(WiFiClient& client, mining_subscribe mWorker, mining_job mJob, unsigned long nonce, unsigned long &submit_id);
+//Method Mining.submit: queued in the pipeline, tx_mining_flush writes it out without blocking
+bool tx_mining_submit(SubmitPipeline& pipeline, const mining_subscribe& mWorker, const mining_job& mJob, uint64_t extranonce2, uint32_t version, unsigned long nonce, const SubmitShare& share);
+bool tx_mining_flush(WiFiClient& client, SubmitPipeline& pipeline);
 
 //Difficulty Methods 
 bool tx_suggest_difficulty(WiFiClient& client, double difficulty);
-bool parse_mining_set_difficulty(String line, double& difficulty);
-
-unsigned long parse_extract_id(const String &line);
+bool parse_mining_set_difficulty(const stratum_message& msg, double& difficulty);
 
 #endif // STRATUM_API_H
\ No newline at end of file
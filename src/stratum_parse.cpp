@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stratum_parse.h"
+
+// Minimal in place JSON reader for pool messages: one pass over the line, strings are
+// terminated where they stand, containers nobody reads are only checked and skipped
+
+#define STRATUM_PARAMS_MAX  12
+#define JSON_DEPTH_MAX      8
+
+enum JsonType
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct JsonValue
+{
+    uint8_t type;
+    bool boolean;
+    const char* str;    // string content, or the text of a number
+};
+
+static void skip_ws(char*& p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+}
+
+// p on the opening quote
+static const char* parse_string(char*& p)
+{
+    char* start = ++p;
+    while (*p != '"')
+    {
+        if (*p == 0)
+            return NULL;
+        if (*p == '\\' && p[1])
+            p++;
+        p++;
+    }
+    *p++ = 0;
+    return start;
+}
+
+static int hex_nibble(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// Exactly size bytes of hex, nothing more
+static bool hex_decode(const char* hex, uint8_t* out, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        int hi = hex_nibble(hex[2 * i]);
+        if (hi < 0)
+            return false;
+        int lo = hex_nibble(hex[2 * i + 1]);
+        if (lo < 0)
+            return false;
+        out[i] = (hi << 4) | lo;
+    }
+    return hex[2 * size] == 0;
+}
+
+static bool hex_u32(const char* hex, uint32_t& value)
+{
+    uint8_t bytes[4];
+    if (!hex_decode(hex, bytes, 4))
+        return false;
+    value = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+    return true;
+}
+
+static bool parse_literal(char*& p, const char* literal)
+{
+    size_t len = strlen(literal);
+    if (strncmp(p, literal, len) != 0)
+        return false;
+    p += len;
+    return true;
+}
+
+static bool parse_value(char*& p, JsonValue& value, int depth);
+
+// Calls element() for every array element, or every member value of an object
+template <typename F>
+static bool parse_container(char*& p, int depth, F element)
+{
+    if (depth > JSON_DEPTH_MAX)
+        return false;
+    char close = *p == '[' ? ']' : '}';
+    p++;
+    skip_ws(p);
+    if (*p == close)
+    {
+        p++;
+        return true;
+    }
+    while (true)
+    {
+        const char* key = NULL;
+        if (close == '}')
+        {
+            if (*p != '"' || (key = parse_string(p)) == NULL)
+                return false;
+            skip_ws(p);
+            if (*p++ != ':')
+                return false;
+            skip_ws(p);
+        }
+        if (!element(p, key))
+            return false;
+        skip_ws(p);
+        if (*p == ',')
+        {
+            p++;
+            skip_ws(p);
+            continue;
+        }
+        if (*p++ == close)
+            return true;
+        return false;
+    }
+}
+
+static bool parse_value(char*& p, JsonValue& value, int depth)
+{
+    value.str = p;
+    switch (*p)
+    {
+        case '"':
+            value.type = JSON_STRING;
+            value.str = parse_string(p);
+            return value.str != NULL;
+        case '[':
+        case '{':
+            value.type = *p == '[' ? JSON_ARRAY : JSON_OBJECT;
+            return parse_container(p, depth + 1, [depth](char*& q, const char*) {
+                JsonValue skipped;
+                return parse_value(q, skipped, depth + 1);
+            });
+        case 't':
+            value.type = JSON_BOOL;
+            value.boolean = true;
+            return parse_literal(p, "true");
+        case 'f':
+            value.type = JSON_BOOL;
+            value.boolean = false;
+            return parse_literal(p, "false");
+        case 'n':
+            value.type = JSON_NULL;
+            return parse_literal(p, "null");
+        default:
+            value.type = JSON_NUMBER;
+            if (*p == '-')
+                p++;
+            if (*p < '0' || *p > '9')
+                return false;
+            while ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')
+                p++;
+            return true;
+    }
+}
+
+// "params": top level values are kept, the first nested array is decoded as merkle branches
+static bool parse_params(char*& p, JsonValue* params, int& count, stratum_message& msg)
+{
+    bool branches_seen = false;
+    return parse_container(p, 1, [&](char*& q, const char*) {
+        JsonValue value;
+        if (*q == '[' && !branches_seen)
+        {
+            branches_seen = true;
+            value.type = JSON_ARRAY;
+            value.str = q;
+            bool ok = parse_container(q, 2, [&](char*& r, const char*) {
+                JsonValue branch;
+                if (!parse_value(r, branch, 2))
+                    return false;
+                if (msg.merkle_branch_count < 0)
+                    return true;
+                if (msg.merkle_branch_count == MAX_MERKLE_BRANCHES || branch.type != JSON_STRING ||
+                    !hex_decode(branch.str, msg.merkle_branch[msg.merkle_branch_count], 32))
+                    msg.merkle_branch_count = -1;
+                else
+                    msg.merkle_branch_count++;
+                return true;
+            });
+            if (!ok)
+                return false;
+        } else if (!parse_value(q, value, 1))
+            return false;
+        if (count < STRATUM_PARAMS_MAX)
+            params[count++] = value;
+        return true;
+    });
+}
+
+// "error": [code, "message", traceback] or anything not null
+static bool parse_error(char*& p, stratum_message& msg)
+{
+    JsonValue value;
+    if (*p != '[')
+    {
+        if (!parse_value(p, value, 1))
+            return false;
+        msg.error = value.type != JSON_NULL;
+        return true;
+    }
+    msg.error = true;
+    return parse_container(p, 1, [&](char*& q, const char*) {
+        JsonValue item;
+        if (!parse_value(q, item, 2))
+            return false;
+        if (item.type == JSON_NUMBER && msg.error_code == 0)
+            msg.error_code = atoi(item.str);
+        else if (item.type == JSON_STRING && msg.error_msg == NULL)
+            msg.error_msg = item.str;
+        return true;
+    });
+}
+
+static const char* param_string(const JsonValue* params, int count, int index)
+{
+    if (index >= count || params[index].type != JSON_STRING)
+        return NULL;
+    return params[index].str;
+}
+
+// "result" of mining.configure: {"version-rolling": true, "version-rolling.mask": "1fffe000", ...}
+static bool parse_configure_result(char*& p, stratum_message& msg)
+{
+    bool granted = false;
+    uint32_t mask = 0;
+    bool ok = parse_container(p, 1, [&](char*& q, const char* key) {
+        JsonValue value;
+        if (!parse_value(q, value, 1))
+            return false;
+        if (strcmp(key, "version-rolling") == 0 && value.type == JSON_BOOL)
+            granted = value.boolean;
+        else if (strcmp(key, "version-rolling.mask") == 0 && (value.type != JSON_STRING || !hex_u32(value.str, mask)))
+            mask = 0;
+        return true;
+    });
+    if (granted)
+        msg.version_mask = mask;
+    return ok;
+}
+
+// [["mining.set_difficulty", "id"], ["mining.notify", "id"]], or a single pair: keeps the notify id
+static bool parse_subscriptions(char*& p, stratum_message& msg, int depth)
+{
+    const char* name = NULL;
+    int index = 0;
+    return parse_container(p, depth, [&](char*& q, const char*) {
+        if (*q == '[' && depth == 2)
+            return parse_subscriptions(q, msg, depth + 1);
+        JsonValue value;
+        if (!parse_value(q, value, depth))
+            return false;
+        if (index == 0 && value.type == JSON_STRING)
+            name = value.str;
+        else if (index == 1 && value.type == JSON_STRING && name && strcmp(name, "mining.notify") == 0)
+            msg.subscription = value.str;
+        index++;
+        return true;
+    });
+}
+
+// "result" of mining.subscribe: [subscriptions, "extranonce1", extranonce2_size]
+static bool parse_subscribe_result(char*& p, stratum_message& msg)
+{
+    int index = 0;
+    return parse_container(p, 1, [&](char*& q, const char*) {
+        if (index++ == 0 && *q == '[')
+            return parse_subscriptions(q, msg, 2);
+        JsonValue value;
+        if (!parse_value(q, value, 1))
+            return false;
+        if (index == 2 && value.type == JSON_STRING)
+            msg.extranonce1 = value.str;
+        else if (index == 3 && value.type == JSON_NUMBER)
+            msg.extranonce2_size = atoi(value.str);
+        return true;
+    });
+}
+
+// [job_id, prevhash, coinb1, coinb2, [merkle branches], version, nbits, ntime, clean_jobs]
+static bool parse_notify(const JsonValue* params, int count, stratum_message& msg)
+{
+    const char* prev_block_hash = param_string(params, count, 1);
+    const char* version = param_string(params, count, 5);
+    const char* nbits = param_string(params, count, 6);
+    const char* ntime = param_string(params, count, 7);
+    msg.job_id = param_string(params, count, 0);
+    msg.coinb1 = param_string(params, count, 2);
+    msg.coinb2 = param_string(params, count, 3);
+    msg.clean_jobs = count > 8 && params[8].type == JSON_BOOL && params[8].boolean;
+    if (count < 5 || params[4].type != JSON_ARRAY)
+        msg.merkle_branch_count = -1;
+    return msg.job_id && msg.coinb1 && msg.coinb2 && msg.merkle_branch_count >= 0 &&
+           prev_block_hash && hex_decode(prev_block_hash, msg.prev_block_hash, 32) &&
+           version && hex_u32(version, msg.version) &&
+           nbits && hex_u32(nbits, msg.nbits) &&
+           ntime && hex_u32(ntime, msg.ntime);
+}
+
+// [difficulty]
+static bool parse_set_difficulty(const JsonValue* params, int count, stratum_message& msg)
+{
+    if (count < 1 || params[0].type != JSON_NUMBER)
+        return false;
+    msg.difficulty = strtod(params[0].str, NULL);
+    return msg.difficulty > 0;
+}
+
+// [mask]
+static bool parse_set_version_mask(const JsonValue* params, int count, stratum_message& msg)
+{
+    const char* mask = param_string(params, count, 0);
+    return mask && hex_u32(mask, msg.version_mask);
+}
+
+typedef bool (*stratum_params_parser)(const JsonValue* params, int count, stratum_message& msg);
+
+static const struct {
+    const char* name;
+    stratum_method method;
+    stratum_params_parser parse;
+} s_methods[] = {
+    { "mining.notify",         MINING_NOTIFY,         parse_notify },
+    { "mining.set_difficulty", MINING_SET_DIFFICULTY, parse_set_difficulty },
+    { "mining.set_version_mask", MINING_SET_VERSION_MASK, parse_set_version_mask },
+};
+
+stratum_method parse_stratum_line(char* line, size_t len, stratum_message& msg)
+{
+    // Only the header, the method fields are written by whoever parses them
+    msg.method = STRATUM_PARSE_ERROR;
+    msg.valid = false;
+    msg.id = 0;
+    msg.error = false;
+    msg.error_code = 0;
+    msg.error_msg = NULL;
+    msg.result = false;
+    msg.version_mask = 0;
+    msg.subscription = NULL;
+    msg.extranonce1 = NULL;
+    msg.extranonce2_size = 0;
+    msg.merkle_branch_count = 0;
+    line[len] = 0;
+
+    JsonValue params[STRATUM_PARAMS_MAX];
+    int params_count = 0;
+    const char* method = NULL;
+
+    char* p = line;
+    skip_ws(p);
+    if (*p != '{')
+        return msg.method;
+    bool ok = parse_container(p, 0, [&](char*& q, const char* key) {
+        if (strcmp(key, "params") == 0 && *q == '[')
+            return parse_params(q, params, params_count, msg);
+        if (strcmp(key, "error") == 0)
+            return parse_error(q, msg);
+        if (strcmp(key, "result") == 0 && *q == '{')
+            return parse_configure_result(q, msg);
+        if (strcmp(key, "result") == 0 && *q == '[')
+            return parse_subscribe_result(q, msg);
+        JsonValue value;
+        if (!parse_value(q, value, 0))
+            return false;
+        if (strcmp(key, "id") == 0 && value.type == JSON_NUMBER)
+            msg.id = strtoul(value.str, NULL, 10);
+        else if (strcmp(key, "method") == 0 && value.type == JSON_STRING)
+            method = value.str;
+        else if (strcmp(key, "result") == 0 && value.type == JSON_BOOL)
+            msg.result = value.boolean;
+        return true;
+    });
+    if (!ok || msg.error)
+        return msg.method;
+
+    if (!method)
+    {
+        msg.valid = true;
+        return msg.method = STRATUM_SUCCESS;
+    }
+    // Known methods keep their kind even with bad params, so the caller can tell what was lost
+    for (size_t i = 0; i < sizeof(s_methods) / sizeof(s_methods[0]); ++i)
+    {
+        if (strcmp(method, s_methods[i].name) == 0)
+        {
+            msg.valid = s_methods[i].parse(params, params_count, msg);
+            return msg.method = s_methods[i].method;
+        }
+    }
+    return msg.method = STRATUM_UNKNOWN;
+}
+
+// Hex string into a fixed span
+static bool hex_span(const char* hex, uint8_t* out, size_t out_size, uint16_t& size)
+{
+    size_t len = strlen(hex);
+    if (len % 2 || len / 2 > out_size || !hex_decode(hex, out, len / 2))
+        return false;
+    size = len / 2;
+    return true;
+}
+
+bool stratum_notify_job(const stratum_message& msg, mining_job& job)
+{
+    if (msg.method != MINING_NOTIFY || !msg.valid || strlen(msg.job_id) >= sizeof(job.job_id) ||
+        !hex_span(msg.coinb1, job.coinb1, sizeof(job.coinb1), job.coinb1_size) ||
+        !hex_span(msg.coinb2, job.coinb2, sizeof(job.coinb2), job.coinb2_size))
+        return false;
+
+    strcpy(job.job_id, msg.job_id);
+    memcpy(job.prev_block_hash, msg.prev_block_hash, sizeof(job.prev_block_hash));
+    memcpy(job.merkle_branch, msg.merkle_branch, msg.merkle_branch_count * sizeof(job.merkle_branch[0]));
+    job.merkle_branch_count = msg.merkle_branch_count;
+    job.version = msg.version;
+    job.nbits = msg.nbits;
+    job.ntime = msg.ntime;
+    job.clean_jobs = msg.clean_jobs;
+    return true;
+}
+
+size_t stratum_submit_line(char* out, size_t size, unsigned long id, const char* worker, const mining_job& job,
+                           const uint8_t* extranonce2, size_t extranonce2_size, uint32_t nonce,
+                           uint32_t version_mask, uint32_t version)
+{
+    static const char s_hex[] = "0123456789abcdef";
+    char extranonce2_hex[2 * EXTRANONCE_SIZE + 1];
+    if (extranonce2_size > EXTRANONCE_SIZE)
+        return 0;
+    for (size_t i = 0; i < extranonce2_size; ++i)
+    {
+        extranonce2_hex[2 * i] = s_hex[extranonce2[i] >> 4];
+        extranonce2_hex[2 * i + 1] = s_hex[extranonce2[i] & 0xF];
+    }
+    extranonce2_hex[2 * extranonce2_size] = 0;
+
+    int len = snprintf(out, size, "{\"id\":%lu,\"method\":\"mining.submit\",\"params\":[\"%s\",\"%s\",\"%s\",\"%08x\",\"%08x\"",
+                       id, worker, job.job_id, extranonce2_hex, (unsigned)job.ntime, (unsigned)nonce);
+    // BIP 310: the pool takes (job version & ~mask) | (version_bits & mask)
+    if (len > 0 && (size_t)len < size && version_mask)
+        len += snprintf(out + len, size - len, ",\"%08x\"", (unsigned)(version & version_mask));
+    if (len > 0 && (size_t)len < size)
+        len += snprintf(out + len, size - len, "]}\n");
+    return len > 0 && (size_t)len < size ? len : 0;
+}
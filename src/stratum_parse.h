@@ -0,0 +1,193 @@
+#ifndef STRATUM_PARSE_H
+#define STRATUM_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Portable part of the stratum client: no Arduino, no heap. Also built by [env:native]
+
+#define MAX_MERKLE_BRANCHES 32
+#define STRATUM_LINE_MAX    4096    // longest pool message kept, longer ones are dropped
+#define JOB_ID_SIZE         64
+#define COINBASE_SIZE       256     // coinb1 bytes, before the extranonces
+#define COINBASE2_SIZE      512     // coinb2 bytes, outputs and witness commitment
+#define EXTRANONCE_SIZE     32      // extranonce1 + extranonce2 bytes
+
+typedef enum {
+    STRATUM_SUCCESS,
+    STRATUM_UNKNOWN,
+    STRATUM_PARSE_ERROR,
+    MINING_NOTIFY,
+    MINING_SET_DIFFICULTY,
+    MINING_SET_VERSION_MASK
+} stratum_method;
+
+// One pool message parsed in place: strings are NUL terminated inside the line
+// (JSON escapes are left as received), so they live as long as the line does.
+// The fixed size hex fields of mining.notify are decoded while scanning
+typedef struct {
+    stratum_method method;
+    bool valid;                     // all params of the method present and well formed
+    unsigned long id;               // 0 when null or missing
+    bool error;                     // "error" neither null nor missing
+    int error_code;
+    const char* error_msg;
+    bool result;                    // "result": true
+    uint32_t version_mask;          // BIP 310 mask granted in a mining.configure result or
+                                    // sent by mining.set_version_mask, 0 when none
+
+    // mining.subscribe result, NULL / 0 when the result is not one
+    const char* subscription;       // mining.notify subscription id
+    const char* extranonce1;
+    int extranonce2_size;
+
+    // mining.notify
+    const char* job_id;
+    const char* coinb1;
+    const char* coinb2;
+    uint8_t prev_block_hash[32];    // bytes in the order of the hex string
+    uint8_t merkle_branch[MAX_MERKLE_BRANCHES][32];
+    int merkle_branch_count;        // -1 when more than MAX_MERKLE_BRANCHES or not 32 byte hashes
+    uint32_t version;
+    uint32_t nbits;
+    uint32_t ntime;
+    bool clean_jobs;
+
+    // mining.set_difficulty
+    double difficulty;
+} stratum_message;
+
+// Decoded once when the notify arrives, the coinbase is hashed straight from the two spans
+typedef struct {
+    char job_id[JOB_ID_SIZE];
+    uint8_t prev_block_hash[32];
+    uint8_t coinb1[COINBASE_SIZE];
+    uint8_t coinb2[COINBASE2_SIZE];
+    uint16_t coinb1_size;
+    uint16_t coinb2_size;
+    uint32_t nbits;
+    uint8_t merkle_branch[MAX_MERKLE_BRANCHES][32];
+    int merkle_branch_count;
+    uint32_t version;
+    uint32_t target;
+    uint32_t ntime;
+    bool clean_jobs;
+} mining_job;
+
+// Parses a single JSON-RPC line in one pass. line[len] must be writable and is set to 0
+stratum_method parse_stratum_line(char* line, size_t len, stratum_message& msg);
+
+// A valid mining.notify into job, false when a field does not fit
+bool stratum_notify_job(const stratum_message& msg, mining_job& job);
+
+// mining.submit of a nonce found with the given extranonce2 and header version, '\n' terminated.
+// With a version_mask (version rolling negotiated) the rolled bits go out as the 6th param.
+// Returns its length, 0 when it does not fit
+size_t stratum_submit_line(char* out, size_t size, unsigned long id, const char* worker, const mining_job& job,
+                           const uint8_t* extranonce2, size_t extranonce2_size, uint32_t nonce,
+                           uint32_t version_mask, uint32_t version);
+
+// Splits the socket byte stream into lines without copying them out. Bytes are
+// received straight into the buffer, complete lines are handed out as views into it.
+// The partial line left at the end is moved to the front when room is needed.
+class StratumFramer
+{
+public:
+    StratumFramer() { reset(); }
+
+    void reset()
+    {
+        head_ = 0;
+        tail_ = 0;
+        scan_ = 0;
+        discard_ = false;
+    }
+
+    // Contiguous free space to receive into, never 0. Invalidates the lines handed out
+    char* fill(size_t& space)
+    {
+        if (head_ == tail_)
+        {
+            head_ = tail_ = scan_ = 0;
+        } else if (tail_ == STRATUM_LINE_MAX)
+        {
+            if (head_ == 0)
+            {
+                // A whole buffer without '\n': drop it and the rest of that line
+                overflows_++;
+                discard_ = true;
+                head_ = tail_ = scan_ = 0;
+            } else
+            {
+                memmove(buffer_, buffer_ + head_, tail_ - head_);
+                tail_ -= head_;
+                scan_ -= head_;
+                head_ = 0;
+            }
+        }
+        space = STRATUM_LINE_MAX - tail_;
+        return buffer_ + tail_;
+    }
+
+    void filled(size_t size) { tail_ += size; }
+
+    // Next complete line, '\r\n' stripped and NUL terminated, false when there is none yet
+    bool next(char*& line, size_t& len)
+    {
+        while (true)
+        {
+            char* eol = (char*)memchr(buffer_ + scan_, '\n', tail_ - scan_);
+            if (!eol)
+            {
+                scan_ = tail_;
+                return false;
+            }
+            line = buffer_ + head_;
+            len = eol - line;
+            head_ = scan_ = eol + 1 - buffer_;
+            *eol = 0;
+            if (len && line[len - 1] == '\r')
+                line[--len] = 0;
+            if (discard_)
+            {
+                discard_ = false;
+                continue;
+            }
+            if (len)
+                return true;
+        }
+    }
+
+    // A line read outside the framer (the subscribe handshake), handed out by next() before
+    // anything received later. false when it does not fit
+    bool push(const char* line, size_t len)
+    {
+        size_t space;
+        char* buffer = fill(space);
+        if (len + 1 > space)
+        {
+            overflows_++;
+            return false;
+        }
+        memcpy(buffer, line, len);
+        buffer[len] = '\n';
+        filled(len + 1);
+        return true;
+    }
+
+    // Data not searched for a line yet, next() may have one without receiving more
+    bool pending() const { return scan_ < tail_; }
+
+    uint32_t overflows() const { return overflows_; }
+
+private:
+    char buffer_[STRATUM_LINE_MAX];
+    size_t head_;       // first byte not handed out yet
+    size_t tail_;       // end of received data
+    size_t scan_;       // searched for '\n' up to here
+    bool discard_;      // dropping the tail of an oversized line
+    uint32_t overflows_ = 0;
+};
+
+#endif // STRATUM_PARSE_H
@@ -0,0 +1,276 @@
+#ifndef SUBMIT_PIPELINE_H
+#define SUBMIT_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Shares on their way to the pool: the stratum task formats a mining.submit straight into a
+// slot, flush() writes the queued lines as far as the socket takes them without waiting, and
+// the pool's answer finds its slot again by JSON-RPC id. Fixed window, no heap. Portable,
+// also built by [env:native]
+#define SUBMIT_WINDOW       16          // shares queued or waiting for their answer
+#define SUBMIT_LINE_MAX     384         // one mining.submit line, worker name included
+#define SUBMIT_TIMEOUT_US   60000000    // no answer after this long: lost, the slot is reused
+#define SUBMIT_BUCKETS      26          // log2 buckets of the round trip, the last one open ended
+#define SUBMIT_REPORT       16          // answers between two reports
+
+// What the stratum task needs to know about a share once the pool answered it
+struct SubmitShare
+{
+    double diff;
+    bool is32bit;
+    bool isValid;
+};
+
+struct SubmitAnswer
+{
+    SubmitShare share;
+    uint32_t queue_us;      // queued to written out
+    uint32_t rtt_us;        // written out to answered
+};
+
+struct SubmitStats
+{
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t lost;          // never answered, timed out or pushed out of the window
+    uint32_t dropped;       // window full of lines not written yet, not submitted at all
+};
+
+class SubmitPipeline
+{
+public:
+    SubmitPipeline()
+    {
+        memset(&stats_, 0, sizeof(stats_));
+        reset_rtt();
+        seq_ = 0;
+        reset();
+    }
+
+    // Connection lost: what is queued or waiting belongs to the old session
+    void reset()
+    {
+        for (int i = 0; i < SUBMIT_WINDOW; ++i)
+        {
+            if (slots_[i].state == SENT)
+                stats_.lost++;
+            slots_[i].state = FREE;
+        }
+    }
+
+    // Slot to format the next line into, NULL when the window is full of unwritten lines.
+    // A share still waiting for its answer past SUBMIT_TIMEOUT_US, or the oldest one when
+    // nothing is free, is given up on
+    char* prepare(size_t& space, uint32_t now)
+    {
+        Slot* slot = NULL;
+        Slot* oldest = NULL;
+        for (int i = 0; i < SUBMIT_WINDOW; ++i)
+        {
+            Slot& s = slots_[i];
+            if (s.state == SENT && now - s.sent_us > SUBMIT_TIMEOUT_US)
+            {
+                s.state = FREE;
+                stats_.lost++;
+            }
+            if (s.state == FREE && !slot)
+                slot = &s;
+            if (s.state == SENT && (!oldest || s.seq - oldest->seq > 0x80000000u))
+                oldest = &s;
+        }
+        if (!slot && oldest)
+        {
+            slot = oldest;
+            slot->state = FREE;
+            stats_.lost++;
+        }
+        if (!slot)
+        {
+            stats_.dropped++;
+            return NULL;
+        }
+        prepared_ = slot;
+        space = sizeof(slot->line);
+        return slot->line;
+    }
+
+    // The line written by prepare() goes out with the next flush()
+    void commit(unsigned long id, size_t size, const SubmitShare& share, uint32_t now)
+    {
+        Slot* slot = prepared_;
+        prepared_ = NULL;
+        slot->id = id;
+        slot->share = share;
+        slot->size = size;
+        slot->written = 0;
+        slot->queued_us = now;
+        slot->seq = seq_++;
+        slot->state = QUEUED;
+        stats_.queued++;
+    }
+
+    // Writes the queued lines in order while the socket takes them. write(data, size) returns
+    // the bytes taken, 0 when it would block, < 0 on a socket error. False on a socket error
+    template <typename F>
+    bool flush(F write, uint32_t now)
+    {
+        while (Slot* slot = next_queued())
+        {
+            int taken = write(slot->line + slot->written, slot->size - slot->written);
+            if (taken < 0)
+                return false;
+            if (taken == 0)
+                return true;
+            slot->written += taken;
+            if (slot->written < slot->size)
+                return true;
+            slot->sent_us = now;
+            slot->state = SENT;
+            stats_.sent++;
+        }
+        return true;
+    }
+
+    // A line is half written: nothing else may go out on the socket before flush() ends it
+    bool writing() const
+    {
+        for (int i = 0; i < SUBMIT_WINDOW; ++i)
+        {
+            if (slots_[i].state == QUEUED && slots_[i].written)
+                return true;
+        }
+        return false;
+    }
+
+    bool queued() const
+    {
+        for (int i = 0; i < SUBMIT_WINDOW; ++i)
+        {
+            if (slots_[i].state == QUEUED)
+                return true;
+        }
+        return false;
+    }
+
+    // The pool answered id. False when id is not a share waiting for its answer
+    bool answer(unsigned long id, bool accepted, uint32_t now, SubmitAnswer& out)
+    {
+        for (int i = 0; i < SUBMIT_WINDOW; ++i)
+        {
+            Slot& s = slots_[i];
+            if (s.state != SENT || s.id != id)
+                continue;
+            s.state = FREE;
+            out.share = s.share;
+            out.queue_us = s.sent_us - s.queued_us;
+            out.rtt_us = now - s.sent_us;
+            if (accepted)
+                stats_.accepted++;
+            else
+                stats_.rejected++;
+            sample(out.rtt_us);
+            return true;
+        }
+        return false;
+    }
+
+    const SubmitStats& stats() const { return stats_; }
+
+    // Answers since the last report_done()
+    uint32_t answers() const { return rtt_count_; }
+
+    // "sent 40 accepted 38 (95.0%) rejected 1 lost 1 dropped 0 | rtt n 16 mean 84.1 p50 < 131 p90 < 262 max 240 ms"
+    size_t format(char* out, size_t size) const
+    {
+        uint32_t answered = stats_.accepted + stats_.rejected;
+        int len = snprintf(out, size, "sent %u accepted %u (%.1f%%) rejected %u lost %u dropped %u",
+                           stats_.sent, stats_.accepted, answered ? 100.0 * stats_.accepted / answered : 0.0,
+                           stats_.rejected, stats_.lost, stats_.dropped);
+        if (rtt_count_ && len > 0 && (size_t)len < size)
+            len += snprintf(out + len, size - len, " | rtt n %u mean %.1f p50 < %u p90 < %u max %.1f ms",
+                            rtt_count_, rtt_sum_ / 1000.0 / rtt_count_, percentile(50) / 1000, percentile(90) / 1000,
+                            rtt_max_ / 1000.0);
+        return len > 0 ? len : 0;
+    }
+
+    // The round trip histogram starts over, the counters keep going
+    void report_done() { reset_rtt(); }
+
+private:
+    enum State { FREE, QUEUED, SENT };
+
+    struct Slot
+    {
+        uint8_t state = FREE;
+        unsigned long id;
+        SubmitShare share;
+        uint32_t seq;
+        uint32_t queued_us;
+        uint32_t sent_us;
+        uint16_t size;
+        uint16_t written;
+        char line[SUBMIT_LINE_MAX];
+    };
+
+    Slot* next_queued()
+    {
+        Slot* next = NULL;
+        for (int i = 0; i < SUBMIT_WINDOW; ++i)
+        {
+            Slot& s = slots_[i];
+            if (s.state == QUEUED && (!next || s.seq - next->seq > 0x80000000u))
+                next = &s;
+        }
+        return next;
+    }
+
+    void reset_rtt()
+    {
+        rtt_count_ = 0;
+        rtt_sum_ = 0;
+        rtt_max_ = 0;
+        memset(rtt_buckets_, 0, sizeof(rtt_buckets_));
+    }
+
+    void sample(uint32_t value)
+    {
+        int bucket = value ? 32 - __builtin_clz(value) : 0;
+        if (bucket >= SUBMIT_BUCKETS)
+            bucket = SUBMIT_BUCKETS - 1;
+        rtt_buckets_[bucket]++;
+        rtt_count_++;
+        rtt_sum_ += value;
+        if (value > rtt_max_)
+            rtt_max_ = value;
+    }
+
+    // Upper bound of the bucket holding the percentile, in us
+    uint32_t percentile(uint32_t percent) const
+    {
+        uint32_t wanted = (rtt_count_ * percent + 99) / 100;
+        uint32_t seen = 0;
+        for (int b = 0; b < SUBMIT_BUCKETS; ++b)
+        {
+            seen += rtt_buckets_[b];
+            if (seen >= wanted)
+                return b < 31 ? 1u << b : 0xFFFFFFFF;
+        }
+        return 0xFFFFFFFF;
+    }
+
+    Slot slots_[SUBMIT_WINDOW];
+    Slot* prepared_ = NULL;
+    uint32_t seq_;
+    SubmitStats stats_;
+    uint32_t rtt_count_;
+    uint64_t rtt_sum_;
+    uint32_t rtt_max_;
+    uint32_t rtt_buckets_[SUBMIT_BUCKETS];
+};
+
+#endif // SUBMIT_PIPELINE_H
@@ -3,7 +3,8 @@
 #include "utils.h"
 #include "mining.h"
 #include "stratum.h"
-#include "mbedtls/sha256.h"
+#include "job_header.h"
+#include "notify_trace.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -186,16 +187,20 @@ miner_data init_miner_data(void){
   return newMinerData;
 }
 
-miner_data calculateMiningData(mining_subscribe& mWorker, mining_job mJob){
+static job_merkle_cache s_merkle_cache;
+
+miner_data calculateMiningData(const mining_subscribe& mWorker, const mining_job& mJob, uint64_t extranonce2){
 
   miner_data mMiner = init_miner_data();
 
   // calculate target - target = (nbits[2:]+'00'*(int(nbits[:2],16) - 3)).zfill(64)
     
     char target[TARGET_BUFFER_SIZE+1];
+    char nbits[9];
+    snprintf(nbits, sizeof(nbits), "%08x", mJob.nbits);
     memset(target, '0', TARGET_BUFFER_SIZE);
-    int zeros = (int) strtol(mJob.nbits.substring(0, 2).c_str(), 0, 16) - 3;
-    memcpy(target + zeros - 2, mJob.nbits.substring(2).c_str(), mJob.nbits.length() - 2);
+    int zeros = (int) (mJob.nbits >> 24) - 3;
+    memcpy(target + zeros - 2, nbits + 2, 6);
     target[TARGET_BUFFER_SIZE] = 0;
     Serial.print("    target: "); Serial.println(target);
     
@@ -208,190 +213,60 @@ miner_data calculateMiningData(mining_subscribe& mWorker, mining_job mJob){
       mMiner.bytearray_target[j] ^= mMiner.bytearray_target[size_target - 1 - j];
     }
 
-    // get extranonce2 - extranonce2 = hex(random.randint(0,2**32-1))[2:].zfill(2*extranonce2_size)
-    //To review
-    //char extranonce2_char[2 * mWorker.extranonce2_size+1];	
-	//mWorker.extranonce2.toCharArray(extranonce2_char, 2 * mWorker.extranonce2_size + 1);
-    //getNextExtranonce2(mWorker.extranonce2_size, extranonce2_char);
-    if (mWorker.extranonce2_size == 2)
-        mWorker.extranonce2 = "0001";
-    else if (mWorker.extranonce2_size == 4)
-        mWorker.extranonce2 = "00000001";
-    else if (mWorker.extranonce2_size == 8)
-        mWorker.extranonce2 = "0000000000000001";
-    else
-    {
-        Serial.println("Unknown extranonce2");
-        mWorker.extranonce2 = "00000001";
-    }
-    //mWorker.extranonce2 = "00000002";
-    
     //get coinbase - coinbase_hash_bin = hashlib.sha256(hashlib.sha256(binascii.unhexlify(coinbase)).digest()).digest()
-    // Use char buffer instead of String concatenation to avoid memory leaks
-    static char coinbase_buffer[512]; // Static buffer to avoid repeated allocation
-    snprintf(coinbase_buffer, sizeof(coinbase_buffer), "%s%s%s%s", 
-             mJob.coinb1.c_str(), mWorker.extranonce1.c_str(), 
-             mWorker.extranonce2.c_str(), mJob.coinb2.c_str());
-    Serial.print("    coinbase: "); Serial.println(coinbase_buffer);
-    size_t str_len = strlen(coinbase_buffer)/2;
-    uint8_t bytearray[str_len];
-
-    size_t res = to_byte_array(coinbase_buffer, str_len*2, bytearray);
+    // coinbase = coinb1 + extranonce1 + extranonce2 + coinb2, hashed span by span without assembling it
+    // extranonce2 is a counter the dispatcher rolls on when the nonce range runs out
+    uint8_t extranonce[EXTRANONCE_SIZE];
+    size_t extranonce1_size = to_byte_array(mWorker.extranonce1.c_str(), mWorker.extranonce1.length(), extranonce);
+    size_t extranonce_size = extranonce1_size + mWorker.extranonce2_size;
+    job_extranonce2(extranonce2, mWorker.extranonce2_size, extranonce + extranonce1_size);
 
     #ifdef DEBUG_MINING
-    Serial.print("    extranonce2: "); Serial.println(mWorker.extranonce2);
-    Serial.print("    coinbase: "); Serial.println(coinbase_buffer);
-    Serial.print("    coinbase bytes - size: "); Serial.println(res);
-    for (size_t i = 0; i < res; i++)
-        Serial.printf("%02x", bytearray[i]);
+    Serial.print("    extranonce2: ");
+    for (size_t i = extranonce1_size; i < extranonce_size; i++)
+        Serial.printf("%02x", extranonce[i]);
+    Serial.println("");
+    Serial.print("    coinbase bytes - size: "); Serial.println(mJob.coinb1_size + extranonce_size + mJob.coinb2_size);
+    for (size_t i = 0; i < mJob.coinb1_size; i++)
+        Serial.printf("%02x", mJob.coinb1[i]);
+    for (size_t i = 0; i < extranonce_size; i++)
+        Serial.printf("%02x", extranonce[i]);
+    for (size_t i = 0; i < mJob.coinb2_size; i++)
+        Serial.printf("%02x", mJob.coinb2[i]);
     Serial.println("---");
     #endif
 
-    mbedtls_sha256_context ctx;
-    mbedtls_sha256_init(&ctx);
-  
-    byte interResult[32]; // 256 bit
+    //coinb1 + extranonce1 hashed once per job, a new extranonce2 only hashes from there on
+    job_merkle_begin(s_merkle_cache, mJob, extranonce, extranonce1_size);
     byte shaResult[32]; // 256 bit
-  
-    mbedtls_sha256_starts_ret(&ctx,0);
-    mbedtls_sha256_update_ret(&ctx, bytearray, str_len);
-    mbedtls_sha256_finish_ret(&ctx, interResult);
-
-    mbedtls_sha256_starts_ret(&ctx,0);
-    mbedtls_sha256_update_ret(&ctx, interResult, 32);
-    mbedtls_sha256_finish_ret(&ctx, shaResult);
-    mbedtls_sha256_free(&ctx);
+    job_coinbase_hash(s_merkle_cache, extranonce + extranonce1_size, extranonce_size - extranonce1_size, shaResult);
+    NOTIFY_TRACE_STAGE(TRACE_COINBASE);
 
     #ifdef DEBUG_MINING
     Serial.print("    coinbase double sha: ");
     for (size_t i = 0; i < 32; i++)
         Serial.printf("%02x", shaResult[i]);
     Serial.println("");
-    #endif
-
-    
-    // copy coinbase hash
-    memcpy(mMiner.merkle_result, shaResult, sizeof(shaResult));
-    
-    byte merkle_concatenated[32 * 2];
-    for (size_t k=0; k < mJob.merkle_branch.size(); k++) {
-        const char* merkle_element = (const char*) mJob.merkle_branch[k];
-        uint8_t bytearray[32];
-        size_t res = to_byte_array(merkle_element, 64, bytearray);
-
-        #ifdef DEBUG_MINING
-        Serial.print("    merkle element    "); Serial.print(k); Serial.print(": "); Serial.println(merkle_element);
-        #endif
-        for (size_t i = 0; i < 32; i++) {
-          merkle_concatenated[i] = mMiner.merkle_result[i];
-          merkle_concatenated[32 + i] = bytearray[i];
-        }
-
-        #ifdef DEBUG_MINING
-        Serial.print("    merkle element    "); Serial.print(k); Serial.print(": "); Serial.println(merkle_element);
-        Serial.print("    merkle concatenated: ");
-        for (size_t i = 0; i < 64; i++)
-            Serial.printf("%02x", merkle_concatenated[i]);
-        Serial.println("");
-        #endif
-
-        mbedtls_sha256_context ctx;
-        mbedtls_sha256_init(&ctx);
-        mbedtls_sha256_starts_ret(&ctx,0);
-        mbedtls_sha256_update_ret(&ctx, merkle_concatenated, 64);
-        mbedtls_sha256_finish_ret(&ctx, interResult);
-
-        mbedtls_sha256_starts_ret(&ctx,0);
-        mbedtls_sha256_update_ret(&ctx, interResult, 32);
-        mbedtls_sha256_finish_ret(&ctx, mMiner.merkle_result);
-        mbedtls_sha256_free(&ctx);
-
-        #ifdef DEBUG_MINING
-        Serial.print("    merkle sha         : ");
+    for (int k = 0; k < mJob.merkle_branch_count; k++) {
+        Serial.print("    merkle element    "); Serial.print(k); Serial.print(": ");
         for (size_t i = 0; i < 32; i++)
-            Serial.printf("%02x", mMiner.merkle_result[i]);
+            Serial.printf("%02x", mJob.merkle_branch[k][i]);
         Serial.println("");
-        #endif
     }
-    // merkle root from merkle_result
+    #endif
+
+    job_merkle_root(mJob, shaResult, mMiner.merkle_result);
+    NOTIFY_TRACE_STAGE(TRACE_MERKLE);
     
     Serial.print("    merkle sha         : ");
-    char merkle_root[65];
-    for (int i = 0; i < 32; i++) {
+    for (int i = 0; i < 32; i++)
       Serial.printf("%02x", mMiner.merkle_result[i]);
-      snprintf(&merkle_root[i*2], 3, "%02x", mMiner.merkle_result[i]);
-    }
-    merkle_root[65] = 0;
     Serial.println("");
 
     // calculate blockheader
     // j.block_header = ''.join([j.version, j.prevhash, merkle_root, j.ntime, j.nbits])
-    String blockheader = mJob.version + mJob.prev_block_hash + String(merkle_root) + mJob.ntime + mJob.nbits + "00000000";
-    str_len = blockheader.length()/2;
-    
-    //uint8_t bytearray_blockheader[str_len];
-    res = to_byte_array(blockheader.c_str(), str_len*2, mMiner.bytearray_blockheader);
-
-    #ifdef DEBUG_MINING
-    Serial.println("    blockheader: "); Serial.print(blockheader);
-    Serial.println("    blockheader bytes "); Serial.print(str_len); Serial.print(" -> ");
-    #endif
-
-    // reverse version
-    uint8_t buff;
-    size_t bword, bsize, boffset;
-    boffset = 0;
-    bsize = 4;
-    for (size_t j = boffset; j < boffset + (bsize/2); j++) {
-        buff = mMiner.bytearray_blockheader[j];
-        mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j];
-        mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j] = buff;
-    }
-
-    // reverse prev hash (4-byte word swap)
-    boffset = 4;
-    bword = 4;
-    bsize = 32;
-    for (size_t i = 1; i <= bsize / bword; i++) {
-        for (size_t j = boffset; j < boffset + bword / 2; j++) {
-            buff = mMiner.bytearray_blockheader[j];
-            mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j];
-            mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j] = buff;
-        }
-        boffset += bword;
-    }
-
-/*
-    // reverse merkle (4-byte word swap)
-    boffset = 36;
-    bword = 4;
-    bsize = 32;
-    for (size_t i = 1; i <= bsize / bword; i++) {
-        for (size_t j = boffset; j < boffset + bword / 2; j++) {
-            buff = mMiner.bytearray_blockheader[j];
-            mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j];
-            mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j] = buff;
-        }
-        boffset += bword;
-    }
-*/
-    // reverse ntime
-    boffset = 68;
-    bsize = 4;
-    for (size_t j = boffset; j < boffset + (bsize/2); j++) {
-        buff = mMiner.bytearray_blockheader[j];
-        mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j];
-        mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j] = buff;
-    }
-
-    // reverse difficulty
-    boffset = 72;
-    bsize = 4;
-    for (size_t j = boffset; j < boffset + (bsize/2); j++) {
-        buff = mMiner.bytearray_blockheader[j];
-        mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j];
-        mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j] = buff;
-    }
+    job_block_header(mJob, mMiner.merkle_result, mMiner.bytearray_blockheader);
+    NOTIFY_TRACE_STAGE(TRACE_HEADER);
 
 
     #ifdef DEBUG_MINING
@@ -424,7 +299,7 @@ miner_data calculateMiningData(mining_subscribe& mWorker, mining_job mJob){
         Serial.printf("%02x", mMiner.bytearray_blockheader[i]);
     Serial.println("");
     Serial.println("bytearray_blockheader: ");
-    for (size_t i = 0; i < str_len; i++) {
+    for (size_t i = 0; i < 80; i++) {
       Serial.printf("%02x", mMiner.bytearray_blockheader[i]);
     }
     Serial.println("");
@@ -0,0 +1,143 @@
+#ifndef VARDIFF_H
+#define VARDIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+// Local share vardiff: the hashrate measured from the miner counters gives the difficulty
+// that yields one share every VARDIFF_SHARE_INTERVAL_S, the stratum task asks the pool for
+// it with mining.suggest_difficulty. Portable, also built by [env:native]
+#ifndef VARDIFF_SHARE_INTERVAL_S
+#define VARDIFF_SHARE_INTERVAL_S  30        // wanted seconds between shares, -D to change
+#endif
+#define VARDIFF_WINDOW_MS         10000     // one hashrate sample
+#define VARDIFF_WINDOWS_MIN       3         // samples before the first suggestion
+#define VARDIFF_RETARGET_MS       120000    // suggestions at most this often
+#define VARDIFF_HYSTERESIS        0.75      // log2 of the distance to the target that is tolerated
+#define VARDIFF_DIFF_MIN          0.0001
+#define VARDIFF_DIFF_MAX          4294967296.0
+
+class ShareVardiff
+{
+public:
+    ShareVardiff() { reset(0, 0); }
+
+    // New pool session, pool_difficulty is what the miners start with
+    void reset(double pool_difficulty, uint32_t now_ms)
+    {
+        hashrate_ = 0;
+        windows_ = 0;
+        window_ms_ = now_ms;
+        window_nonces_ = 0;
+        nonces_ = 0;
+        started_ = false;
+        suggested_ = 0;
+        suggested_ms_ = now_ms;
+        suggestions_ = 0;
+        difficulty(pool_difficulty, now_ms);
+    }
+
+    // mining.set_difficulty: the share cadence is measured again from here
+    void difficulty(double pool_difficulty, uint32_t now_ms)
+    {
+        pool_difficulty_ = pool_difficulty;
+        shares_ = 0;
+        shares_ms_ = now_ms;
+    }
+
+    // A share at the pool difficulty went out
+    void share() { shares_++; }
+
+    // Once per stratum round with the nonces hashed since boot. True when a new difficulty
+    // should be suggested, see suggested()
+    bool tick(uint64_t nonces, uint32_t now_ms)
+    {
+        if (!started_)
+        {
+            started_ = true;
+            nonces_ = nonces;
+            window_ms_ = now_ms;
+            return false;
+        }
+        window_nonces_ += nonces - nonces_;
+        nonces_ = nonces;
+        uint32_t elapsed = now_ms - window_ms_;
+        if (elapsed < VARDIFF_WINDOW_MS)
+            return false;
+
+        // Exponential average over ~3 windows, the first one taken as it is
+        double rate = window_nonces_ * 1000.0 / elapsed;
+        hashrate_ = windows_ ? hashrate_ + (rate - hashrate_) * 0.3 : rate;
+        windows_++;
+        window_nonces_ = 0;
+        window_ms_ = now_ms;
+        if (windows_ < VARDIFF_WINDOWS_MIN || hashrate_ <= 0)
+            return false;
+        // Still moving after a hashrate change: wait for the average to catch up rather than
+        // suggest every value on the way
+        if (fabs(log2(rate / hashrate_)) > 0.25)
+            return false;
+        if (suggestions_ && now_ms - suggested_ms_ < VARDIFF_RETARGET_MS)
+            return false;
+
+        // Difficulty 1 takes 2^32 hashes a share. Suggested in powers of two, and only once the
+        // target is 2^0.75 off the current one so a rate sitting between two does not flap
+        double target = target_difficulty();
+        double current = suggestions_ ? suggested_ : pool_difficulty_;
+        if (current > 0 && fabs(log2(target / current)) <= VARDIFF_HYSTERESIS)
+            return false;
+        double next = exp2(floor(log2(target) + 0.5));
+        if (next < VARDIFF_DIFF_MIN)
+            next = VARDIFF_DIFF_MIN;
+        if (next == suggested_)
+            return false;
+        suggested_ = next;
+        suggested_ms_ = now_ms;
+        suggestions_++;
+        return true;
+    }
+
+    // Difficulty to ask for, also on keepalives: the pool's until a suggestion was made
+    double suggested() const { return suggestions_ ? suggested_ : pool_difficulty_; }
+
+    double hashrate() const { return hashrate_; }
+
+    double target_difficulty() const
+    {
+        double target = hashrate_ * VARDIFF_SHARE_INTERVAL_S / 4294967296.0;
+        return target < VARDIFF_DIFF_MIN ? VARDIFF_DIFF_MIN : target > VARDIFF_DIFF_MAX ? VARDIFF_DIFF_MAX : target;
+    }
+
+    // Seconds between shares since the pool set its difficulty, 0 before the first one
+    double share_interval(uint32_t now_ms) const { return shares_ ? (now_ms - shares_ms_) / 1000.0 / shares_ : 0; }
+
+    uint32_t suggestions() const { return suggestions_; }
+
+    // "812.3 kH/s, pool diff 0.002 suggested 0.0039, share every 27.4 s over 12 (expected 10.6 s, target 30 s)"
+    size_t format(char* out, size_t size, uint32_t now_ms) const
+    {
+        double expected = hashrate_ > 0 ? pool_difficulty_ * 4294967296.0 / hashrate_ : 0;
+        int len = snprintf(out, size, "%.1f kH/s, pool diff %.6g suggested %.6g, share every %.1f s over %u (expected %.1f s, target %d s)",
+                           hashrate_ / 1000.0, pool_difficulty_, suggested(), share_interval(now_ms), shares_, expected,
+                           VARDIFF_SHARE_INTERVAL_S);
+        return len > 0 ? len : 0;
+    }
+
+private:
+    double hashrate_;           // H/s
+    uint32_t windows_;
+    uint32_t window_ms_;
+    uint64_t window_nonces_;
+    uint64_t nonces_;           // counter value at the last tick
+    bool started_;
+    double pool_difficulty_;
+    uint32_t shares_;           // since the pool difficulty changed
+    uint32_t shares_ms_;
+    double suggested_;
+    uint32_t suggested_ms_;
+    uint32_t suggestions_;
+};
+
+#endif // VARDIFF_H